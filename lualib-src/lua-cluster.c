@@ -16,6 +16,12 @@
 	return 
 		string request
 		uint32_t next_session
+
+	when sz >= MULTI_PART, return
+		string request (the multi req)
+		uint32_t next_session
+		table parts : lightuserdata part1, integer size1, lightuserdata part2, ...
+			each multi part is a C buffer, send them by socket one by one (or skynet.trash them)
  */
 
 #define TEMP_LENGTH 0x8200
@@ -73,6 +79,12 @@ fill_header(lua_State *L, uint8_t *buf, int sz) {
 		BYTE 2/3 ; 2:multipart, 3:multipart end
 		DWORD SESSION
 		PADDING msgpart(sz)
+
+	batch of requests (see clusterd.lua), only sent when cluster_batch is enabled,
+	because the nodes of older versions reply "Invalid req package type 4"
+		WORD sz + 1
+		BYTE 4
+		PADDING requests(sz)	; the packages above with their WORD size, but not batch
  */
 static int
 packreq_number(lua_State *L, int session, void * msg, uint32_t sz, int is_push) {
@@ -133,26 +145,31 @@ packreq_string(lua_State *L, int session, void * msg, uint32_t sz, int is_push)
 	}
 }
 
+// push the parts (a C buffer each) into the table on the top, each byte of msg is copied only once
 static void
 packreq_multi(lua_State *L, int session, void * msg, uint32_t sz) {
-	uint8_t buf[TEMP_LENGTH];
 	int part = (sz - 1) / MULTI_PART + 1;
 	int i;
 	char *ptr = msg;
 	for (i=0;i<part;i++) {
 		uint32_t s;
+		uint8_t * buf;
 		if (sz > MULTI_PART) {
 			s = MULTI_PART;
+			buf = skynet_malloc(s+7);
 			buf[2] = 2;
 		} else {
 			s = sz;
+			buf = skynet_malloc(s+7);
 			buf[2] = 3;	// the last multi part
 		}
 		fill_header(L, buf, s+5);
 		fill_uint32(buf+3, (uint32_t)session);
 		memcpy(buf+7, ptr, s);
-		lua_pushlstring(L, (const char *)buf, s+7);
-		lua_rawseti(L, -2, i+1);
+		lua_pushlightuserdata(L, buf);
+		lua_rawseti(L, -2, i*2+1);
+		lua_pushinteger(L, s+7);
+		lua_rawseti(L, -2, i*2+2);
 		sz -= s;
 		ptr += s;
 	}
@@ -183,7 +200,7 @@ packrequest(lua_State *L, int is_push) {
 	}
 	lua_pushinteger(L, new_session);
 	if (multipak) {
-		lua_createtable(L, multipak, 0);
+		lua_createtable(L, multipak * 2, 0);
 		packreq_multi(L, session, msg, sz);
 		skynet_free(msg);
 		return 3;
@@ -203,15 +220,74 @@ lpackpush(lua_State *L) {
 	return packrequest(L, 1);
 }
 
+/*
+	table requests (the strings return by packrequest/packpush)
+	return string batch
+ */
+static int
+lpackbatch(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int n = (int)lua_rawlen(L, 1);
+	if (n == 1) {
+		lua_rawgeti(L, 1, 1);
+		return 1;
+	}
+	size_t sz = 1;
+	int i;
+	for (i=1;i<=n;i++) {
+		size_t s;
+		lua_rawgeti(L, 1, i);
+		const char * req = lua_tolstring(L, -1, &s);
+		if (req == NULL || s < 3 || req[2] == 4) {
+			return luaL_error(L, "Invalid request %d in batch", i);
+		}
+		sz += s;
+		lua_pop(L, 1);
+	}
+	if (sz >= 0x10000) {
+		return luaL_error(L, "The batch is too large (size=%d)", (int)sz);
+	}
+	luaL_Buffer b;
+	uint8_t * buf = (uint8_t *)luaL_buffinitsize(L, &b, sz+2);
+	fill_header(L, buf, sz);
+	buf[2] = 4;
+	luaL_addsize(&b, 3);
+	for (i=1;i<=n;i++) {
+		lua_rawgeti(L, 1, i);
+		luaL_addvalue(&b);
+	}
+	luaL_pushresult(&b);
+	return 1;
+}
+
 /*
 	string packed message
+	table large requests (optional, session -> receive buffer)
 	return 	
 		uint32_t or string addr
 		int session
 		string msg
 		boolean padding
+
+	If the large requests table is given, the multi parts are appended into a receive buffer
+	(it grows as the parts arrive, up to the size in multi req) instead of returning the part as a string.
+	It returns (addr, session, nil, true) until the last part, and then
+		uint32_t or string addr
+		int session
+		lightuserdata msg (send it to other service, or skynet.trash it)
+		uint32_t sz
+		boolean is_push
+	or (false, session) if the large request is invalid.
  */
 
+struct large_request {
+	char * buffer;
+	uint32_t size;
+	uint32_t offset;
+	uint32_t cap;
+	int is_push;
+};
+
 static inline uint32_t
 unpack_uint32(const uint8_t * buf) {
 	return buf[0] | buf[1]<<8 | buf[2]<<16 | buf[3]<<24;
@@ -310,27 +386,160 @@ unpackmreq_string(lua_State *L, const uint8_t * buf, int sz, int is_push) {
 	return 5;
 }
 
+static int
+unpackreq_batch(lua_State *L, const uint8_t * buf, int sz) {
+	lua_newtable(L);
+	int n = 0;
+	int offset = 1;
+	while (offset < sz) {
+		if (sz - offset < 2) {
+			return luaL_error(L, "Invalid cluster batch message (size=%d)", sz);
+		}
+		int s = buf[offset] << 8 | buf[offset+1];
+		offset += 2;
+		if (s < 1 || s > sz - offset || buf[offset] == 4) {
+			return luaL_error(L, "Invalid cluster batch message (size=%d)", sz);
+		}
+		lua_pushlstring(L, (const char *)buf+offset, s);
+		lua_rawseti(L, -2, ++n);
+		offset += s;
+	}
+	return 1;
+}
+
+static int
+lrelease_large(lua_State *L) {
+	struct large_request *req = lua_touserdata(L, 1);
+	skynet_free(req->buffer);
+	req->buffer = NULL;
+	return 0;
+}
+
+// the results of unpackmreq_* are at 3-7 : addr, session, size, true, is_push
+static int
+large_begin(lua_State *L) {
+	uint32_t size = (uint32_t)lua_tointeger(L, 5);
+	if (size == 0) {
+		return luaL_error(L, "Invalid cluster multi req size 0");
+	}
+	struct large_request *req = lua_newuserdata(L, sizeof(*req));
+	req->buffer = NULL;
+	req->size = size;
+	req->offset = 0;
+	req->cap = size < MULTI_PART ? size : MULTI_PART;
+	req->is_push = lua_toboolean(L, 7);
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_setmetatable(L, -2);
+	// don't trust the size in multi req, the buffer grows as the parts arrive
+	req->buffer = skynet_malloc(req->cap);
+	lua_pushvalue(L, 3);
+	lua_setuservalue(L, -2);	// keep addr in uservalue
+	lua_pushvalue(L, 4);
+	lua_insert(L, -2);
+	lua_settable(L, 2);	// requests[session] = req
+	lua_pushnil(L);
+	lua_replace(L, 5);	// no msg
+	return 5;
+}
+
+static int
+large_append(lua_State *L, const uint8_t * buf, int sz) {
+	if (sz < 5) {
+		return luaL_error(L, "Invalid cluster multi part message");
+	}
+	int last = (buf[0] == 3);
+	uint32_t session = unpack_uint32(buf+1);
+	lua_pushboolean(L, 0);	// 3: no address
+	lua_pushinteger(L, session);	// 4
+	lua_pushvalue(L, 4);
+	lua_gettable(L, 2);	// 5
+	struct large_request *req = lua_touserdata(L, 5);
+	if (req == NULL || req->buffer == NULL) {
+		lua_settop(L, 4);
+		if (last) {
+			return 2;
+		}
+		// ignore the part, report at the last one
+		lua_pushnil(L);
+		lua_pushboolean(L, 1);
+		return 4;
+	}
+	uint32_t s = sz - 5;
+	// all the parts but the last one are MULTI_PART bytes (see packreq_multi)
+	if (s > req->size - req->offset || (!last && s != MULTI_PART)) {
+		lua_pushvalue(L, 4);
+		lua_pushnil(L);
+		lua_settable(L, 2);
+		return luaL_error(L, "Invalid cluster multi part message (size=%d)", sz);
+	}
+	if (req->offset + s > req->cap) {
+		uint32_t cap = req->cap;
+		while (cap < req->offset + s) {
+			cap = (uint64_t)cap * 2 < req->size ? cap * 2 : req->size;
+		}
+		req->buffer = skynet_realloc(req->buffer, cap);
+		req->cap = cap;
+	}
+	memcpy(req->buffer + req->offset, buf+5, s);
+	req->offset += s;
+	if (!last) {
+		lua_settop(L, 4);
+		lua_pushnil(L);
+		lua_pushboolean(L, 1);
+		return 4;
+	}
+	lua_pushvalue(L, 4);
+	lua_pushnil(L);
+	lua_settable(L, 2);	// requests[session] = nil
+	if (req->offset != req->size) {
+		lua_settop(L, 4);
+		return 2;
+	}
+	lua_getuservalue(L, 5);
+	lua_replace(L, 3);	// addr
+	char * buffer = req->buffer;
+	uint32_t size = req->size;
+	int is_push = req->is_push;
+	req->buffer = NULL;
+	lua_pushlightuserdata(L, buffer);
+	lua_replace(L, 5);
+	lua_pushinteger(L, size);
+	lua_pushboolean(L, is_push);
+	return 5;
+}
+
 static int
 lunpackrequest(lua_State *L) {
 	size_t ssz;
 	const char *msg = luaL_checklstring(L,1,&ssz);
 	int sz = (int)ssz;
+	lua_settop(L, 2);
+	int large = lua_istable(L, 2);
 	switch (msg[0]) {
 	case 0:
 		return unpackreq_number(L, (const uint8_t *)msg, sz);
 	case 1:
-		return unpackmreq_number(L, (const uint8_t *)msg, sz, 0);	// request
+		unpackmreq_number(L, (const uint8_t *)msg, sz, 0);	// request
+		return large ? large_begin(L) : 5;
 	case '\x41':
-		return unpackmreq_number(L, (const uint8_t *)msg, sz, 1);	// push
+		unpackmreq_number(L, (const uint8_t *)msg, sz, 1);	// push
+		return large ? large_begin(L) : 5;
 	case 2:
 	case 3:
+		if (large) {
+			return large_append(L, (const uint8_t *)msg, sz);
+		}
 		return unpackmreq_part(L, (const uint8_t *)msg, sz);
+	case 4:
+		return unpackreq_batch(L, (const uint8_t *)msg, sz);	// return a table of requests
 	case '\x80':
 		return unpackreq_string(L, (const uint8_t *)msg, sz);
 	case '\x81':
-		return unpackmreq_string(L, (const uint8_t *)msg, sz, 0 );	// request
+		unpackmreq_string(L, (const uint8_t *)msg, sz, 0 );	// request
+		return large ? large_begin(L) : 5;
 	case '\xc1':
-		return unpackmreq_string(L, (const uint8_t *)msg, sz, 1 );	// push
+		unpackmreq_string(L, (const uint8_t *)msg, sz, 1 );	// push
+		return large ? large_begin(L) : 5;
 	default:
 		return luaL_error(L, "Invalid req package type %d", msg[0]);
 	}
@@ -358,6 +567,7 @@ lunpackrequest(lua_State *L) {
 	lightuserdata msg
 	int sz
 	return string response
+		or table parts (sz > MULTI_PART) : lightuserdata part1, integer size1, ... send them by socket one by one
  */
 static int
 lpackresponse(lua_State *L) {
@@ -382,18 +592,21 @@ lpackresponse(lua_State *L) {
 		}
 	} else {
 		if (sz > MULTI_PART) {
-			// return 
+			// return a table of C buffers : lightuserdata part1, integer size1, ...
+			// the multi part begin and each part are sent by socket one by one
 			int part = (sz - 1) / MULTI_PART + 1;
-			lua_createtable(L, part+1, 0);
-			uint8_t buf[TEMP_LENGTH];
+			lua_createtable(L, part*2+2, 0);
 
 			// multi part begin
+			uint8_t * buf = skynet_malloc(11);
 			fill_header(L, buf, 9);
 			fill_uint32(buf+2, session);
 			buf[6] = 2;
 			fill_uint32(buf+7, (uint32_t)sz);
-			lua_pushlstring(L, (const char *)buf, 11);
+			lua_pushlightuserdata(L, buf);
 			lua_rawseti(L, -2, 1);
+			lua_pushinteger(L, 11);
+			lua_rawseti(L, -2, 2);
 
 			char * ptr = msg;
 			int i;
@@ -401,16 +614,20 @@ lpackresponse(lua_State *L) {
 				int s;
 				if (sz > MULTI_PART) {
 					s = MULTI_PART;
+					buf = skynet_malloc(s+7);
 					buf[6] = 3;
 				} else {
 					s = sz;
+					buf = skynet_malloc(s+7);
 					buf[6] = 4;
 				}
 				fill_header(L, buf, s+5);
 				fill_uint32(buf+2, session);
 				memcpy(buf+7,ptr,s);
-				lua_pushlstring(L, (const char *)buf, s+7);
-				lua_rawseti(L, -2, i+2);
+				lua_pushlightuserdata(L, buf);
+				lua_rawseti(L, -2, i*2+3);
+				lua_pushinteger(L, s+7);
+				lua_rawseti(L, -2, i*2+4);
 				sz -= s;
 				ptr += s;
 			}
@@ -512,7 +729,7 @@ luaopen_skynet_cluster_core(lua_State *L) {
 	luaL_Reg l[] = {
 		{ "packrequest", lpackrequest },
 		{ "packpush", lpackpush },
-		{ "unpackrequest", lunpackrequest },
+		{ "packbatch", lpackbatch },
 		{ "packresponse", lpackresponse },
 		{ "unpackresponse", lunpackresponse },
 		{ "concat", lconcat },
@@ -521,5 +738,12 @@ luaopen_skynet_cluster_core(lua_State *L) {
 	luaL_checkversion(L);
 	luaL_newlib(L,l);
 
+	// metatable of large request, the upvalue of unpackrequest
+	lua_createtable(L, 0, 1);
+	lua_pushcfunction(L, lrelease_large);
+	lua_setfield(L, -2, "__gc");
+	lua_pushcclosure(L, lunpackrequest, 1);
+	lua_setfield(L, -2, "unpackrequest");
+
 	return 1;
 }
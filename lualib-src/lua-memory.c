@@ -43,6 +43,12 @@ lexpandshrtbl(lua_State *L) {
 	return 0;
 }
 
+static int
+lpurge(lua_State *L) {
+	malloc_purge();
+	return 0;
+}
+
 static int
 lcurrent(lua_State *L) {
 	lua_pushinteger(L, malloc_current_memory());
@@ -62,6 +68,9 @@ luaopen_skynet_memory(lua_State *L) {
 		{ "ssinfo", luaS_shrinfo },
 		{ "ssexpand", lexpandshrtbl },
 		{ "current", lcurrent },
+		{ "slab", dump_slab_lua },
+		{ "jemalloc", dump_jemalloc_lua },
+		{ "purge", lpurge },
 		{ NULL, NULL },
 	};
 
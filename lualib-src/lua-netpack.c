@@ -3,6 +3,7 @@
 #include "skynet_malloc.h"
 
 #include "skynet_socket.h"
+#include "frame_header.h"
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -22,11 +23,23 @@
 #define TYPE_OPEN 4
 #define TYPE_CLOSE 5
 #define TYPE_WARNING 6
+#define TYPE_BATCH 7
+#define TYPE_INVALID 8
+
+// the last upvalue of filter, after the type names
+#define BATCH_METATABLE 9
+
+// uncomplete.read
+#define UNCOMPLETE_HEADER -1
+#define UNCOMPLETE_INVALID -2
 
 /*
 	Each package is uint16 + data , uint16 (serialized in big-endian) is the number of bytes comprising the data .
+	The queue created by netpack.queue(format) can use the other header formats, see frame_header.h .
  */
 
+static const struct frame_format DEFAULT_FORMAT = { 'S', 0x10000 };
+
 struct netpack {
 	int id;
 	int size;
@@ -36,11 +49,31 @@ struct netpack {
 struct uncomplete {
 	struct netpack pack;
 	struct uncomplete * next;
-	int read;
-	int header;
+	int read;	// UNCOMPLETE_HEADER : reading header, UNCOMPLETE_INVALID : drop all the data
+	int headlen;
+	uint8_t head[FRAME_HEADER_MAX];
+};
+
+/*
+	All the complete packages of one socket message, returned by netpack.filterbatch .
+	The frames point into the socket buffer (or the package completed by this message),
+	which is owned by the batch and released by netpack.release (or gc) .
+ */
+struct batch_frame {
+	int offset;
+	int size;
+};
+
+struct batch {
+	int n;
+	uint8_t * buffer;
+	void * leftover;
+	int leftover_size;
+	struct batch_frame frame[];
 };
 
 struct queue {
+	struct frame_format format;
 	int cap;
 	int head;
 	int tail;
@@ -113,18 +146,25 @@ find_uncomplete(struct queue *q, int fd) {
 	return NULL;
 }
 
+static struct queue *
+new_queue(lua_State *L, const struct frame_format *format) {
+	struct queue *q = lua_newuserdata(L, sizeof(struct queue));
+	q->format = *format;
+	q->cap = QUEUESIZE;
+	q->head = 0;
+	q->tail = 0;
+	int i;
+	for (i=0;i<HASHSIZE;i++) {
+		q->hash[i] = NULL;
+	}
+	return q;
+}
+
 static struct queue *
 get_queue(lua_State *L) {
 	struct queue *q = lua_touserdata(L,1);
 	if (q == NULL) {
-		q = lua_newuserdata(L, sizeof(struct queue));
-		q->cap = QUEUESIZE;
-		q->head = 0;
-		q->tail = 0;
-		int i;
-		for (i=0;i<HASHSIZE;i++) {
-			q->hash[i] = NULL;
-		}
+		q = new_queue(L, &DEFAULT_FORMAT);
 		lua_replace(L, 1);
 	}
 	return q;
@@ -133,6 +173,7 @@ get_queue(lua_State *L) {
 static void
 expand_queue(lua_State *L, struct queue *q) {
 	struct queue *nq = lua_newuserdata(L, sizeof(struct queue) + q->cap * sizeof(struct netpack));
+	nq->format = q->format;
 	nq->cap = q->cap + QUEUESIZE;
 	nq->head = 0;
 	nq->tail = q->cap;
@@ -179,23 +220,33 @@ save_uncomplete(lua_State *L, int fd) {
 	return uc;
 }
 
-static inline int
-read_size(uint8_t * buffer) {
-	int r = (int)buffer[0] << 8 | (int)buffer[1];
-	return r;
+static inline void
+relink_uncomplete(struct queue *q, struct uncomplete *uc) {
+	int h = hash_fd(uc->pack.id);
+	uc->next = q->hash[h];
+	q->hash[h] = uc;
+}
+
+static inline const struct frame_format *
+queue_format(struct queue *q) {
+	return q ? &q->format : &DEFAULT_FORMAT;
 }
 
+// the headers in buffer are checked by scan_frames
 static void
-push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
-	if (size == 1) {
+push_more(lua_State *L, int fd, const struct frame_format *format, uint8_t *buffer, int size) {
+	int pack_size;
+	int len = frame_read_header(format, buffer, size, &pack_size);
+	if (len == 0) {
 		struct uncomplete * uc = save_uncomplete(L, fd);
-		uc->read = -1;
-		uc->header = *buffer;
+		uc->read = UNCOMPLETE_HEADER;
+		uc->headlen = size;
+		memcpy(uc->head, buffer, size);
 		return;
 	}
-	int pack_size = read_size(buffer);
-	buffer += 2;
-	size -= 2;
+	assert(len > 0);
+	buffer += len;
+	size -= len;
 
 	if (size < pack_size) {
 		struct uncomplete * uc = save_uncomplete(L, fd);
@@ -210,7 +261,7 @@ push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
 	buffer += pack_size;
 	size -= pack_size;
 	if (size > 0) {
-		push_more(L, fd, buffer, size);
+		push_more(L, fd, format, buffer, size);
 	}
 }
 
@@ -224,35 +275,109 @@ close_uncomplete(lua_State *L, int fd) {
 	}
 }
 
+/*
+	Fill the uncomplete package of fd with the head of buffer, and move buffer/size forward.
+	return 1 if the package is completed, 0 if it's still uncomplete (saved again), -1 if the header is invalid.
+ */
+static int
+fill_uncomplete(struct queue *q, struct uncomplete *uc, const struct frame_format *format, uint8_t **buffer, int *size) {
+	if (uc->read == UNCOMPLETE_INVALID) {
+		// drop the data until the socket is closed
+		*size = 0;
+		relink_uncomplete(q, uc);
+		return 0;
+	}
+	if (uc->read == UNCOMPLETE_HEADER) {
+		// read size, the header may be shorter than the bytes copied (varint)
+		int old = uc->headlen;
+		int c = *size < FRAME_HEADER_MAX - old ? *size : FRAME_HEADER_MAX - old;
+		memcpy(uc->head + old, *buffer, c);
+		int pack_size;
+		int len = frame_read_header(format, uc->head, old + c, &pack_size);
+		if (len < 0) {
+			return -1;
+		}
+		if (len == 0) {
+			uc->headlen = old + c;
+			*size = 0;
+			relink_uncomplete(q, uc);
+			return 0;
+		}
+		*buffer += len - old;
+		*size -= len - old;
+		uc->pack.size = pack_size;
+		uc->pack.buffer = skynet_malloc(pack_size);
+		uc->read = 0;
+	}
+	int need = uc->pack.size - uc->read;
+	if (*size < need) {
+		memcpy(uc->pack.buffer + uc->read, *buffer, *size);
+		uc->read += *size;
+		*size = 0;
+		relink_uncomplete(q, uc);
+		return 0;
+	}
+	memcpy(uc->pack.buffer + uc->read, *buffer, need);
+	*buffer += need;
+	*size -= need;
+	return 1;
+}
+
+// scan the headers in one pass, return the number of complete packages (-1 if a header is invalid) and the bytes they take
+static int
+scan_frames(const struct frame_format *format, uint8_t * buffer, int size, int base, struct batch_frame *frame, int *consumed) {
+	int n = 0;
+	int offset = 0;
+	while (offset < size) {
+		int pack_size;
+		int len = frame_read_header(format, buffer + offset, size - offset, &pack_size);
+		if (len < 0)
+			return -1;
+		if (len == 0 || size - offset - len < pack_size)
+			break;
+		if (frame) {
+			frame[n].offset = base + offset + len;
+			frame[n].size = pack_size;
+		}
+		offset += len + pack_size;
+		++n;
+	}
+	*consumed = offset;
+	return n;
+}
+
+// the stream of fd can't be split any more, drop the following data and report it
+static int
+invalid_stream(lua_State *L, int fd) {
+	struct uncomplete * uc = save_uncomplete(L, fd);
+	uc->read = UNCOMPLETE_INVALID;
+	lua_pushvalue(L, lua_upvalueindex(TYPE_INVALID));
+	lua_pushinteger(L, fd);
+	lua_pushliteral(L, "Invalid package header");
+	return 4;
+}
+
 static int
 filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 	struct queue *q = lua_touserdata(L,1);
+	const struct frame_format *format = queue_format(q);
 	struct uncomplete * uc = find_uncomplete(q, fd);
 	if (uc) {
 		// fill uncomplete
-		if (uc->read < 0) {
-			// read size
-			assert(uc->read == -1);
-			int pack_size = *buffer;
-			pack_size |= uc->header << 8 ;
-			++buffer;
-			--size;
-			uc->pack.size = pack_size;
-			uc->pack.buffer = skynet_malloc(pack_size);
-			uc->read = 0;
-		}
-		int need = uc->pack.size - uc->read;
-		if (size < need) {
-			memcpy(uc->pack.buffer + uc->read, buffer, size);
-			uc->read += size;
-			int h = hash_fd(fd);
-			uc->next = q->hash[h];
-			q->hash[h] = uc;
+		int r = fill_uncomplete(q, uc, format, &buffer, &size);
+		if (r == 0) {
 			return 1;
 		}
-		memcpy(uc->pack.buffer + uc->read, buffer, need);
-		buffer += need;
-		size -= need;
+		if (r < 0) {
+			skynet_free(uc);
+			return invalid_stream(L, fd);
+		}
+		int consumed;
+		if (size > 0 && scan_frames(format, buffer, size, 0, NULL, &consumed) < 0) {
+			skynet_free(uc->pack.buffer);
+			skynet_free(uc);
+			return invalid_stream(L, fd);
+		}
 		if (size == 0) {
 			lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
 			lua_pushinteger(L, fd);
@@ -264,48 +389,92 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		// more data
 		push_data(L, fd, uc->pack.buffer, uc->pack.size, 0);
 		skynet_free(uc);
-		push_more(L, fd, buffer, size);
+		push_more(L, fd, format, buffer, size);
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	} else {
-		if (size == 1) {
-			struct uncomplete * uc = save_uncomplete(L, fd);
-			uc->read = -1;
-			uc->header = *buffer;
-			return 1;
+		int consumed;
+		int n = scan_frames(format, buffer, size, 0, NULL, &consumed);
+		if (n < 0) {
+			return invalid_stream(L, fd);
 		}
-		int pack_size = read_size(buffer);
-		buffer+=2;
-		size-=2;
-
-		if (size < pack_size) {
-			struct uncomplete * uc = save_uncomplete(L, fd);
-			uc->read = size;
-			uc->pack.size = pack_size;
-			uc->pack.buffer = skynet_malloc(pack_size);
-			memcpy(uc->pack.buffer, buffer, size);
-			return 1;
-		}
-		if (size == pack_size) {
+		if (n == 1 && consumed == size) {
 			// just one package
+			int pack_size = 0;
+			int len = frame_read_header(format, buffer, size, &pack_size);
 			lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
 			lua_pushinteger(L, fd);
 			void * result = skynet_malloc(pack_size);
-			memcpy(result, buffer, size);
+			memcpy(result, buffer + len, pack_size);
 			lua_pushlightuserdata(L, result);
-			lua_pushinteger(L, size);
+			lua_pushinteger(L, pack_size);
 			return 5;
 		}
+		push_more(L, fd, format, buffer, size);
+		if (n == 0) {
+			return 1;
+		}
 		// more data
-		push_data(L, fd, buffer, pack_size, 1);
-		buffer += pack_size;
-		size -= pack_size;
-		push_more(L, fd, buffer, size);
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	}
 }
 
+static int
+filter_batch(lua_State *L, int fd, uint8_t * buffer, int size) {
+	struct queue *q = lua_touserdata(L,1);
+	const struct frame_format *format = queue_format(q);
+	struct uncomplete * uc = find_uncomplete(q, fd);
+	uint8_t * ptr = buffer;
+	void * leftover = NULL;
+	int leftover_size = 0;
+	if (uc) {
+		int r = fill_uncomplete(q, uc, format, &ptr, &size);
+		if (r == 0) {
+			skynet_free(buffer);
+			return 1;
+		}
+		if (r < 0) {
+			skynet_free(uc);
+			skynet_free(buffer);
+			return invalid_stream(L, fd);
+		}
+		leftover = uc->pack.buffer;
+		leftover_size = uc->pack.size;
+		skynet_free(uc);
+	}
+	int consumed;
+	int n = scan_frames(format, ptr, size, 0, NULL, &consumed);
+	if (n < 0) {
+		skynet_free(leftover);
+		skynet_free(buffer);
+		return invalid_stream(L, fd);
+	}
+	if (consumed < size) {
+		// the tail is an uncomplete package
+		push_more(L, fd, format, ptr + consumed, size - consumed);
+	}
+	if (n == 0) {
+		skynet_free(buffer);
+		buffer = NULL;
+		if (leftover == NULL)
+			return 1;
+	}
+	lua_pushvalue(L, lua_upvalueindex(TYPE_BATCH));
+	lua_pushinteger(L, fd);
+	struct batch * b = lua_newuserdata(L, sizeof(struct batch) + n * sizeof(struct batch_frame));
+	b->n = n;
+	b->buffer = buffer;
+	b->leftover = leftover;
+	b->leftover_size = leftover_size;
+	if (n > 0) {
+		scan_frames(format, ptr, size, (int)(ptr - buffer), b->frame, &consumed);
+	}
+	lua_pushvalue(L, lua_upvalueindex(BATCH_METATABLE));
+	lua_setmetatable(L, -2);
+	return 4;
+}
+
 static inline int
 filter_data(lua_State *L, int fd, uint8_t * buffer, int size) {
 	int ret = filter_data_(L, fd, buffer, size);
@@ -332,10 +501,10 @@ pushstring(lua_State *L, const char * msg, int size) {
 		userdata queue
 		integer type
 		integer fd
-		string msg | lightuserdata/integer
+		string msg | lightuserdata/integer | userdata batch
  */
 static int
-lfilter(lua_State *L) {
+filter_message(lua_State *L, int batch) {
 	struct skynet_socket_message *message = lua_touserdata(L,2);
 	int size = luaL_checkinteger(L,3);
 	char * buffer = message->buffer;
@@ -352,6 +521,9 @@ lfilter(lua_State *L) {
 	case SKYNET_SOCKET_TYPE_DATA:
 		// ignore listen id (message->id)
 		assert(size == -1);	// never padding string
+		if (batch) {
+			return filter_batch(L, message->id, (uint8_t *)buffer, message->ud);
+		}
 		return filter_data(L, message->id, (uint8_t *)buffer, message->ud);
 	case SKYNET_SOCKET_TYPE_CONNECT:
 		// ignore listen fd connect
@@ -386,6 +558,69 @@ lfilter(lua_State *L) {
 	}
 }
 
+static int
+lfilter(lua_State *L) {
+	return filter_message(L, 0);
+}
+
+/*
+	The same as filter, but all the complete packages in one socket message
+	return as a batch ("batch", fd, batch) instead of "data" / "more" .
+ */
+static int
+lfilterbatch(lua_State *L) {
+	return filter_message(L, 1);
+}
+
+static int
+lrelease(lua_State *L) {
+	struct batch * b = lua_touserdata(L, 1);
+	if (b == NULL) {
+		return 0;
+	}
+	skynet_free(b->buffer);
+	skynet_free(b->leftover);
+	b->buffer = NULL;
+	b->leftover = NULL;
+	b->n = 0;
+	return 0;
+}
+
+static int
+lbatch_next(lua_State *L) {
+	struct batch * b = lua_touserdata(L, 1);
+	int i = luaL_checkinteger(L, 2);
+	if (b->leftover) {
+		if (i == 0) {
+			lua_pushinteger(L, 1);
+			lua_pushlightuserdata(L, b->leftover);
+			lua_pushinteger(L, b->leftover_size);
+			return 3;
+		}
+		--i;
+	}
+	if (i >= b->n)
+		return 0;
+	lua_pushinteger(L, luaL_checkinteger(L, 2) + 1);
+	lua_pushlightuserdata(L, b->buffer + b->frame[i].offset);
+	lua_pushinteger(L, b->frame[i].size);
+	return 3;
+}
+
+/*
+	userdata batch
+	return iterator : for index, msg, sz in netpack.frames(batch)
+	msg is valid until the batch is released, don't free it.
+ */
+static int
+lframes(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TUSERDATA);
+	lua_pushcfunction(L, lbatch_next);
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, 0);
+	return 3;
+}
+
 /*
 	userdata queue
 	return
@@ -427,30 +662,63 @@ tolstring(lua_State *L, size_t *sz, int index) {
 	return ptr;
 }
 
-static inline void
-write_size(uint8_t * buffer, int len) {
-	buffer[0] = (len >> 8) & 0xff;
-	buffer[1] = len & 0xff;
-}
-
 static int
-lpack(lua_State *L) {
+pack_frame(lua_State *L, const struct frame_format *format, int index) {
 	size_t len;
-	const char * ptr = tolstring(L, &len, 1);
-	if (len >= 0x10000) {
+	const char * ptr = tolstring(L, &len, index);
+	uint8_t header[FRAME_HEADER_MAX];
+	int hlen = len > 0x7fffffff ? -1 : frame_write_header(format, header, (int)len);
+	if (hlen < 0) {
 		return luaL_error(L, "Invalid size (too long) of data : %d", (int)len);
 	}
 
-	uint8_t * buffer = skynet_malloc(len + 2);
-	write_size(buffer, len);
-	memcpy(buffer+2, ptr, len);
+	uint8_t * buffer = skynet_malloc(len + hlen);
+	memcpy(buffer, header, hlen);
+	memcpy(buffer+hlen, ptr, len);
 
 	lua_pushlightuserdata(L, buffer);
-	lua_pushinteger(L, len + 2);
+	lua_pushinteger(L, len + hlen);
 
 	return 2;
 }
 
+static int
+lpack(lua_State *L) {
+	return pack_frame(L, &DEFAULT_FORMAT, 1);
+}
+
+static void
+check_format(lua_State *L, int index, struct frame_format *format) {
+	const char * str = luaL_checkstring(L, index);
+	if (frame_format_parse(format, str)) {
+		luaL_error(L, "Invalid header format : %s", str);
+	}
+}
+
+/*
+	string format
+	string msg | lightuserdata/integer
+	return lightuserdata/integer
+ */
+static int
+lpackframe(lua_State *L) {
+	struct frame_format format;
+	check_format(L, 1, &format);
+	return pack_frame(L, &format, 2);
+}
+
+/*
+	string format ("S", "L", "s", "l" or "V", with an optional ":maxsize", see frame_header.h)
+	return userdata queue , use it as the queue of filter instead of nil
+ */
+static int
+lqueue(lua_State *L) {
+	struct frame_format format;
+	check_format(L, 1, &format);
+	new_queue(L, &format);
+	return 1;
+}
+
 static int
 ltostring(lua_State *L) {
 	void * ptr = lua_touserdata(L, 1);
@@ -472,6 +740,10 @@ luaopen_skynet_netpack(lua_State *L) {
 		{ "pack", lpack },
 		{ "clear", lclear },
 		{ "tostring", ltostring },
+		{ "frames", lframes },
+		{ "packframe", lpackframe },
+		{ "queue", lqueue },
+		{ "release", lrelease },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
@@ -483,8 +755,22 @@ luaopen_skynet_netpack(lua_State *L) {
 	lua_pushliteral(L, "open");
 	lua_pushliteral(L, "close");
 	lua_pushliteral(L, "warning");
+	lua_pushliteral(L, "batch");
+	lua_pushliteral(L, "invalid");
+
+	// metatable of batch
+	lua_createtable(L, 0, 1);
+	lua_pushcfunction(L, lrelease);
+	lua_setfield(L, -2, "__gc");
+
+	int i;
+	for (i=0;i<BATCH_METATABLE;i++) {
+		lua_pushvalue(L, -BATCH_METATABLE);
+	}
+	lua_pushcclosure(L, lfilterbatch, BATCH_METATABLE);
+	lua_setfield(L, -2 - BATCH_METATABLE, "filterbatch");
 
-	lua_pushcclosure(L, lfilter, 6);
+	lua_pushcclosure(L, lfilter, BATCH_METATABLE);
 	lua_setfield(L, -2, "filter");
 
 	return 1;
@@ -30,89 +30,101 @@
 // hibits 0~31 : len
 #define TYPE_LONG_STRING 5
 #define TYPE_TABLE 6
+#define TYPE_EXTEND 7
+// cookie of TYPE_EXTEND
+#define EXTEND_TABLE 0
+// integer array size, WORD hash size (hint), array part, hash part, nil
+#define EXTEND_KEY 1
+// a string follows, add it into the key dictionary of the message
+#define EXTEND_KEYREF 2
+// integer index of the key dictionary follows
+#define EXTEND_KEYREF_SHORT 3
+// cookie 3 ~ 31 : the key (cookie - 2) in dictionary
 
 #define MAX_COOKIE 32
+#define MAX_HASH_HINT 0xffff
+// only the tables with at least HASH_HINT_THRESHOLD keys out of array part carry the hint
+#define HASH_HINT_THRESHOLD 8
+// the string keys after the first DICT_THRESHOLD keys in a value use the key dictionary.
+// The dictionary is reset for each value of the message, so any tail of the values is a valid stream.
+#define DICT_THRESHOLD 16
 #define COMBINE_TYPE(t,v) ((t) | (v) << 3)
 
-#define BLOCK_SIZE 128
+// the first BLOCK_SIZE bytes are written into a buffer on C stack,
+// the larger stream is moved to a heap buffer growing geometrically, and the heap buffer is handed off as the message.
+#define BLOCK_SIZE 512
 #define MAX_DEPTH 32
 
-struct block {
-	struct block * next;
-	char buffer[BLOCK_SIZE];
-};
-
 struct write_block {
-	struct block * head;
-	struct block * current;
+	char * buffer;
 	int len;
-	int ptr;
+	int cap;
+	char * stack;	// the initial buffer on C stack
+	int dict;	// the stack index of key dictionary (string -> index), 0 if TYPE_EXTEND is disabled
+	int nkey;
+	int ndict;
 };
 
 struct read_block {
 	char * buffer;
 	int len;
 	int ptr;
+	int dict;	// the stack index of key dictionary (index -> string)
+	int ndict;
 };
 
-inline static struct block *
-blk_alloc(void) {
-	struct block *b = skynet_malloc(sizeof(struct block));
-	b->next = NULL;
-	return b;
+static void
+wb_expand(struct write_block *b, int sz) {
+	int cap = b->cap;
+	while (cap < b->len + sz) {
+		cap *= 2;
+	}
+	if (b->buffer == b->stack) {
+		b->buffer = skynet_malloc(cap);
+		memcpy(b->buffer, b->stack, b->len);
+	} else {
+		b->buffer = skynet_realloc(b->buffer, cap);
+	}
+	b->cap = cap;
 }
 
 inline static void
 wb_push(struct write_block *b, const void *buf, int sz) {
-	const char * buffer = buf;
-	if (b->ptr == BLOCK_SIZE) {
-_again:
-		b->current = b->current->next = blk_alloc();
-		b->ptr = 0;
-	}
-	if (b->ptr <= BLOCK_SIZE - sz) {
-		memcpy(b->current->buffer + b->ptr, buffer, sz);
-		b->ptr+=sz;
-		b->len+=sz;
-	} else {
-		int copy = BLOCK_SIZE - b->ptr;
-		memcpy(b->current->buffer + b->ptr, buffer, copy);
-		buffer += copy;
-		b->len += copy;
-		sz -= copy;
-		goto _again;
+	if (b->len + sz > b->cap) {
+		wb_expand(b, sz);
 	}
+	memcpy(b->buffer + b->len, buf, sz);
+	b->len += sz;
 }
 
 static void
-wb_init(struct write_block *wb , struct block *b) {
-	wb->head = b;
-	assert(b->next == NULL);
+wb_init(struct write_block *wb , char *stack, int dict) {
+	wb->buffer = stack;
+	wb->stack = stack;
 	wb->len = 0;
-	wb->current = wb->head;
-	wb->ptr = 0;
+	wb->cap = BLOCK_SIZE;
+	wb->dict = dict;
+	wb->nkey = 0;
+	wb->ndict = 0;
 }
 
 static void
 wb_free(struct write_block *wb) {
-	struct block *blk = wb->head;
-	blk = blk->next;	// the first block is on stack
-	while (blk) {
-		struct block * next = blk->next;
-		skynet_free(blk);
-		blk = next;
-	}
-	wb->head = NULL;
-	wb->current = NULL;
-	wb->ptr = 0;
+	if (wb->buffer != wb->stack) {
+		skynet_free(wb->buffer);
+	}
+	wb->buffer = wb->stack;
 	wb->len = 0;
+	wb->cap = BLOCK_SIZE;
 }
 
 static void
-rball_init(struct read_block * rb, char * buffer, int size) {
+rball_init(struct read_block * rb, char * buffer, int size, int dict) {
 	rb->buffer = buffer;
 	rb->len = size;
 	rb->ptr = 0;
+	rb->dict = dict;
+	rb->ndict = 0;
 }
 
 static void *
@@ -214,10 +226,54 @@ wb_string(struct write_block *wb, const char *str, int len) {
 
 static void pack_one(lua_State *L, struct write_block *b, int index, int depth);
 
+// TYPE_EXTEND can't be decoded by the older versions, so it's disabled by default, see luaseri_extend
+static int extend_format = 0;
+
+void
+luaseri_extend(int enable) {
+	extend_format = enable;
+}
+
+// count the keys out of array part, stop at limit
+static int
+hash_size(lua_State *L, int index, int array_size, int limit) {
+	int n = 0;
+	if (array_size > 0) {
+		// skip the array part
+		lua_pushinteger(L, array_size);
+	} else {
+		lua_pushnil(L);
+	}
+	while (lua_next(L, index) != 0) {
+		lua_pop(L, 1);
+		if (lua_isinteger(L, -1)) {
+			lua_Integer x = lua_tointeger(L,-1);
+			if (x>0 && x<=array_size) {
+				continue;
+			}
+		}
+		if (++n >= limit) {
+			lua_pop(L, 1);
+			break;
+		}
+	}
+	return n;
+}
+
+// *hint is the offset of the hash size hint in wb (patched after the hash part is packed), or -1
 static int
-wb_table_array(lua_State *L, struct write_block * wb, int index, int depth) {
+wb_table_array(lua_State *L, struct write_block * wb, int index, int depth, int *hint) {
 	int array_size = lua_rawlen(L,index);
-	if (array_size >= MAX_COOKIE-1) {
+	*hint = -1;
+	if (wb->dict && hash_size(L, index, array_size, HASH_HINT_THRESHOLD) >= HASH_HINT_THRESHOLD) {
+		// a table with a large hash part carries the size hints
+		uint8_t n = COMBINE_TYPE(TYPE_EXTEND, EXTEND_TABLE);
+		wb_push(wb, &n, 1);
+		wb_integer(wb, array_size);
+		uint16_t size = 0;
+		*hint = wb->len;
+		wb_push(wb, &size, sizeof(size));
+	} else if (array_size >= MAX_COOKIE-1) {
 		uint8_t n = COMBINE_TYPE(TYPE_TABLE, MAX_COOKIE-1);
 		wb_push(wb, &n, 1);
 		wb_integer(wb, array_size);
@@ -236,11 +292,54 @@ wb_table_array(lua_State *L, struct write_block * wb, int index, int depth) {
 	return array_size;
 }
 
-static void
+// pack the string key at the top of stack by the key dictionary, return 0 if it should be packed as a string
+static int
+wb_key(lua_State *L, struct write_block *wb) {
+	if (wb->dict == 0 || wb->nkey++ < DICT_THRESHOLD) {
+		return 0;
+	}
+	size_t sz = 0;
+	const char * str = lua_tolstring(L, -1, &sz);
+	if (sz < 2) {
+		// the reference is not shorter
+		return 0;
+	}
+	if (lua_type(L, wb->dict) != LUA_TTABLE) {
+		lua_newtable(L);
+		lua_replace(L, wb->dict);
+	}
+	lua_pushvalue(L, -1);
+	if (lua_rawget(L, wb->dict) == LUA_TNUMBER) {
+		int id = lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		if (id < MAX_COOKIE - EXTEND_KEYREF) {
+			uint8_t n = COMBINE_TYPE(TYPE_EXTEND, EXTEND_KEYREF + id);
+			wb_push(wb, &n, 1);
+		} else {
+			uint8_t n = COMBINE_TYPE(TYPE_EXTEND, EXTEND_KEYREF);
+			wb_push(wb, &n, 1);
+			wb_integer(wb, id);
+		}
+		return 1;
+	}
+	lua_pop(L, 1);
+	lua_pushvalue(L, -1);
+	lua_pushinteger(L, ++wb->ndict);
+	lua_rawset(L, wb->dict);
+	uint8_t n = COMBINE_TYPE(TYPE_EXTEND, EXTEND_KEY);
+	wb_push(wb, &n, 1);
+	wb_string(wb, str, (int)sz);
+	return 1;
+}
+
+// return the number of keys out of array part
+static int
 wb_table_hash(lua_State *L, struct write_block * wb, int index, int depth, int array_size) {
+	int n = 0;
 	lua_pushnil(L);
 	while (lua_next(L, index) != 0) {
-		if (lua_type(L,-2) == LUA_TNUMBER) {
+		int keytype = lua_type(L,-2);
+		if (keytype == LUA_TNUMBER) {
 			if (lua_isinteger(L, -2)) {
 				lua_Integer x = lua_tointeger(L,-2);
 				if (x>0 && x<=array_size) {
@@ -249,11 +348,21 @@ wb_table_hash(lua_State *L, struct write_block * wb, int index, int depth, int a
 				}
 			}
 		}
-		pack_one(L,wb,-2,depth);
+		if (keytype == LUA_TSTRING) {
+			lua_pushvalue(L, -2);
+			if (!wb_key(L, wb)) {
+				pack_one(L,wb,-1,depth);
+			}
+			lua_pop(L, 1);
+		} else {
+			pack_one(L,wb,-2,depth);
+		}
 		pack_one(L,wb,-1,depth);
 		lua_pop(L, 1);
+		++n;
 	}
 	wb_nil(wb);
+	return n;
 }
 
 static void
@@ -288,8 +397,13 @@ wb_table(lua_State *L, struct write_block *wb, int index, int depth) {
 	if (luaL_getmetafield(L, index, "__pairs") != LUA_TNIL) {
 		wb_table_metapairs(L, wb, index, depth);
 	} else {
-		int array_size = wb_table_array(L, wb, index, depth);
-		wb_table_hash(L, wb, index, depth, array_size);
+		int hint;
+		int array_size = wb_table_array(L, wb, index, depth, &hint);
+		int hash = wb_table_hash(L, wb, index, depth, array_size);
+		if (hint >= 0) {
+			uint16_t size = hash > MAX_HASH_HINT ? MAX_HASH_HINT : hash;
+			memcpy(wb->buffer + hint, &size, sizeof(size));
+		}
 	}
 }
 
@@ -344,6 +458,15 @@ pack_from(lua_State *L, struct write_block *b, int from) {
 	int n = lua_gettop(L) - from;
 	int i;
 	for (i=1;i<=n;i++) {
+		if (b->nkey > 0) {
+			// reset the key dictionary
+			b->nkey = 0;
+			b->ndict = 0;
+			if (b->dict) {
+				lua_pushnil(L);
+				lua_replace(L, b->dict);
+			}
+		}
 		pack_one(L, b , from + i, 0);
 	}
 }
@@ -431,28 +554,82 @@ get_buffer(lua_State *L, struct read_block *rb, int len) {
 
 static void unpack_one(lua_State *L, struct read_block *rb);
 
-static void
-unpack_table(lua_State *L, struct read_block *rb, int array_size) {
-	if (array_size == MAX_COOKIE-1) {
-		uint8_t type;
-		uint8_t *t = rb_read(rb, sizeof(type));
-		if (t==NULL) {
-			invalid_stream(L,rb);
-		}
-		type = *t;
-		int cookie = type >> 3;
-		if ((type & 7) != TYPE_NUMBER || cookie == TYPE_NUMBER_REAL) {
-			invalid_stream(L,rb);
-		}
-		array_size = get_integer(L,rb,cookie);
+static int
+read_size(lua_State *L, struct read_block *rb) {
+	uint8_t type;
+	uint8_t *t = rb_read(rb, sizeof(type));
+	if (t==NULL) {
+		invalid_stream(L,rb);
 	}
-	luaL_checkstack(L,LUA_MINSTACK,NULL);
-	lua_createtable(L,array_size,0);
+	type = *t;
+	int cookie = type >> 3;
+	if ((type & 7) != TYPE_NUMBER || cookie == TYPE_NUMBER_REAL) {
+		invalid_stream(L,rb);
+	}
+	lua_Integer n = get_integer(L,rb,cookie);
+	if (n < 0 || n > INT32_MAX) {
+		invalid_stream(L,rb);
+	}
+	return (int)n;
+}
+
+// the integers in array part (the most common elements) are decoded in place, the others by unpack_one
+static void
+unpack_array(lua_State *L, struct read_block *rb, int array_size) {
 	int i;
 	for (i=1;i<=array_size;i++) {
+		if (rb->len > 0) {
+			const uint8_t * p = (const uint8_t *)rb->buffer + rb->ptr;
+			int type = p[0];
+			int len = 0;
+			lua_Integer v = 0;
+			if ((type & 7) == TYPE_NUMBER) {
+				switch (type >> 3) {
+				case TYPE_NUMBER_ZERO:
+					len = 1;
+					break;
+				case TYPE_NUMBER_BYTE:
+					if (rb->len >= 2) {
+						v = p[1];
+						len = 2;
+					}
+					break;
+				case TYPE_NUMBER_WORD:
+					if (rb->len >= 3) {
+						uint16_t n;
+						memcpy(&n, p + 1, sizeof(n));
+						v = n;
+						len = 3;
+					}
+					break;
+				case TYPE_NUMBER_DWORD:
+					if (rb->len >= 5) {
+						int32_t n;
+						memcpy(&n, p + 1, sizeof(n));
+						v = n;
+						len = 5;
+					}
+					break;
+				}
+			}
+			if (len > 0) {
+				rb->ptr += len;
+				rb->len -= len;
+				lua_pushinteger(L, v);
+				lua_rawseti(L,-2,i);
+				continue;
+			}
+		}
 		unpack_one(L,rb);
 		lua_rawseti(L,-2,i);
 	}
+}
+
+static void
+unpack_table(lua_State *L, struct read_block *rb, int array_size, int hash_size) {
+	luaL_checkstack(L,LUA_MINSTACK,NULL);
+	lua_createtable(L,array_size,hash_size);
+	unpack_array(L, rb, array_size);
 	for (;;) {
 		unpack_one(L,rb);
 		if (lua_isnil(L,-1)) {
@@ -464,6 +641,49 @@ unpack_table(lua_State *L, struct read_block *rb, int array_size) {
 	}
 }
 
+static void
+unpack_extend(lua_State *L, struct read_block *rb, int cookie) {
+	switch (cookie) {
+	case EXTEND_TABLE: {
+		int array_size = read_size(L, rb);
+		uint16_t *phint = rb_read(rb, sizeof(uint16_t));
+		if (phint == NULL) {
+			invalid_stream(L,rb);
+		}
+		uint16_t hint;
+		memcpy(&hint, phint, sizeof(hint));
+		unpack_table(L,rb,array_size,hint);
+		break;
+	}
+	case EXTEND_KEY: {
+		unpack_one(L,rb);
+		if (lua_type(L,-1) != LUA_TSTRING || rb->dict == 0) {
+			invalid_stream(L,rb);
+		}
+		if (lua_type(L, rb->dict) != LUA_TTABLE) {
+			lua_newtable(L);
+			lua_replace(L, rb->dict);
+		}
+		lua_pushvalue(L,-1);
+		lua_rawseti(L, rb->dict, ++rb->ndict);
+		break;
+	}
+	default: {
+		lua_Integer id;
+		if (cookie == EXTEND_KEYREF) {
+			id = read_size(L, rb);
+		} else {
+			id = cookie - EXTEND_KEYREF;
+		}
+		if (rb->dict == 0 || id <= 0 || id > rb->ndict) {
+			invalid_stream(L,rb);
+		}
+		lua_rawgeti(L, rb->dict, id);
+		break;
+	}
+	}
+}
+
 static void
 push_value(lua_State *L, struct read_block *rb, int type, int cookie) {
 	switch(type) {
@@ -510,9 +730,16 @@ push_value(lua_State *L, struct read_block *rb, int type, int cookie) {
 		break;
 	}
 	case TYPE_TABLE: {
-		unpack_table(L,rb,cookie);
+		int array_size = cookie;
+		if (array_size == MAX_COOKIE-1) {
+			array_size = read_size(L, rb);
+		}
+		unpack_table(L,rb,array_size,0);
 		break;
 	}
+	case TYPE_EXTEND:
+		unpack_extend(L,rb,cookie);
+		break;
 	default: {
 		invalid_stream(L,rb);
 		break;
@@ -532,24 +759,19 @@ unpack_one(lua_State *L, struct read_block *rb) {
 }
 
 static void
-seri(lua_State *L, struct block *b, int len) {
-	uint8_t * buffer = skynet_malloc(len);
-	uint8_t * ptr = buffer;
-	int sz = len;
-	while(len>0) {
-		if (len >= BLOCK_SIZE) {
-			memcpy(ptr, b->buffer, BLOCK_SIZE);
-			ptr += BLOCK_SIZE;
-			len -= BLOCK_SIZE;
-			b = b->next;
-		} else {
-			memcpy(ptr, b->buffer, len);
-			break;
-		}
+seri(lua_State *L, struct write_block *wb) {
+	void * buffer;
+	if (wb->buffer == wb->stack) {
+		// small message, copy it out of the stack
+		buffer = skynet_message_malloc(wb->len);
+		memcpy(buffer, wb->stack, wb->len);
+	} else {
+		// hand off the heap buffer without copy
+		buffer = wb->buffer;
+		wb->buffer = wb->stack;
 	}
-	
 	lua_pushlightuserdata(L, buffer);
-	lua_pushinteger(L, sz);
+	lua_pushinteger(L, wb->len);
 }
 
 int
@@ -575,8 +797,10 @@ luaseri_unpack(lua_State *L) {
 	}
 
 	lua_settop(L,1);
+	// slot 2 for the key dictionary, created on demand
+	lua_pushnil(L);
 	struct read_block rb;
-	rball_init(&rb, buffer, len);
+	rball_init(&rb, buffer, len, 2);
 
 	int i;
 	for (i=0;;i++) {
@@ -588,23 +812,93 @@ luaseri_unpack(lua_State *L) {
 		if (t==NULL)
 			break;
 		type = *t;
+		rb.ndict = 0;
 		push_value(L, &rb, type & 0x7, type>>3);
 	}
 
 	// Need not free buffer
 
+	lua_remove(L, 2);
 	return lua_gettop(L) - 1;
 }
 
+/*
+	lightuserdata msg, integer sz, integer n, boolean tostring
+	 string msg, integer n, boolean tostring
+
+	Unpack the first n values only, return them and the rest of the message (lightuserdata, size)
+	without decoding it. The rest is a new message owned by the caller (send it, or free it by skynet.trash),
+	msg is not changed and should be freed as usual. If tostring is true, the rest is a string instead.
+	The rest is nil, 0 if there are no more values.
+ */
+int
+luaseri_unpackhead(lua_State *L) {
+	char * buffer;
+	int len;
+	int idx;
+	if (lua_type(L,1) == LUA_TSTRING) {
+		size_t sz;
+		buffer = (char *)lua_tolstring(L,1,&sz);
+		len = (int)sz;
+		idx = 2;
+	} else {
+		buffer = lua_touserdata(L,1);
+		len = luaL_checkinteger(L,2);
+		idx = 3;
+	}
+	int n = luaL_checkinteger(L,idx);
+	int tostring = lua_toboolean(L,idx+1);
+	if (buffer == NULL && len > 0) {
+		return luaL_error(L, "deserialize null pointer");
+	}
+	if (n < 0) {
+		return luaL_error(L, "Invalid unpack count %d", n);
+	}
+
+	lua_settop(L,1);
+	// slot 2 for the key dictionary, created on demand
+	lua_pushnil(L);
+	luaL_checkstack(L,n+LUA_MINSTACK,NULL);
+	struct read_block rb;
+	rball_init(&rb, buffer, len, 2);
+
+	int i;
+	for (i=0;i<n;i++) {
+		if (rb.len == 0) {
+			lua_pushnil(L);
+		} else {
+			rb.ndict = 0;
+			unpack_one(L, &rb);
+		}
+	}
+	if (rb.len == 0) {
+		lua_pushnil(L);
+	} else if (tostring) {
+		lua_pushlstring(L, buffer + rb.ptr, rb.len);
+	} else {
+		// never return a pointer into msg, it can't be freed or sent alone
+		void * rest = skynet_message_malloc(rb.len);
+		memcpy(rest, buffer + rb.ptr, rb.len);
+		lua_pushlightuserdata(L, rest);
+	}
+	lua_pushinteger(L, rb.len);
+	lua_remove(L, 2);
+	return n + 2;
+}
+
 LUAMOD_API int
 luaseri_pack(lua_State *L) {
-	struct block temp;
-	temp.next = NULL;
+	char temp[BLOCK_SIZE];
 	struct write_block wb;
-	wb_init(&wb, &temp);
-	pack_from(L,&wb,0);
-	assert(wb.head == &temp);
-	seri(L, &temp, wb.len);
+	int extend = extend_format;
+	if (extend) {
+		// slot 1 for the key dictionary, created on demand
+		lua_pushnil(L);
+		lua_insert(L, 1);
+	}
+	wb_init(&wb, temp, extend);
+	pack_from(L,&wb,extend);
+	seri(L, &wb);
 
 	wb_free(&wb);
 
@@ -5,5 +5,8 @@
 
 int luaseri_pack(lua_State *L);
 int luaseri_unpack(lua_State *L);
+int luaseri_unpackhead(lua_State *L);
+// enable TYPE_EXTEND (table size hints and key dictionary) in luaseri_pack, only when all the nodes can decode it
+void luaseri_extend(int enable);
 
 #endif
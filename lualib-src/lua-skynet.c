@@ -265,6 +265,57 @@ lredirect(lua_State *L) {
 	return send_message(L, source, 3);
 }
 
+/*
+	table addresses (uint32 address or string name)
+	integer type
+	string message
+	 lightuserdata message_ptr
+	 integer len
+
+	return the number of services the message is sent to
+ */
+static int
+lbroadcast(lua_State *L) {
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int type = luaL_checkinteger(L, 2);
+	int n = lua_rawlen(L, 1);
+	uint32_t tmp[64];
+	uint32_t * dest = tmp;
+	if (n > (int)(sizeof(tmp)/sizeof(tmp[0]))) {
+		dest = lua_newuserdata(L, n * sizeof(uint32_t));
+	}
+	int i;
+	for (i=0;i<n;i++) {
+		lua_rawgeti(L, 1, i+1);
+		if (lua_type(L, -1) == LUA_TNUMBER) {
+			dest[i] = (uint32_t)lua_tointeger(L, -1);
+		} else {
+			dest[i] = skynet_queryname(context, get_dest_string(L, -1));
+		}
+		lua_pop(L, 1);
+	}
+	void * msg;
+	size_t len = 0;
+	switch (lua_type(L, 3)) {
+	case LUA_TSTRING:
+		msg = (void *)lua_tolstring(L, 3, &len);
+		if (len == 0) {
+			msg = NULL;
+		}
+		break;
+	case LUA_TLIGHTUSERDATA:
+		msg = lua_touserdata(L, 3);
+		len = luaL_checkinteger(L, 4);
+		type |= PTYPE_TAG_DONTCOPY;
+		break;
+	default:
+		return luaL_error(L, "invalid param %s", lua_typename(L, lua_type(L,3)));
+	}
+	lua_pushinteger(L, skynet_broadcast(context, 0, dest, n, type, msg, len));
+	return 1;
+}
+
 static int
 lerror(lua_State *L) {
 	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
@@ -358,6 +409,7 @@ luaopen_skynet_core(lua_State *L) {
 		{ "send" , lsend },
 		{ "genid", lgenid },
 		{ "redirect", lredirect },
+		{ "broadcast", lbroadcast },
 		{ "command" , lcommand },
 		{ "intcommand", lintcommand },
 		{ "error", lerror },
@@ -365,6 +417,7 @@ luaopen_skynet_core(lua_State *L) {
 		{ "harbor", lharbor },
 		{ "pack", luaseri_pack },
 		{ "unpack", luaseri_unpack },
+		{ "unpackhead", luaseri_unpackhead },
 		{ "packstring", lpackstring },
 		{ "trash" , ltrash },
 		{ "callback", lcallback },
@@ -380,6 +433,9 @@ luaopen_skynet_core(lua_State *L) {
 		return luaL_error(L, "Init skynet context first");
 	}
 
+	const char * extend = skynet_command(ctx, "GETENV", "seri_extend");
+	luaseri_extend(extend && strcmp(extend, "true") == 0);
+
 	luaL_setfuncs(L,l,1);		/* 这个函数里面做了闭包操作，创建的函数可以共享同一个上值skynet_context。其实意思就是将ctx作为上值压入了每个函数里面（闭包） */
 
 	return 1;
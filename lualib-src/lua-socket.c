@@ -12,7 +12,11 @@
 #include <lauxlib.h>
 
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "skynet_socket.h"
 
@@ -20,6 +24,8 @@
 // 2 ** 12 == 4096
 #define LARGE_PAGE_NODE 12
 #define BUFFER_LIMIT (256 * 1024)
+// the size of one sendfile request is an int, a larger file region is split
+#define SENDFILE_CHUNK (1 << 30)
 
 struct buffer_node {
 	char * msg;
@@ -360,6 +366,12 @@ lreadline(lua_State *L) {
 	return 0;
 }
 
+static int
+lbackend(lua_State *L) {
+	lua_pushstring(L, skynet_socket_backend());
+	return 1;
+}
+
 static int
 lstr2p(lua_State *L) {
 	size_t sz = 0;
@@ -479,8 +491,14 @@ llisten(lua_State *L) {
 	const char * host = luaL_checkstring(L,1);
 	int port = luaL_checkinteger(L,2);
 	int backlog = luaL_optinteger(L,3,BACKLOG);
+	int reuseport = lua_toboolean(L,4);
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
-	int id = skynet_socket_listen(ctx, host,port,backlog);
+	int id;
+	if (reuseport) {
+		id = skynet_socket_listen_reuseport(ctx, host,port,backlog);
+	} else {
+		id = skynet_socket_listen(ctx, host,port,backlog);
+	}
 	if (id < 0) {
 		return luaL_error(L, "Listen error");
 	}
@@ -575,6 +593,110 @@ lsendlow(lua_State *L) {
 	return 1;
 }
 
+/*
+	integer id
+	string filename
+	integer offset (optional, default 0)
+	integer size (optional, default to the end of file)
+
+	return true or false, error message
+	The region larger than SENDFILE_CHUNK is sent by several requests, each one owns a dup of the fd.
+ */
+static int
+lsendfile(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	const char * filename = luaL_checkstring(L, 2);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	// the fd is kept by socket server until it's sent, don't leak it to the child process
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	lua_Integer size = st.st_size - offset;
+	if (!lua_isnoneornil(L, 4)) {
+		lua_Integer sz = luaL_checkinteger(L, 4);
+		if (sz < size)
+			size = sz;
+	}
+	if (offset < 0 || size < 0) {
+		close(fd);
+		return luaL_error(L, "Invalid file region %I + %I", offset, size);
+	}
+	if (size == 0) {
+		close(fd);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	while (size > SENDFILE_CHUNK) {
+		int chunk_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if (chunk_fd < 0) {
+			close(fd);
+			lua_pushboolean(L, 0);
+			lua_pushstring(L, strerror(errno));
+			return 2;
+		}
+		if (skynet_socket_sendfile(ctx, id, chunk_fd, offset, SENDFILE_CHUNK)) {
+			close(fd);
+			lua_pushboolean(L, 0);
+			return 1;
+		}
+		offset += SENDFILE_CHUNK;
+		size -= SENDFILE_CHUNK;
+	}
+	int err = skynet_socket_sendfile(ctx, id, fd, offset, (int)size);
+	lua_pushboolean(L, !err);
+	return 1;
+}
+
+static int
+lzerocopy(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int enable = lua_isnone(L, 2) ? 1 : lua_toboolean(L, 2);
+	skynet_socket_zerocopy(ctx, id, enable);
+	return 0;
+}
+
+/*
+	integer id
+	integer high watermark (0 disable pause/resume)
+	integer low watermark
+	integer limit (optional, 0 means unlimited)
+	boolean close when exceed limit (optional, default drop the package)
+ */
+static int
+lwatermark(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	lua_Integer high = luaL_checkinteger(L, 2);
+	lua_Integer low = luaL_checkinteger(L, 3);
+	lua_Integer limit = luaL_optinteger(L, 4, 0);
+	int close = lua_toboolean(L, 5);
+	if (high < 0 || low < 0 || limit < 0) {
+		return luaL_error(L, "Invalid watermark %I %I %I", high, low, limit);
+	}
+	skynet_socket_watermark(ctx, id, high, low, limit, close);
+	return 0;
+}
+
+static int
+lpaused(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	lua_pushboolean(L, skynet_socket_paused(ctx, id));
+	return 1;
+}
+
 static int
 lbind(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -612,7 +734,8 @@ ludp(lua_State *L) {
 		host = address_port(L, tmp, addr, 2, &port);
 	}
 
-	int id = skynet_socket_udp(ctx, host, port);
+	// the 3rd argument enables the batched delivery (SKYNET_SOCKET_TYPE_UDP_BATCH)
+	int id = lua_toboolean(L, 3) ? skynet_socket_udp_batch(ctx, host, port) : skynet_socket_udp(ctx, host, port);
 	if (id < 0) {
 		return luaL_error(L, "udp init failed");
 	}
@@ -680,6 +803,34 @@ ludp_address(lua_State *L) {
 	return 2;
 }
 
+/*
+	lightuserdata data
+	integer size
+
+	return package1, address1, package2, address2, ...
+	see SKYNET_SOCKET_TYPE_UDP_BATCH, the data should be trashed after
+*/
+static int
+ludp_unpack(lua_State *L) {
+	const char * data = lua_touserdata(L, 1);
+	int sz = luaL_checkinteger(L, 2);
+	if (data == NULL) {
+		return luaL_error(L, "Invalid udp batch");
+	}
+	int offset = 0;
+	int n = 0;
+	int size, addrsz;
+	const char * address;
+	const char * package;
+	while ((package = skynet_socket_udp_next(data, sz, &offset, &size, &address, &addrsz))) {
+		luaL_checkstack(L, 2, NULL);
+		lua_pushlstring(L, package, size);
+		lua_pushlstring(L, address, addrsz);
+		n += 2;
+	}
+	return n;
+}
+
 LUAMOD_API int
 luaopen_skynet_socketdriver(lua_State *L) {
 	luaL_checkversion(L);
@@ -693,8 +844,10 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "readline", lreadline },
 		{ "str2p", lstr2p },
 		{ "header", lheader },
+		{ "backend", lbackend },
 
 		{ "unpack", lunpack },
+		{ "udp_unpack", ludp_unpack },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
@@ -705,6 +858,10 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "listen", llisten },
 		{ "send", lsend },
 		{ "lsend", lsendlow },
+		{ "sendfile", lsendfile },
+		{ "zerocopy", lzerocopy },
+		{ "watermark", lwatermark },
+		{ "paused", lpaused },
 		{ "bind", lbind },
 		{ "start", lstart },
 		{ "nodelay", lnodelay },
@@ -373,6 +373,13 @@ function skynet.rawsend(addr, typename, msg, sz)
 	return c.send(addr, p.id, 0 , msg, sz)
 end
 
+-- send the same message to a list of addresses, the receivers share one message buffer.
+-- return the number of services the message is sent to
+function skynet.broadcast(addresses, typename, ...)
+	local p = proto[typename]
+	return c.broadcast(addresses, p.id, p.pack(...))
+end
+
 skynet.genid = assert(c.genid)
 
 skynet.redirect = function(dest,source,typename,...)
@@ -382,6 +389,9 @@ end
 skynet.pack = assert(c.pack)
 skynet.packstring = assert(c.packstring)
 skynet.unpack = assert(c.unpack)
+-- skynet.unpackhead(msg, sz, n [, tostring]) returns the first n values and the rest of message (msg, sz),
+-- the rest is a new message owned by the caller, or a string if tostring is true
+skynet.unpackhead = assert(c.unpackhead)
 skynet.tostring = assert(c.tostring)
 skynet.trash = assert(c.trash)
 
@@ -517,8 +527,43 @@ local function raw_dispatch_message(prototype, msg, sz, session, source)  --具
 	end
 end
 
+local soft_limit	-- see skynet.memsoftlimit
+
+local function check_softlimit(s)
+	local mem
+	if s.active then
+		-- drive the collector even if the service allocates little
+		collectgarbage "step"
+		mem = collectgarbage "count" * 1024
+		if mem < s.limit * s.recover then
+			s.active = false
+			collectgarbage("setpause", s.oldpause)
+			collectgarbage("setstepmul", s.oldstepmul)
+			if s.callback then
+				skynet.fork(s.callback, false, mem)
+			end
+		end
+		return
+	end
+	mem = collectgarbage "count" * 1024
+	if mem > s.limit then
+		-- emergency full gc, and then collect more aggressively until the memory drops
+		collectgarbage "collect"
+		s.active = true
+		s.oldpause = collectgarbage("setpause", s.pause)
+		s.oldstepmul = collectgarbage("setstepmul", s.stepmul)
+		mem = collectgarbage "count" * 1024
+		if s.callback then
+			skynet.fork(s.callback, true, mem)
+		end
+	end
+end
+
 function skynet.dispatch_message(...)
 	local succ, err = pcall(raw_dispatch_message,...)   --所有服务的lua里面回调函数其实都是这个，c里面就是_cb或者forward_cb
+	if soft_limit then
+		check_softlimit(soft_limit)
+	end
 	while true do
 		local key,co = next(fork_queue)
 		if co == nil then
@@ -688,6 +733,30 @@ function skynet.memlimit(bytes)
 	skynet.memlimit = nil	-- set only once
 end
 
+-- Soft memory limit, checked after each message. (skynet.memlimit is the hard limit, the allocation fails beyond it)
+-- When lua heap exceeds bytes, run a full gc, switch the collector to pause/stepmul (default 100/400),
+-- and call callback(true, mem) in a new coroutine.
+-- When the heap drops below bytes * recover (default 0.8), restore the collector and call callback(false, mem).
+-- skynet.memsoftlimit(nil) turns it off.
+function skynet.memsoftlimit(bytes, callback, pause, stepmul, recover)
+	if soft_limit and soft_limit.active then
+		collectgarbage("setpause", soft_limit.oldpause)
+		collectgarbage("setstepmul", soft_limit.oldstepmul)
+	end
+	if bytes == nil then
+		soft_limit = nil
+		return
+	end
+	soft_limit = {
+		limit = bytes,
+		callback = callback,
+		pause = pause or 100,
+		stepmul = stepmul or 400,
+		recover = recover or 0.8,
+		active = false,
+	}
+end
+
 -- Inject internal debug framework
 local debug = require "skynet.debug"
 debug.init(skynet, {
@@ -15,7 +15,8 @@ local function init(skynet, export)
 
 		function dbgcmd.MEM()
 			local kb, bytes = collectgarbage "count"
-			skynet.ret(skynet.pack(kb,bytes))
+			-- reserved, used, request, large bytes of the arena when lua_arena is on
+			skynet.ret(skynet.pack(kb,bytes,require("skynet.arena").stat()))
 		end
 
 		function dbgcmd.GC()
@@ -19,6 +19,11 @@ function harbor.connect(id)
 	skynet.call(".cslave", "lua", "CONNECT", id)
 end
 
+-- the compression stat of the links of this harbor (see harbor_compress in config)
+function harbor.compressstat()
+	return skynet.call(".cslave", "lua", "COMPRESSSTAT")
+end
+
 function harbor.linkmaster()
 	skynet.call(".cslave", "lua", "LINKMASTER")
 end
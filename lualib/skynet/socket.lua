@@ -27,6 +27,16 @@ local function wakeup(s)
 	end
 end
 
+local function wakeup_writer(s)
+	local writer = s.writer
+	if writer then
+		s.writer = nil
+		for _, co in ipairs(writer) do
+			skynet.wakeup(co)
+		end
+	end
+end
+
 local function suspend(s)
 	assert(not s.co)
 	s.co = coroutine.running()
@@ -93,6 +103,7 @@ socket_message[3] = function(id)
 	end
 	s.connected = false
 	wakeup(s)
+	wakeup_writer(s)
 end
 
 -- SKYNET_SOCKET_TYPE_ACCEPT = 4
@@ -121,6 +132,7 @@ socket_message[5] = function(id, _, err)
 	driver.shutdown(id)
 
 	wakeup(s)
+	wakeup_writer(s)
 end
 
 -- SKYNET_SOCKET_TYPE_UDP = 6
@@ -136,6 +148,30 @@ socket_message[6] = function(id, size, data, address)
 	s.callback(str, address)
 end
 
+local function dispatch_udp(callback, str, address, ...)
+	if str then
+		callback(str, address)
+		return dispatch_udp(callback, ...)
+	end
+end
+
+-- the packages are copied out by udp_unpack, so trash the data before dispatch
+local function trash_udp(data, size, ...)
+	skynet_core.trash(data, size)
+	return ...
+end
+
+-- SKYNET_SOCKET_TYPE_UDP_BATCH = 10, only for the socket created by socket.udp(callback, host, port, true)
+socket_message[10] = function(id, size, data)
+	local s = socket_pool[id]
+	if s == nil or s.callback == nil then
+		skynet.error("socket: drop udp packages from " .. id)
+		driver.drop(data, size)
+		return
+	end
+	dispatch_udp(s.callback, trash_udp(data, size, driver.udp_unpack(data, size)))
+end
+
 local function default_warning(id, size)
 	local s = socket_pool[id]
 	if not s then
@@ -153,6 +189,29 @@ socket_message[7] = function(id, size)
 	end
 end
 
+-- SKYNET_SOCKET_TYPE_PAUSE = 8
+socket_message[8] = function(id, size)
+	local s = socket_pool[id]
+	if s then
+		s.paused = true
+		if s.on_pause then
+			s.on_pause(id, true, size)
+		end
+	end
+end
+
+-- SKYNET_SOCKET_TYPE_RESUME = 9
+socket_message[9] = function(id, size)
+	local s = socket_pool[id]
+	if s then
+		s.paused = nil
+		wakeup_writer(s)
+		if s.on_pause then
+			s.on_pause(id, false, size)
+		end
+	end
+end
+
 skynet.register_protocol {
 	name = "socket",
 	id = skynet.PTYPE_SOCKET,	-- PTYPE_SOCKET = 6
@@ -272,7 +331,7 @@ function socket.read(id, sz)        --该函数是阻塞函数，一定会等到
 		end
 	end
 
-	local ret = driver.pop(s.buffer, buffer_pool, sz)   /* 从s.buffer里面获取数据,如果数据不够就直接返回nil */
+	local ret = driver.pop(s.buffer, buffer_pool, sz)   -- 从s.buffer里面获取数据,如果数据不够就直接返回nil
 	if ret then
 		return ret
 	end
@@ -340,6 +399,10 @@ end
 socket.write = assert(driver.send)
 socket.lwrite = assert(driver.lsend)
 socket.header = assert(driver.header)
+-- socket.sendfile(id, filename [, offset, size]) : send a file region by sendfile(2), without copying it into lua
+socket.sendfile = assert(driver.sendfile)
+-- socket.zerocopy(id [, enable]) : packages larger than 16K will be sent with MSG_ZEROCOPY (linux only)
+socket.zerocopy = assert(driver.zerocopy)
 
 function socket.invalid(id)
 	return socket_pool[id] == nil
@@ -352,12 +415,13 @@ function socket.disconnected(id)
 	end
 end
 
-function socket.listen(host, port, backlog)
+-- set reuseport to listen with SO_REUSEPORT, so that more than one service can listen the same address
+function socket.listen(host, port, backlog, reuseport)
 	if port == nil then
 		host, port = string.match(host, "([^:]+):(.+)$")
 		port = tonumber(port)
 	end
-	return driver.listen(host, port, backlog)
+	return driver.listen(host, port, backlog, reuseport)
 end
 
 function socket.lock(id)
@@ -417,8 +481,9 @@ local function create_udp_object(id, cb)
 	}
 end
 
-function socket.udp(callback, host, port)
-	local id = driver.udp(host, port)
+-- batch : the datagrams read together are delivered in one message, the callback is still called for each of them
+function socket.udp(callback, host, port, batch)
+	local id = driver.udp(host, port, batch)
 	create_udp_object(id, callback)
 	return id
 end
@@ -445,4 +510,39 @@ function socket.warning(id, callback)
 	obj.on_warning = callback
 end
 
+-- The socket is paused when the send buffer reaches high (bytes), and resumed when it drains to low.
+-- If limit is given, the package which makes the send buffer exceed limit is dropped,
+-- or the socket is closed when policy is "close".
+function socket.watermark(id, high, low, limit, policy)
+	assert(socket_pool[id])
+	driver.watermark(id, high or 0, low or 0, limit or 0, policy == "close")
+end
+
+-- callback(id, paused, size) : size is the K bytes in send buffer
+function socket.onpause(id, callback)
+	local obj = socket_pool[id]
+	assert(obj)
+	obj.on_pause = callback
+end
+
+-- block the current coroutine while the socket is paused, return false if the socket is closed
+function socket.writable(id)
+	local s = socket_pool[id]
+	if not s or not s.connected then
+		return false
+	end
+	-- SKYNET_SOCKET_TYPE_PAUSE may be still in message queue, so check the socket server
+	if s.paused or driver.paused(id) then
+		local co = coroutine.running()
+		local writer = s.writer
+		if writer then
+			table.insert(writer, co)
+		else
+			s.writer = { co }
+		end
+		skynet.wait(co)
+	end
+	return s.connected
+end
+
 return socket
@@ -388,22 +388,44 @@ local function sock_err(self)
 	error(socket_error)
 end
 
+-- padding is a table of strings, or C buffers (lightuserdata part1, size1, part2, size2, ...)
+local function is_cbuffer(padding)
+	return padding and type(padding[1]) == "userdata"
+end
+
 function channel:request(request, response, padding)
-	assert(block_connect(self, true))	-- connect once
+	if is_cbuffer(padding) then
+		-- the C buffers would be freed by socket, free them if connect failed
+		local ok, err = pcall(block_connect, self, true)
+		if not ok then
+			for i = 1, #padding, 2 do
+				skynet.trash(padding[i], padding[i+1])
+			end
+			error(err)
+		end
+	else
+		assert(block_connect(self, true))	-- connect once
+	end
 	local fd = self.__sock[1]
 
 	if padding then
 		-- padding may be a table, to support multi part request
 		-- multi part request use low priority socket write
 		-- now socket_lwrite returns as socket_write
-		if not socket_lwrite(fd , request) then
-			sock_err(self)
-		end
-		for _,v in ipairs(padding) do
-			if not socket_lwrite(fd, v) then
-				sock_err(self)
+		local ok = socket_lwrite(fd , request)
+		if is_cbuffer(padding) then
+			-- each part is a write, and socket frees the buffer even if the write fails
+			for i = 1, #padding, 2 do
+				ok = socket_lwrite(fd, padding[i], padding[i+1]) and ok
+			end
+		else
+			for _,v in ipairs(padding) do
+				ok = ok and socket_lwrite(fd, v)
 			end
 		end
+		if not ok then
+			sock_err(self)
+		end
 	else
 		if not socket_write(fd , request) then
 			sock_err(self)
@@ -28,7 +28,7 @@ function gateserver.closeclient(fd)
 end
 
 function gateserver.start(handler)
-	assert(handler.message)
+	assert(handler.message or handler.batch)
 	assert(handler.connect)
 
 	function CMD.open( source, conf )
@@ -37,8 +37,14 @@ function gateserver.start(handler)
 		local port = assert(conf.port)
 		maxclient = conf.maxclient or 1024
 		nodelay = conf.nodelay
-		skynet.error(string.format("Listen on %s:%d", address, port))
-		socket = socketdriver.listen(address, port)
+		-- conf.header : the format of package header, "S" (default) "L" "s" "l" "V" with optional ":maxsize" (see frame_header.h)
+		if conf.header then
+			netpack.clear(queue)
+			queue = netpack.queue(conf.header)
+		end
+		-- conf.reuseport : launch more than one gate with the same address, the kernel balances the connections
+		skynet.error(string.format("Listen on %s:%d%s", address, port, conf.reuseport and " (reuseport)" or ""))
+		socket = socketdriver.listen(address, port, conf.backlog, conf.reuseport)
 		socketdriver.start(socket)
 		if handler.open then
 			return handler.open(source, conf)
@@ -78,6 +84,17 @@ function gateserver.start(handler)
 
 	MSG.more = dispatch_queue
 
+	-- handler.batch(fd, batch) : iterate the packages by netpack.frames(batch) ,
+	-- the msg is only valid in handler.batch (copy it if you need it later), don't free it.
+	function MSG.batch(fd, batch)
+		if connection[fd] then
+			handler.batch(fd, batch)
+		else
+			skynet.error(string.format("Drop batch message from fd (%d)", fd))
+		end
+		netpack.release(batch)
+	end
+
 	function MSG.open(fd, msg)
 		if client_number >= maxclient then
 			socketdriver.close(fd)
@@ -122,17 +139,26 @@ function gateserver.start(handler)
 		end
 	end
 
+	-- the package header is invalid (or too large), the rest of the stream can't be split
+	function MSG.invalid(fd, msg)
+		skynet.error(string.format("gateserver close fd (%d) : %s", fd, msg))
+		gateserver.closeclient(fd)
+	end
+
 	function MSG.warning(fd, size)
 		if handler.warning then
 			handler.warning(fd, size)
 		end
 	end
 
+	-- filter all the packages of a socket message into one batch, if the handler supports it
+	local filter = handler.batch and netpack.filterbatch or netpack.filter
+
 	skynet.register_protocol {
 		name = "socket",
 		id = skynet.PTYPE_SOCKET,	-- PTYPE_SOCKET = 6
 		unpack = function ( msg, sz )
-			return netpack.filter( queue, msg, sz)
+			return filter( queue, msg, sz)
 		end,
 		dispatch = function (_, _, q, type, ...)
 			queue = q
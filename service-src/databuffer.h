@@ -5,6 +5,8 @@
 #include <string.h>
 #include <assert.h>
 
+#include "frame_header.h"
+
 #define MESSAGEPOOL 1023
 
 struct message {
@@ -14,7 +16,7 @@ struct message {
 };
 
 struct databuffer {
-	int header;		/* 当前协议的头部数据, 2 or 4 bytes */
+	int header;		/* 当前报文的长度（已解析的报文头），0 表示还没有解析 */
 	int offset;		/* 读取的head这个节点的当前偏移量 */
 	int size;		/* 当前读取到了但还没有解析的数据长度 */
 	struct message * head;
@@ -88,6 +90,35 @@ databuffer_read(struct databuffer *db, struct messagepool *mp, void * buffer, in
 	}
 }
 
+/*
+	取出 sz 字节的报文，返回的 buffer 由调用者释放。
+	skynet 消息必须是分配出来的起始地址，所以只有报文从头结点的起始处开始（offset 为 0），
+	并且头结点不超过 2*sz 字节时，才直接把这个节点的 buffer 交出去（不拷贝报文，交出的内存最多浪费一倍），
+	节点里剩下的数据（不超过 sz）拷贝到新 buffer 里。其它情况分配新 buffer 拷贝报文。
+ */
+static void *
+databuffer_pop(struct databuffer *db, struct messagepool *mp, int sz) {
+	assert(db->size >= sz);
+	struct message *current = db->head;
+	if (db->offset == 0 && current->size >= sz && current->size <= 2 * sz) {
+		char * buffer = current->buffer;
+		int rest = current->size - sz;
+		db->size -= sz;
+		if (rest > 0) {
+			current->buffer = skynet_malloc(rest);
+			current->size = rest;
+			memcpy(current->buffer, buffer + sz, rest);
+		} else {
+			current->buffer = NULL;
+			_return_message(db, mp);
+		}
+		return buffer;
+	}
+	void * buffer = skynet_malloc(sz);
+	databuffer_read(db, mp, buffer, sz);
+	return buffer;
+}
+
 /* 将消息挂在到对应的connection的消息队列里面 */
 static void
 databuffer_push(struct databuffer *db, struct messagepool *mp, void *data, int sz) {
@@ -123,21 +154,43 @@ databuffer_push(struct databuffer *db, struct messagepool *mp, void *data, int s
 	}
 }
 
+/* 复制开头的 sz 字节，不移动读取位置，返回复制的字节数 */
+static int
+databuffer_peek(struct databuffer *db, void * buffer, int sz) {
+	if (sz > db->size)
+		sz = db->size;
+	struct message *current = db->head;
+	int offset = db->offset;
+	int n = 0;
+	while (n < sz) {
+		int bsz = current->size - offset;
+		if (bsz > sz - n)
+			bsz = sz - n;
+		memcpy((char *)buffer + n, current->buffer + offset, bsz);
+		n += bsz;
+		current = current->next;
+		offset = 0;
+	}
+	return n;
+}
+
+/* 返回报文长度，-1 表示数据还不完整，-2 表示报文头非法 (见 frame_header.h) */
 static int
-databuffer_readheader(struct databuffer *db, struct messagepool *mp, int header_size) {
+databuffer_readheader(struct databuffer *db, struct messagepool *mp, const struct frame_format *format) {
 	if (db->header == 0) {
-		// parser header (2 or 4)
-		if (db->size < header_size) {	/* 判断是否收到一个完整的报文头部，实际上协议前面几个字节就是报文长度 */
+		// the length of header is unknown before parsing (varint), peek the bytes first
+		uint8_t plen[FRAME_HEADER_MAX];
+		int n = databuffer_peek(db, plen, FRAME_HEADER_MAX);
+		int size;
+		int len = frame_read_header(format, plen, n, &size);	/* 判断是否收到一个完整的报文头部，实际上协议前面几个字节就是报文长度 */
+		if (len == 0) {
 			return -1;
 		}
-		uint8_t plen[4];
-		databuffer_read(db,mp,(char *)plen,header_size);
-		// big-endian
-		if (header_size == 2) {
-			db->header = plen[0] << 8 | plen[1];
-		} else {
-			db->header = plen[0] << 24 | plen[1] << 16 | plen[2] << 8 | plen[3];
+		if (len < 0) {
+			return -2;
 		}
+		databuffer_read(db,mp,(char *)plen,len);
+		db->header = size;
 	}
 	if (db->size < db->header)
 		return -1;
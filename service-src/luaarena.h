@@ -0,0 +1,178 @@
+#ifndef skynet_luaarena_h
+#define skynet_luaarena_h
+
+#include "skynet_malloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+	A size-class slab owned by one lua service (enable it by lua_arena = true in config).
+	A lua vm is only touched by one worker thread at a time, so the arena needs no lock.
+	Small objects (<= ARENA_SMALL) are packed into ARENA_CHUNK chunks, and all the chunks
+	are released at once when the service exit. Larger objects go to skynet_lalloc.
+ */
+
+#define ARENA_ALIGN 8
+#define ARENA_SMALL 256
+#define ARENA_CLASS (ARENA_SMALL / ARENA_ALIGN)
+#define ARENA_CHUNK (64 * 1024)
+
+#define ARENA_CLASSID(sz) (((sz) - 1) / ARENA_ALIGN)
+#define ARENA_CLASSSIZE(id) (((id) + 1) * ARENA_ALIGN)
+
+struct arena_node {
+	struct arena_node * next;
+};
+
+struct arena_chunk {
+	struct arena_chunk * next;
+	uint64_t padding;	// keep the objects ARENA_ALIGN aligned
+};
+
+struct arena {
+	struct arena_node * freelist[ARENA_CLASS];
+	struct arena_chunk * chunk;
+	char * ptr;
+	char * end;
+	size_t reserved;	// bytes of chunks
+	size_t used;		// bytes of the slots in use
+	size_t request;		// bytes requested by lua (in the slots)
+	size_t large;		// bytes allocated out of arena
+};
+
+static struct arena *
+arena_new(void) {
+	struct arena * a = skynet_malloc(sizeof(*a));
+	memset(a, 0, sizeof(*a));
+	return a;
+}
+
+static void
+arena_delete(struct arena *a) {
+	struct arena_chunk * c = a->chunk;
+	while (c) {
+		struct arena_chunk * next = c->next;
+		skynet_lalloc(c, ARENA_CHUNK, 0);
+		c = next;
+	}
+	skynet_free(a);
+}
+
+static inline void
+arena_push(struct arena *a, void *ptr, int id) {
+	struct arena_node * node = (struct arena_node *)ptr;
+	node->next = a->freelist[id];
+	a->freelist[id] = node;
+}
+
+static int
+arena_newchunk(struct arena *a) {
+	struct arena_chunk * c = skynet_lalloc(NULL, 0, ARENA_CHUNK);
+	if (c == NULL)
+		return 1;
+	// put the rest of current chunk into freelist
+	size_t rest = a->end - a->ptr;
+	if (rest >= ARENA_ALIGN) {
+		int id = rest / ARENA_ALIGN - 1;
+		arena_push(a, a->ptr, id);
+	}
+	c->next = a->chunk;
+	a->chunk = c;
+	a->ptr = (char *)(c+1);
+	a->end = (char *)c + ARENA_CHUNK;
+	a->reserved += ARENA_CHUNK;
+	return 0;
+}
+
+static void *
+arena_malloc(struct arena *a, size_t sz) {
+	if (sz > ARENA_SMALL) {
+		void * ptr = skynet_lalloc(NULL, 0, sz);
+		if (ptr) {
+			a->large += sz;
+		}
+		return ptr;
+	}
+	int id = ARENA_CLASSID(sz);
+	size_t csz = ARENA_CLASSSIZE(id);
+	void * ptr = a->freelist[id];
+	if (ptr) {
+		a->freelist[id] = a->freelist[id]->next;
+	} else {
+		if (a->ptr + csz > a->end && arena_newchunk(a)) {
+			return NULL;
+		}
+		ptr = a->ptr;
+		a->ptr += csz;
+	}
+	a->used += csz;
+	a->request += sz;
+	return ptr;
+}
+
+static void
+arena_free(struct arena *a, void *ptr, size_t sz) {
+	if (ptr == NULL)
+		return;
+	if (sz > ARENA_SMALL) {
+		a->large -= sz;
+		skynet_lalloc(ptr, sz, 0);
+		return;
+	}
+	int id = ARENA_CLASSID(sz);
+	a->used -= ARENA_CLASSSIZE(id);
+	a->request -= sz;
+	arena_push(a, ptr, id);
+}
+
+// the same as lua_Alloc, osize is the type of object when ptr is NULL
+static void *
+arena_lalloc(struct arena *a, void *ptr, size_t osize, size_t nsize) {
+	if (ptr == NULL) {
+		osize = 0;
+	}
+	if (nsize == 0) {
+		arena_free(a, ptr, osize);
+		return NULL;
+	}
+	if (osize > ARENA_SMALL && nsize > ARENA_SMALL) {
+		void * newptr = skynet_lalloc(ptr, osize, nsize);
+		if (newptr) {
+			a->large = a->large - osize + nsize;
+		}
+		return newptr;
+	}
+	if (osize > 0 && osize <= ARENA_SMALL && nsize <= ARENA_SMALL
+		&& ARENA_CLASSID(osize) == ARENA_CLASSID(nsize)) {
+		a->request = a->request - osize + nsize;
+		return ptr;
+	}
+	void * newptr = arena_malloc(a, nsize);
+	if (newptr == NULL) {
+		if (ptr && osize >= nsize) {
+			// shrinking never fails : keep the block as a slot of the class of nsize.
+			// A large block joins the arena (reserved) then, and it's never released (only when out of memory).
+			size_t csz = ARENA_CLASSSIZE(ARENA_CLASSID(nsize));
+			if (osize > ARENA_SMALL) {
+				a->large -= osize;
+				a->reserved += osize;
+			} else {
+				a->used -= ARENA_CLASSSIZE(ARENA_CLASSID(osize));
+				a->request -= osize;
+			}
+			a->used += csz;
+			a->request += nsize;
+			return ptr;
+		}
+		return NULL;
+	}
+	if (ptr) {
+		memcpy(newptr, ptr, osize < nsize ? osize : nsize);
+		arena_free(a, ptr, osize);
+	}
+	return newptr;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef skynet_lzblock_h
+#define skynet_lzblock_h
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+	A small and fast LZ77 compressor, the output is the same as the block format of LZ4 :
+	each sequence is a token (4 bits literal length, 4 bits match length - 4), the extra bytes of
+	literal length, the literals, a 2 bytes little-endian offset and the extra bytes of match length.
+	The last sequence has only literals.
+ */
+
+#define LZB_HASHLOG 12
+#define LZB_MINMATCH 4
+#define LZB_MAXOFFSET 65535
+#define LZB_LASTLITERALS 5
+#define LZB_MFLIMIT 12
+
+#define lzb_bound(n) ((n) + (n) / 255 + 16)
+
+static inline uint32_t
+lzb_read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t
+lzb_hash(uint32_t v) {
+	return (v * 2654435761u) >> (32 - LZB_HASHLOG);
+}
+
+static inline uint8_t *
+lzb_write_length(uint8_t *op, int len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+// return the size of compressed data, 0 if the dst (cap bytes) is not enough
+static int
+lzb_compress(const uint8_t *src, int n, uint8_t *dst, int cap) {
+	uint32_t table[1 << LZB_HASHLOG];
+	memset(table, 0, sizeof(table));
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *end = src + n;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + cap;
+	if (n > LZB_MFLIMIT) {
+		const uint8_t *mflimit = end - LZB_MFLIMIT;
+		const uint8_t *matchlimit = end - LZB_LASTLITERALS;
+		int miss = 0;
+		while (ip < mflimit) {
+			uint32_t seq = lzb_read32(ip);
+			uint32_t h = lzb_hash(seq);
+			const uint8_t *ref = src + table[h];
+			table[h] = (uint32_t)(ip - src);
+			if (ref >= ip || ip - ref > LZB_MAXOFFSET || lzb_read32(ref) != seq) {
+				// skip faster in the incompressible data
+				ip += 1 + (miss++ >> 6);
+				continue;
+			}
+			miss = 0;
+			const uint8_t *mp = ip + LZB_MINMATCH;
+			const uint8_t *rp = ref + LZB_MINMATCH;
+			while (mp < matchlimit && *mp == *rp) {
+				++mp;
+				++rp;
+			}
+			int lit = (int)(ip - anchor);
+			int mlen = (int)(mp - ip) - LZB_MINMATCH;
+			if (op + 1 + lit + lit / 255 + 1 + 2 + mlen / 255 + 1 > oend)
+				return 0;
+			uint8_t *token = op++;
+			if (lit >= 15) {
+				*token = 15 << 4;
+				op = lzb_write_length(op, lit - 15);
+			} else {
+				*token = (uint8_t)(lit << 4);
+			}
+			memcpy(op, anchor, lit);
+			op += lit;
+			int offset = (int)(ip - ref);
+			*op++ = offset & 0xff;
+			*op++ = (offset >> 8) & 0xff;
+			if (mlen >= 15) {
+				*token |= 15;
+				op = lzb_write_length(op, mlen - 15);
+			} else {
+				*token |= (uint8_t)mlen;
+			}
+			ip = mp;
+			anchor = ip;
+		}
+	}
+	int lit = (int)(end - anchor);
+	if (op + 1 + lit + lit / 255 + 1 > oend)
+		return 0;
+	if (lit >= 15) {
+		*op++ = 15 << 4;
+		op = lzb_write_length(op, lit - 15);
+	} else {
+		*op++ = (uint8_t)(lit << 4);
+	}
+	memcpy(op, anchor, lit);
+	op += lit;
+	return (int)(op - dst);
+}
+
+static inline int
+lzb_read_length(const uint8_t **ip, const uint8_t *iend, int len, int limit) {
+	int b;
+	do {
+		if (*ip >= iend)
+			return -1;
+		b = *(*ip)++;
+		len += b;
+		if (len > limit)
+			return -1;
+	} while (b == 255);
+	return len;
+}
+
+// return size (the size of original data) , -1 if the data is corrupted
+static int
+lzb_decompress(const uint8_t *src, int n, uint8_t *dst, int size) {
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + n;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + size;
+	while (ip < iend) {
+		int token = *ip++;
+		int lit = token >> 4;
+		if (lit == 15) {
+			lit = lzb_read_length(&ip, iend, lit, size);
+			if (lit < 0)
+				return -1;
+		}
+		if (lit > iend - ip || lit > oend - op)
+			return -1;
+		memcpy(op, ip, lit);
+		op += lit;
+		ip += lit;
+		if (ip == iend)
+			break;
+		if (iend - ip < 2)
+			return -1;
+		int offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > op - dst)
+			return -1;
+		int mlen = token & 15;
+		if (mlen == 15) {
+			mlen = lzb_read_length(&ip, iend, mlen, size);
+			if (mlen < 0)
+				return -1;
+		}
+		mlen += LZB_MINMATCH;
+		if (mlen > oend - op)
+			return -1;
+		const uint8_t *ref = op - offset;
+		if (offset >= mlen) {
+			memcpy(op, ref, mlen);
+		} else {
+			// overlapped
+			int i;
+			for (i=0;i<mlen;i++) {
+				op[i] = ref[i];
+			}
+		}
+		op += mlen;
+	}
+	if (op != oend)
+		return -1;
+	return size;
+}
+
+#endif
@@ -16,6 +16,7 @@ struct connection {
 	int id;	// skynet_socket id
 	uint32_t agent;
 	uint32_t client;
+	int framed;	// the packages are split in socket thread and sent to agent directly
 	char remote_name[32];
 	struct databuffer buffer;
 };
@@ -26,8 +27,13 @@ struct gate {
 	uint32_t watchdog;
 	uint32_t broker;		/* 代理服务的handle */
 	int client_tag;
-	int header_size;		/* 2 or 4, S or L */
+	struct frame_format format;	/* 报文头格式, 见 frame_header.h */
 	int max_connection;
+	int frame;		/* 在 socket 线程分包，直接发给 agent */
+	int shard;		/* 前端 gate 把连接按 socket id 分给 shard 个 gate worker */
+	uint32_t *shards;
+	int count;		/* 前端 gate: 所有 worker 的连接数, 超过 max_connection 的新连接直接关闭 */
+	uint32_t front;	/* gate worker: 连接关闭时通知前端 gate */
 	struct hashid hash;
 	struct connection *conn;
 	// todo: save message pool ptr for release
@@ -55,6 +61,12 @@ gate_release(struct gate *g) {
 	if (g->listen_id >= 0) {
 		skynet_socket_close(ctx, g->listen_id);
 	}
+	for (i=0;i<g->shard;i++) {
+		char addr[16];
+		snprintf(addr, sizeof(addr), ":%x", g->shards[i]);
+		skynet_command(ctx, "KILL", addr);
+	}
+	skynet_free(g->shards);
 	messagepool_free(&g->mp);
 	hashid_clear(&g->hash);
 	skynet_free(g->conn);
@@ -75,6 +87,23 @@ _parm(char *msg, int sz, int command_sz) {
 	msg[i-command_sz] = '\0';
 }
 
+static inline int
+_frame_mode(struct gate *g, struct connection *c) {
+	// the broker and the watchdog need the packages go through gate
+	return g->frame && c->agent && g->broker == 0 && g->client_tag == PTYPE_CLIENT;
+}
+
+static void
+_start(struct gate *g, struct connection *c) {
+	if (_frame_mode(g, c)) {
+		c->framed = 1;
+		skynet_socket_start_frame(g->ctx, c->id, &g->format, c->agent, c->client);
+	} else {
+		c->framed = 0;
+		skynet_socket_start(g->ctx, c->id);
+	}
+}
+
 static void
 _forward_agent(struct gate * g, int fd, uint32_t agentaddr, uint32_t clientaddr) {
 	int id = hashid_lookup(&g->hash, fd);
@@ -82,7 +111,66 @@ _forward_agent(struct gate * g, int fd, uint32_t agentaddr, uint32_t clientaddr)
 		struct connection * agent = &g->conn[id];
 		agent->agent = agentaddr;
 		agent->client = clientaddr;
+		if (agent->framed) {
+			// change the target in socket thread
+			_start(g, agent);
+		}
+	}
+}
+
+static inline uint32_t
+_owner(struct gate *g, int id) {
+	// mix the bits of id, the ids of accepted connections are often interleaved with others
+	uint32_t h = (uint32_t)id * 2654435761u;
+	return g->shards[((uint64_t)h * g->shard) >> 32];
+}
+
+// the front gate routes the command to the worker which owns the connection, return 0 if it isn't routed
+static int
+_route_ctrl(struct gate * g, const char * command, int i, const void * msg, int sz) {
+	struct skynet_context * ctx = g->ctx;
+	if (memcmp(command,"kick",i)==0 || memcmp(command,"forward",i)==0 || memcmp(command,"start",i)==0) {
+		int id = strtol(command + i, NULL, 10);
+		skynet_send(ctx, 0, _owner(g, id), PTYPE_TEXT, 0, (void *)msg, sz);
+		return 1;
+	}
+	if (memcmp(command,"broker",i)==0) {
+		int j;
+		for (j=0;j<g->shard;j++) {
+			skynet_send(ctx, 0, g->shards[j], PTYPE_TEXT, 0, (void *)msg, sz);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static void _report(struct gate * g, const char * data, ...);
+
+// the worker tells the front gate that a connection is released
+static void
+_disconnect(struct gate *g) {
+	if (g->front) {
+		skynet_send(g->ctx, 0, g->front, PTYPE_TEXT, 0, "disconnect", 10);
+	}
+}
+
+// a connection accepted by the front gate, "accept id remote_name"
+static void
+_accept(struct gate *g, char * parm) {
+	struct skynet_context * ctx = g->ctx;
+	char * name = parm;
+	char * idstr = strsep(&name, " ");
+	int uid = strtol(idstr, NULL, 10);
+	if (hashid_full(&g->hash)) {
+		skynet_socket_close(ctx, uid);
+		_disconnect(g);
+		return;
 	}
+	struct connection *c = &g->conn[hashid_insert(&g->hash, uid)];
+	c->id = uid;
+	snprintf(c->remote_name, sizeof(c->remote_name), "%s", name ? name : "");
+	_report(g, "%d open %d %s:0",c->id, c->id, c->remote_name);
+	skynet_error(ctx, "socket open: %x", c->id);
 }
 
 static void
@@ -100,6 +188,19 @@ _ctrl(struct gate * g, const void * msg, int sz) {
 			break;
 		}
 	}
+	if (g->shard > 0 && _route_ctrl(g, command, i, msg, sz)) {
+		return;
+	}
+	if (memcmp(command,"accept",i)==0) {
+		_parm(tmp, sz, i);
+		_accept(g, tmp);
+		return;
+	}
+	if (memcmp(command,"disconnect",i)==0) {
+		// a connection of the workers is closed
+		--g->count;
+		return;
+	}
 	if (memcmp(command,"kick",i)==0) {	/* 关闭指定的socket */
 		_parm(tmp, sz, i);		/* 得到kick 后面的param，指定的socket的id */
 		int uid = strtol(command , NULL, 10);
@@ -129,6 +230,16 @@ _ctrl(struct gate * g, const void * msg, int sz) {
 	if (memcmp(command,"broker",i)==0) {
 		_parm(tmp, sz, i);
 		g->broker = skynet_queryname(ctx, command);
+		if (g->broker) {
+			// the packages go to broker through gate
+			int j;
+			for (j=0;j<g->max_connection;j++) {
+				struct connection *c = &g->conn[j];
+				if (c->id >= 0 && c->framed) {
+					_start(g, c);
+				}
+			}
+		}
 		return;
 	}
 	if (memcmp(command,"start",i) == 0) {
@@ -136,7 +247,7 @@ _ctrl(struct gate * g, const void * msg, int sz) {
 		int uid = strtol(command , NULL, 10);
 		int id = hashid_lookup(&g->hash, uid);
 		if (id>=0) {
-			skynet_socket_start(ctx, uid);
+			_start(g, &g->conn[id]);
 		}
 		return;
 	}
@@ -169,14 +280,12 @@ static void
 _forward(struct gate *g, struct connection * c, int size) {
 	struct skynet_context * ctx = g->ctx;
 	if (g->broker) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,temp, size);
+		void * temp = databuffer_pop(&c->buffer,&g->mp, size);
 		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, 1, temp, size);
 		return;
 	}
 	if (c->agent) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,temp, size);
+		void * temp = databuffer_pop(&c->buffer,&g->mp, size);
 		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, 1 , temp, size);
 	} else if (g->watchdog) {
 		char * tmp = skynet_malloc(size + 32);
@@ -190,20 +299,18 @@ static void
 dispatch_message(struct gate *g, struct connection *c, int id, void * data, int sz) {
 	databuffer_push(&c->buffer,&g->mp, data, sz);
 	for (;;) {
-		int size = databuffer_readheader(&c->buffer, &g->mp, g->header_size);	/* 这个函数保证了头部和数据都读取完成了 */
-		if (size < 0) {
+		int size = databuffer_readheader(&c->buffer, &g->mp, &g->format);	/* 这个函数保证了头部和数据都读取完成了 */
+		if (size == -1) {
+			return;
+		} else if (size < 0) {
+			struct skynet_context * ctx = g->ctx;
+			databuffer_clear(&c->buffer,&g->mp);
+			skynet_socket_close(ctx, id);
+			skynet_error(ctx, "Recv invalid socket message header (max size %d)", g->format.max);
 			return;
 		} else if (size > 0) {
-			if (size >= 0x1000000) {
-				struct skynet_context * ctx = g->ctx;
-				databuffer_clear(&c->buffer,&g->mp);
-				skynet_socket_close(ctx, id);
-				skynet_error(ctx, "Recv socket message > 16M");
-				return;
-			} else {
-				_forward(g, c, size);	/* 将本次数据转发到指定的handle去 */
-				databuffer_reset(&c->buffer);
-			}
+			_forward(g, c, size);	/* 将本次数据转发到指定的handle去 */
+			databuffer_reset(&c->buffer);
 		}
 	}
 }
@@ -211,6 +318,11 @@ dispatch_message(struct gate *g, struct connection *c, int id, void * data, int
 static void
 dispatch_socket_message(struct gate *g, const struct skynet_socket_message * message, int sz) {
 	struct skynet_context * ctx = g->ctx;
+	if (g->shard > 0 && message->id != g->listen_id) {
+		// front gate : the worker owns the connection
+		skynet_send(ctx, 0, _owner(g, message->id), PTYPE_SOCKET, 0, (void *)message, sz + sizeof(*message));
+		return;
+	}
 	switch(message->type) {
 	case SKYNET_SOCKET_TYPE_DATA: {
 		int id = hashid_lookup(&g->hash, message->id);
@@ -245,13 +357,23 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 			memset(c, 0, sizeof(*c));
 			c->id = -1;
 			_report(g, "%d close", message->id);
+			_disconnect(g);
 		}
 		break;
 	}
 	case SKYNET_SOCKET_TYPE_ACCEPT:
 		// report accept, then it will be get a SKYNET_SOCKET_TYPE_CONNECT message
 		assert(g->listen_id == message->id);
-		if (hashid_full(&g->hash)) {
+		if (g->shard > 0) {
+			if (g->count >= g->max_connection) {
+				skynet_socket_close(ctx, message->ud);
+				break;
+			}
+			++g->count;
+			char tmp[64];
+			int n = snprintf(tmp, sizeof(tmp), "accept %d %.*s", message->ud, sz < 32 ? sz : 31, (const char *)(message+1));
+			skynet_send(ctx, 0, _owner(g, message->ud), PTYPE_TEXT, 0, tmp, n);
+		} else if (hashid_full(&g->hash)) {
 			skynet_socket_close(ctx, message->ud);
 		} else {
 			struct connection *c = &g->conn[hashid_insert(&g->hash, message->ud)];	/* 分配了一个conn用于新的fd */
@@ -286,6 +408,10 @@ _cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t sour
 		// The last 4 bytes in msg are the id of socket, write following bytes to it
 		const uint8_t * idbuf = msg + sz - 4;
 		uint32_t uid = idbuf[0] | idbuf[1] << 8 | idbuf[2] << 16 | idbuf[3] << 24;
+		if (g->shard > 0) {
+			skynet_send(ctx, source, _owner(g, uid), PTYPE_CLIENT | PTYPE_TAG_DONTCOPY, session, (void *)msg, sz);
+			return 1;
+		}
 		int id = hashid_lookup(&g->hash, uid);
 		if (id>=0) {
 			// don't send id (last 4 bytes)
@@ -306,7 +432,7 @@ _cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t sour
 }
 
 static int
-start_listen(struct gate *g, char * listen_addr) {
+start_listen(struct gate *g, char * listen_addr, int reuseport) {
 	struct skynet_context * ctx = g->ctx;
 	char * portstr = strchr(listen_addr,':');
 	const char * host = "";
@@ -326,7 +452,11 @@ start_listen(struct gate *g, char * listen_addr) {
 		portstr[0] = '\0';
 		host = listen_addr;
 	}
-	g->listen_id = skynet_socket_listen(ctx, host, port, BACKLOG);
+	if (reuseport) {
+		g->listen_id = skynet_socket_listen_reuseport(ctx, host, port, BACKLOG);
+	} else {
+		g->listen_id = skynet_socket_listen(ctx, host, port, BACKLOG);
+	}
 	if (g->listen_id < 0) {
 		return 1;
 	}
@@ -334,6 +464,26 @@ start_listen(struct gate *g, char * listen_addr) {
 	return 0;
 }
 
+static int
+start_shards(struct gate *g, const char * header, const char * watchdog, int client_tag, int max, int frame, int shard) {
+	struct skynet_context * ctx = g->ctx;
+	g->shards = skynet_malloc(shard * sizeof(uint32_t));
+	uint32_t self = strtoul(skynet_command(ctx, "REG", NULL) + 1, NULL, 16);
+	int i;
+	for (i=0;i<shard;i++) {
+		char cmd[256];
+		snprintf(cmd, sizeof(cmd), "gate %s %s - %d %d 0 %d 0 %x", header, watchdog, client_tag, max, frame, self);
+		const char * addr = skynet_command(ctx, "LAUNCH", cmd);
+		if (addr == NULL) {
+			skynet_error(ctx, "Launch gate worker %d failed", i);
+			return 1;
+		}
+		g->shards[i] = strtoul(addr+1, NULL, 16);
+		g->shard = i + 1;
+	}
+	return 0;
+}
+
 int
 gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 	if (parm == NULL)
@@ -343,8 +493,15 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 	char watchdog[sz];
 	char binding[sz];
 	int client_tag = 0;
-	char header;
-	int n = sscanf(parm, "%c %s %s %d %d", &header, watchdog, binding, &client_tag, &max);
+	char header[sz];
+	int reuseport = 0;
+	int frame = 0;
+	int shard = 0;
+	uint32_t front = 0;
+	// header watchdog binding client_tag max [reuseport [frame [shard [front]]]]
+	// header is the format of package header (S L s l V, with optional :maxsize, see frame_header.h)
+	// binding is "-" for a gate worker without listen socket, front is the handle (hex) of its front gate
+	int n = sscanf(parm, "%s %s %s %d %d %d %d %d %x", header, watchdog, binding, &client_tag, &max, &reuseport, &frame, &shard, &front);
 	if (n<4) {
 		skynet_error(ctx, "Invalid gate parm %s",parm);
 		return 1;
@@ -353,8 +510,8 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 		skynet_error(ctx, "Need max connection");
 		return 1;
 	}
-	if (header != 'S' && header !='L') {
-		skynet_error(ctx, "Invalid data header style");
+	if (frame_format_parse(&g->format, header)) {
+		skynet_error(ctx, "Invalid data header style %s", header);
 		return 1;
 	}
 
@@ -383,9 +540,21 @@ gate_init(struct gate *g , struct skynet_context * ctx, char * parm) {
 	}
 	
 	g->client_tag = client_tag;
-	g->header_size = header=='S' ? 2 : 4;
+	g->frame = frame;
+	g->front = front;
 
 	skynet_callback(ctx,g,_cb);
 
-	return start_listen(g,binding);
+	if (shard > 1) {
+		// the connections are assigned by hash, not evenly, so each worker accepts up to max connections,
+		// and the front gate counts the connections of all workers not to exceed max
+		if (start_shards(g, header, watchdog, client_tag, max, frame, shard)) {
+			return 1;
+		}
+	}
+	if (strcmp(binding, "-") == 0) {
+		return 0;
+	}
+
+	return start_listen(g,binding,reuseport);
 }
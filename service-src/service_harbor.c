@@ -2,14 +2,24 @@
 #include "skynet_harbor.h"
 #include "skynet_socket.h"
 #include "skynet_handle.h"
+#include "hashid.h"
+#include "lzblock.h"
 
 /*
 	harbor listen the PTYPE_HARBOR (in text)
 	N name : update the global name
-	S fd id: connect to new harbor , we should send self_id to fd first , and then recv a id (check it), and at last send queue.
-	A fd id: accept new harbor , we should send self_id to fd , and then send queue.
-
-	If the fd is disconnected, send message to slave in PTYPE_TEXT.  D id
+	S fd id ext: connect to new harbor , we should send self_id to fd first , and then recv a id (check it), and at last send queue.
+	A fd id ext flags: accept new harbor , we should send self_id to fd , and then send queue.
+	F : (send by harbor itself) flush the remote messages buffered in this batch.
+	C : return the compression stat of harbor links (text).
+
+	The handshake is id (1 byte). When both harbors enable harbor_compress, they learn it from each other by the master,
+	and the slave passes ext = 1 : then the handshake is id (1 byte) + flags (1 byte), and the buffers larger than
+	harbor_compress bytes are sent as compressed blocks if both flags have HANDSHAKE_COMPRESS. So the harbors of the
+	older version (or without harbor_compress) always use the 1 byte handshake with each other.
+
+	If the fd is disconnected, send message to slave in PTYPE_TEXT.  D id fd
+	The harbor down can connect again later (the master accepts the id again), by S or A with a new fd.
 	If we don't known a globalname, send message to slave in PTYPE_TEXT. Q name
  */
 
@@ -20,9 +30,18 @@
 #include <assert.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
 
 #define HASH_SIZE 4096
 #define DEFAULT_QUEUE_SIZE 1024
+#define DEFAULT_FLUSH_SIZE 0x10000
+#define MIN_SEND_BUFFER 1024
+
+#define HANDSHAKE_COMPRESS 1
+// the first byte of the length header of a compressed block
+#define BLOCK_COMPRESSED 0x80
+#define COMPRESS_MAX 0x1000000
 
 // 12 is sizeof(struct remote_message_header)
 #define HEADER_COOKIE_LENGTH 12
@@ -76,13 +95,41 @@ struct slave {
 	int read;
 	uint8_t size[4];
 	char * recv_buffer;
+	uint8_t * send_buffer;	/* 还没有发出的远程消息, 见 send_remote */
+	int send_size;
+	int send_cap;		/* send_buffer 按需倍增, 不超过 flush_size */
+	bool dirty;		/* 已经在 harbor.dirty 里 */
+	bool ext;		/* 握手多一个 flags 字节, 双方都开启了 harbor_compress */
+	bool compress;	/* 双方都开启了压缩 */
+	bool block;		/* 正在接收的是压缩块 */
+};
+
+struct compress_stat {
+	uint64_t compress_blocks;
+	uint64_t compress_skip;		/* 压缩后没有变小, 原样发送 */
+	uint64_t compress_in;
+	uint64_t compress_out;
+	uint64_t compress_time;		/* ns */
+	uint64_t decompress_blocks;
+	uint64_t decompress_in;
+	uint64_t decompress_out;
+	uint64_t decompress_time;
 };
 
 struct harbor {
 	struct skynet_context *ctx;
 	int id;		/* harbor_id 编号 */
+	uint32_t self;
 	uint32_t slave;
 	struct hashmap * map;
+	struct hashid fds;			/* socket id -> slave_id 的下标, 连接时加入, 关闭时移除 */
+	int slave_id[REMOTE_MAX];
+	int flush_size;		/* 合并发送的缓冲区大小, 0 表示每个消息单独发送 */
+	int compress_size;	/* 超过这个大小的缓冲区压缩后发送, 0 表示不压缩 */
+	struct compress_stat stat;
+	bool flushing;		/* 已经给自己发了 flush 消息 */
+	int ndirty;
+	uint8_t dirty[REMOTE_MAX];	/* send_buffer 里有消息的 slave */
 	struct slave s[REMOTE_MAX];
 };
 
@@ -227,32 +274,58 @@ hash_delete(struct hashmap *hash) {
 
 ///////////////
 
+/*
+	The messages to a harbor down are dropped, until it connects again (S or A command with a new fd).
+ */
 static void
 close_harbor(struct harbor *h, int id) {
 	struct slave *s = &h->s[id];
 	s->status = STATUS_DOWN;
 	if (s->fd) {
+		// the socket id is not valid any more, the data and close message of it are ignored
+		hashid_remove(&h->fds, s->fd);
 		skynet_socket_close(h->ctx, s->fd);
-	}
+		s->fd = 0;
+	}
+	skynet_free(s->send_buffer);
+	s->send_buffer = NULL;
+	s->send_size = 0;
+	s->send_cap = 0;
+	skynet_free(s->recv_buffer);
+	s->recv_buffer = NULL;
+	s->length = 0;
+	s->read = 0;
+	s->compress = false;
+	s->block = false;
 	if (s->queue) {
 		release_queue(s->queue);
 		s->queue = NULL;
 	}
 }
 
+// D id fd : the fd tells the slave which link is down, the harbor may connect again with a new one
 static void
-report_harbor_down(struct harbor *h, int id) {
+report_harbor_down(struct harbor *h, int id, int fd) {
 	char down[64];
-	int n = sprintf(down, "D %d",id);
+	int n = sprintf(down, "D %d %d",id, fd);
 
 	skynet_send(h->ctx, 0, h->slave, PTYPE_TEXT, 0, down, n);
 }
 
+// close a broken link, report it here because the close message of socket is ignored
+static void
+drop_harbor(struct harbor *h, int id) {
+	int fd = h->s[id].fd;
+	close_harbor(h, id);
+	report_harbor_down(h, id, fd);
+}
+
 struct harbor *
 harbor_create(void) {
 	struct harbor * h = skynet_malloc(sizeof(*h));
 	memset(h,0,sizeof(*h));
 	h->map = hash_new();
+	hashid_init(&h->fds, REMOTE_MAX);
 	return h;
 }
 
@@ -268,6 +341,7 @@ harbor_release(struct harbor *h) {
 		}
 	}
 	hash_delete(h->map);
+	hashid_clear(&h->fds);
 	skynet_free(h);
 }
 
@@ -325,21 +399,117 @@ forward_local_messsage(struct harbor *h, void *msg, int sz) {
 	}
 }
 
-/* 消息格式:   报文长度(4) + 报文内容+cookie(12)          */
+static inline uint64_t
+now_ns(void) {
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * 1000000000 + ti.tv_nsec;
+}
+
+/* 发送若干完整的消息, buffer 交给 socket. 连接协商了压缩并且足够大时, 压缩成一个块发送 */
 static void
-send_remote(struct skynet_context * ctx, int fd, const char * buffer, size_t sz, struct remote_message_header * cookie) {
+send_frames(struct harbor *h, struct slave *s, uint8_t * buffer, int size) {
+	if (s->compress && size >= h->compress_size && size <= COMPRESS_MAX) {
+		int cap = lzb_bound(size);
+		uint8_t * block = skynet_malloc(cap + 8);
+		uint64_t start = now_ns();
+		int n = lzb_compress(buffer, size, block + 8, cap);
+		h->stat.compress_time += now_ns() - start;
+		int blen = n + 4;
+		if (n > 0 && blen + 4 < size && blen < 0x1000000) {
+			block[0] = BLOCK_COMPRESSED;
+			block[1] = (blen >> 16) & 0xff;
+			block[2] = (blen >> 8) & 0xff;
+			block[3] = blen & 0xff;
+			to_bigendian(block + 4, (uint32_t)size);
+			++h->stat.compress_blocks;
+			h->stat.compress_in += size;
+			h->stat.compress_out += blen + 4;
+			skynet_free(buffer);
+			skynet_socket_send(h->ctx, s->fd, block, blen + 4);
+			return;
+		}
+		++h->stat.compress_skip;
+		skynet_free(block);
+	}
+	// ignore send error, because if the connection is broken, the mainloop will recv a message.
+	skynet_socket_send(h->ctx, s->fd, buffer, size);
+}
+
+static void
+flush_slave(struct harbor *h, struct slave *s) {
+	if (s->send_size > 0) {
+		send_frames(h, s, s->send_buffer, s->send_size);
+		s->send_buffer = NULL;
+		s->send_size = 0;
+		s->send_cap = 0;
+	}
+}
+
+/* 收到自己发的 flush 消息, 之前队列里的消息都处理完了, 把攒下的远程消息发出去 */
+static void
+flush_dirty(struct harbor *h) {
+	int i;
+	for (i=0;i<h->ndirty;i++) {
+		struct slave *s = &h->s[h->dirty[i]];
+		s->dirty = false;
+		flush_slave(h, s);
+	}
+	h->ndirty = 0;
+	h->flushing = false;
+}
+
+/*
+	消息格式:   报文长度(4) + 报文内容+cookie(12)
+	小于 flush_size 的消息先写进 slave 的 send_buffer, 满了或者当前这批消息处理完 (flush_dirty) 再一次发出去.
+ */
+static void
+send_remote(struct harbor *h, struct slave *s, const char * buffer, size_t sz, struct remote_message_header * cookie) {
 	size_t sz_header = sz+sizeof(*cookie);
 	if (sz_header > UINT32_MAX) {
-		skynet_error(ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
+		skynet_error(h->ctx, "remote message from :%08x to :%08x is too large.", cookie->source, cookie->destination);
 		return;
 	}
-	uint8_t * sendbuf = skynet_malloc(sz_header+4);
+	size_t frame = sz_header + 4;
+	if (frame >= (size_t)h->flush_size) {
+		// keep the order of messages
+		flush_slave(h, s);
+		uint8_t * sendbuf = skynet_malloc(frame);
+		to_bigendian(sendbuf, (uint32_t)sz_header);
+		memcpy(sendbuf+4, buffer, sz);
+		header_to_message(cookie, sendbuf+4+sz);
+		send_frames(h, s, sendbuf, (int)frame);
+		return;
+	}
+	if (s->send_size + frame > (size_t)h->flush_size) {
+		flush_slave(h, s);
+	}
+	if (s->send_size + frame > (size_t)s->send_cap) {
+		// most batches are small, don't allocate flush_size for each of them
+		int cap = s->send_cap ? s->send_cap * 2 : MIN_SEND_BUFFER;
+		while (cap < s->send_size + frame) {
+			cap *= 2;
+		}
+		if (cap > h->flush_size) {
+			cap = h->flush_size;
+		}
+		s->send_buffer = skynet_realloc(s->send_buffer, cap);
+		s->send_cap = cap;
+	}
+	uint8_t * sendbuf = s->send_buffer + s->send_size;
 	to_bigendian(sendbuf, (uint32_t)sz_header);
 	memcpy(sendbuf+4, buffer, sz);
 	header_to_message(cookie, sendbuf+4+sz);
-
-	// ignore send error, because if the connection is broken, the mainloop will recv a message.
-	skynet_socket_send(ctx, fd, sendbuf, sz_header+4);
+	s->send_size += frame;
+	if (!s->dirty) {
+		s->dirty = true;
+		h->dirty[h->ndirty++] = s - h->s;
+	}
+	if (!h->flushing) {
+		h->flushing = true;
+		// the message is after the messages in queue now
+		skynet_send(h->ctx, 0, h->self, PTYPE_HARBOR, 0, "F", 1);
+	}
 }
 
 static void
@@ -382,7 +552,7 @@ dispatch_name_queue(struct harbor *h, struct keyvalue * node) {
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
 		m->header.destination |= (handle & HANDLE_MASK);
-		send_remote(context, fd, m->buffer, m->size, &m->header);
+		send_remote(h, s, m->buffer, m->size, &m->header);
 		skynet_free(m->buffer);
 	}
 }
@@ -399,46 +569,82 @@ dispatch_queue(struct harbor *h, int id) {
 
 	struct harbor_msg * m;
 	while ((m = pop_queue(queue)) != NULL) {
-		send_remote(h->ctx, fd, m->buffer, m->size, &m->header);
+		send_remote(h, s, m->buffer, m->size, &m->header);
 		skynet_free(m->buffer);
 	}
 	release_queue(queue);
 	s->queue = NULL;
 }
 
-static void
-push_socket_data(struct harbor *h, const struct skynet_socket_message * message) {
-	assert(message->type == SKYNET_SOCKET_TYPE_DATA);
-	int fd = message->id;
-	int i;
-	int id = 0;
-	struct slave * s = NULL;
-	for (i=1;i<REMOTE_MAX;i++) {
-		if (h->s[i].fd == fd) {
-			s = &h->s[i];
-			id = i;
-			break;
-		}
+static int
+harbor_id(struct harbor *h, int fd) {
+	int index = hashid_lookup(&h->fds, fd);
+	if (index < 0) {
+		return 0;
 	}
-	if (s == NULL) {
-		skynet_error(h->ctx, "Invalid socket fd (%d) data", fd);
-		return;
+	return h->slave_id[index];
+}
+
+static int push_stream(struct harbor *h, int id, const uint8_t * buffer, int size);
+
+/* 压缩块: 原始长度(4) + lzblock 数据, 解压后是若干完整的消息 */
+static int
+unpack_block(struct harbor *h, int id, const uint8_t * block, int sz) {
+	struct slave * s = &h->s[id];
+	if (sz < 4)
+		return 1;
+	uint32_t n = (uint32_t)block[0] << 24 | block[1] << 16 | block[2] << 8 | block[3];
+	if (n == 0 || n > COMPRESS_MAX)
+		return 1;
+	uint8_t * raw = skynet_malloc(n);
+	uint64_t start = now_ns();
+	int r = lzb_decompress(block + 4, sz - 4, raw, (int)n);
+	h->stat.decompress_time += now_ns() - start;
+	if (r < 0) {
+		skynet_free(raw);
+		return 1;
 	}
-	uint8_t * buffer = (uint8_t *)message->buffer;
-	int size = message->ud;
+	++h->stat.decompress_blocks;
+	h->stat.decompress_in += sz + 4;
+	h->stat.decompress_out += n;
+	// a block is never nested
+	s->compress = false;
+	r = push_stream(h, id, raw, (int)n);
+	s->compress = true;
+	skynet_free(raw);
+	if (r)
+		return r;
+	if (s->status != STATUS_HEADER || s->read != 0)
+		return 1;
+	return 0;
+}
 
+// return 0 when succeed, 1 if the harbor is closed
+static int
+push_stream(struct harbor *h, int id, const uint8_t * buffer, int size) {
+	struct slave * s = &h->s[id];
 	for (;;) {
 		switch(s->status) {
 		case STATUS_HANDSHAKE: {
+			// id (1) + flags (1, when ext)
+			int need = (s->ext ? 2 : 1) - s->read;
+			if (size < need) {
+				memcpy(s->size + s->read, buffer, size);
+				s->read += size;
+				return 0;
+			}
+			memcpy(s->size + s->read, buffer, need);
+			buffer += need;
+			size -= need;
+			s->read = 0;
 			// check id
-			uint8_t remote_id = buffer[0];
+			uint8_t remote_id = s->size[0];
 			if (remote_id != id) {
-				skynet_error(h->ctx, "Invalid shakehand id (%d) from fd = %d , harbor = %d", id, fd, remote_id);
-				close_harbor(h,id);
-				return;
+				skynet_error(h->ctx, "Invalid shakehand id (%d) from fd = %d , harbor = %d", id, s->fd, remote_id);
+				drop_harbor(h,id);
+				return 1;
 			}
-			++buffer;
-			--size;
+			s->compress = s->ext && (s->size[1] & HANDSHAKE_COMPRESS) && h->compress_size > 0;
 			s->status = STATUS_HEADER;
 
 			dispatch_queue(h, id);
@@ -449,28 +655,30 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 			// go though
 		}
 		case STATUS_HEADER: {	/* 接收四字节头部 */
-			// big endian 4 bytes length, the first one must be 0.
+			// big endian 4 bytes length, the first one must be 0 (or BLOCK_COMPRESSED).
 			int need = 4 - s->read;
 			if (size < need) {
 				memcpy(s->size + s->read, buffer, size);
 				s->read += size;
-				return;
+				return 0;
 			} else {
 				memcpy(s->size + s->read, buffer, need);
 				buffer += need;
 				size -= need;
 
-				if (s->size[0] != 0) {
+				if (s->size[0] == BLOCK_COMPRESSED && s->compress) {
+					s->block = true;
+				} else if (s->size[0] != 0) {
 					skynet_error(h->ctx, "Message is too long from harbor %d", id);
-					close_harbor(h,id);
-					return;
+					drop_harbor(h,id);
+					return 1;
 				}
 				s->length = s->size[1] << 16 | s->size[2] << 8 | s->size[3];
 				s->read = 0;
 				s->recv_buffer = skynet_malloc(s->length);
 				s->status = STATUS_CONTENT;
 				if (size == 0) {
-					return;
+					return 0;
 				}
 			}
 		}
@@ -480,26 +688,53 @@ push_socket_data(struct harbor *h, const struct skynet_socket_message * message)
 			if (size < need) {
 				memcpy(s->recv_buffer + s->read, buffer, size);
 				s->read += size;
-				return;
+				return 0;
 			}
 			memcpy(s->recv_buffer + s->read, buffer, need);
-			forward_local_messsage(h, s->recv_buffer, s->length);
+			char * content = s->recv_buffer;
+			int length = s->length;
 			s->length = 0;
 			s->read = 0;
 			s->recv_buffer = NULL;
 			size -= need;
 			buffer += need;
 			s->status = STATUS_HEADER;
+			if (s->block) {
+				s->block = false;
+				int r = unpack_block(h, id, (const uint8_t *)content, length);
+				skynet_free(content);
+				if (r) {
+					if (s->status != STATUS_DOWN) {
+						skynet_error(h->ctx, "Invalid compressed block from harbor %d", id);
+						drop_harbor(h,id);
+					}
+					return 1;
+				}
+			} else {
+				forward_local_messsage(h, content, length);
+			}
 			if (size == 0)
-				return;
+				return 0;
 			break;
 		}
 		default:
-			return;
+			return 1;
 		}
 	}
 }
 
+static void
+push_socket_data(struct harbor *h, const struct skynet_socket_message * message) {
+	assert(message->type == SKYNET_SOCKET_TYPE_DATA);
+	int fd = message->id;
+	int id = harbor_id(h, fd);
+	if (id == 0) {
+		// the rest of a link closed by close_harbor
+		return;
+	}
+	push_stream(h, id, (const uint8_t *)message->buffer, message->ud);
+}
+
 static void
 update_name(struct harbor *h, const char name[GLOBALNAME_LENGTH], uint32_t handle) {
 	struct keyvalue * node = hash_search(h->map, name);
@@ -547,7 +782,7 @@ remote_send_handle(struct harbor *h, uint32_t source, uint32_t destination, int
 		cookie.source = source;
 		cookie.destination = (destination & HANDLE_MASK) | ((uint32_t)type << HANDLE_REMOTE_SHIFT);
 		cookie.session = (uint32_t)session;
-		send_remote(context, s->fd, msg,sz,&cookie);
+		send_remote(h, s, msg,sz,&cookie);
 	}
 
 	return 0;
@@ -581,9 +816,25 @@ remote_send_name(struct harbor *h, uint32_t source, const char name[GLOBALNAME_L
 static void
 handshake(struct harbor *h, int id) {
 	struct slave *s = &h->s[id];
-	uint8_t * handshake = skynet_malloc(1);
+	int sz = s->ext ? 2 : 1;
+	uint8_t * handshake = skynet_malloc(sz);
 	handshake[0] = (uint8_t)h->id;
-	skynet_socket_send(h->ctx, s->fd, handshake, 1);
+	if (s->ext) {
+		handshake[1] = h->compress_size > 0 ? HANDSHAKE_COMPRESS : 0;
+	}
+	skynet_socket_send(h->ctx, s->fd, handshake, sz);
+}
+
+static void
+compress_stat(struct harbor *h, int session, uint32_t source) {
+	const struct compress_stat *st = &h->stat;
+	char tmp[512];
+	int n = snprintf(tmp, sizeof(tmp),
+		"compress_blocks=%" PRIu64 " compress_skip=%" PRIu64 " compress_in=%" PRIu64 " compress_out=%" PRIu64 " compress_time=%.6f "
+		"decompress_blocks=%" PRIu64 " decompress_in=%" PRIu64 " decompress_out=%" PRIu64 " decompress_time=%.6f",
+		st->compress_blocks, st->compress_skip, st->compress_in, st->compress_out, (double)st->compress_time / 1e9,
+		st->decompress_blocks, st->decompress_in, st->decompress_out, (double)st->decompress_time / 1e9);
+	skynet_send(h->ctx, 0, source, PTYPE_RESPONSE, session, tmp, n);
 }
 
 static void
@@ -592,6 +843,12 @@ harbor_command(struct harbor * h, const char * msg, size_t sz, int session, uint
 	int s = (int)sz;
 	s -= 2;
 	switch(msg[0]) {
+	case 'F' :
+		flush_dirty(h);
+		break;
+	case 'C' :
+		compress_stat(h, session, source);
+		break;
 	case 'N' : {
 		if (s <=0 || s>= GLOBALNAME_LENGTH) {
 			skynet_error(h->ctx, "Invalid global name %s", name);
@@ -609,8 +866,9 @@ harbor_command(struct harbor * h, const char * msg, size_t sz, int session, uint
 		char buffer[s+1];
 		memcpy(buffer, name, s);
 		buffer[s] = 0;
-		int fd=0, id=0;
-		sscanf(buffer, "%d %d",&fd,&id);
+		int fd=0, id=0, ext=0, flags=0;
+		// ext : the handshake has the flags byte, A fd id ext flags : the flags of handshake from the remote harbor
+		sscanf(buffer, "%d %d %d %d",&fd,&id,&ext,&flags);
 		if (fd == 0 || id <= 0 || id>=REMOTE_MAX) {
 			skynet_error(h->ctx, "Invalid command %c %s", msg[0], buffer);
 			return;
@@ -621,6 +879,8 @@ harbor_command(struct harbor * h, const char * msg, size_t sz, int session, uint
 			return;
 		}
 		slave->fd = fd;
+		slave->ext = ext != 0;
+		h->slave_id[hashid_insert(&h->fds, fd)] = id;
 
 		skynet_socket_start(h->ctx, fd);
 		handshake(h, id);
@@ -628,6 +888,7 @@ harbor_command(struct harbor * h, const char * msg, size_t sz, int session, uint
 			slave->status = STATUS_HANDSHAKE;
 		} else {
 			slave->status = STATUS_HEADER;
+			slave->compress = slave->ext && (flags & HANDSHAKE_COMPRESS) && h->compress_size > 0;
 			dispatch_queue(h,id);
 		}
 		break;
@@ -638,18 +899,6 @@ harbor_command(struct harbor * h, const char * msg, size_t sz, int session, uint
 	}
 }
 
-static int
-harbor_id(struct harbor *h, int fd) {
-	int i;
-	for (i=1;i<REMOTE_MAX;i++) {
-		struct slave *s = &h->s[i];
-		if (s->fd == fd) {
-			return i;
-		}
-	}
-	return 0;
-}
-
 static int
 mainloop(struct skynet_context * context, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
 	struct harbor * h = ud;
@@ -665,10 +914,13 @@ mainloop(struct skynet_context * context, void * ud, int type, int session, uint
 		case SKYNET_SOCKET_TYPE_CLOSE: {
 			int id = harbor_id(h, message->id);
 			if (id) {
-				report_harbor_down(h,id);
-			} else {
-				skynet_error(context, "Unkown fd (%d) closed", message->id);
+				// the socket id is not valid any more, don't close it again
+				hashid_remove(&h->fds, message->id);
+				h->s[id].fd = 0;
+				close_harbor(h,id);
+				report_harbor_down(h,id,message->id);
 			}
+			// or it's closed by close_harbor (reported by drop_harbor)
 			break;
 		}
 		case SKYNET_SOCKET_TYPE_CONNECT:
@@ -720,12 +972,18 @@ harbor_init(struct harbor *h, struct skynet_context *ctx, const char * args) {
 	h->ctx = ctx;
 	int harbor_id = 0;
 	uint32_t slave = 0;
-	sscanf(args,"%d %u", &harbor_id, &slave);
+	int flush_size = DEFAULT_FLUSH_SIZE;
+	int compress_size = 0;
+	sscanf(args,"%d %u %d %d", &harbor_id, &slave, &flush_size, &compress_size);
 	if (slave == 0) {
 		return 1;
 	}
 	h->id = harbor_id;
 	h->slave = slave;
+	h->flush_size = flush_size > 0 ? flush_size : 0;
+	h->compress_size = compress_size > 0 ? compress_size : 0;
+	const char * self = skynet_command(ctx, "REG", NULL);
+	h->self = strtoul(self+1, NULL, 16);
 	skynet_callback(ctx, h, mainloop);
 	skynet_harbor_start(ctx);
 
@@ -1,4 +1,5 @@
 #include "skynet.h"
+#include "luaarena.h"
 
 #include <lua.h>
 #include <lualib.h>
@@ -17,6 +18,7 @@ struct snlua {
 	size_t mem;
 	size_t mem_report;
 	size_t mem_limit;		/* LUA_REGISTRYINDEX 的memlimit */
+	struct arena * arena;	/* NULL when lua_arena is off */
 };
 
 // LUA_CACHELIB may defined in patched lua for shared proto
@@ -46,6 +48,34 @@ codecache(lua_State *L) {
 
 #endif
 
+/*
+	return reserved used request large (bytes) of the arena, or nothing when lua_arena is off
+ */
+static int
+larenastat(lua_State *L) {
+	void * ud = NULL;
+	lua_getallocf(L, &ud);
+	struct snlua *l = ud;
+	struct arena *a = l->arena;
+	if (a == NULL)
+		return 0;
+	lua_pushinteger(L, a->reserved);
+	lua_pushinteger(L, a->used);
+	lua_pushinteger(L, a->request);
+	lua_pushinteger(L, a->large);
+	return 4;
+}
+
+static int
+luaopen_arena(lua_State *L) {
+	luaL_Reg l[] = {
+		{ "stat", larenastat },
+		{ NULL, NULL },
+	};
+	luaL_newlib(L,l);
+	return 1;
+}
+
 static int 
 traceback (lua_State *L) {
 	const char *msg = lua_tostring(L, 1);
@@ -84,6 +114,8 @@ init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t s
 	lua_setfield(L, LUA_REGISTRYINDEX, "skynet_context");
 	luaL_requiref(L, "skynet.codecache", codecache , 0);
 	lua_pop(L,1);	/* 将 skynet.codecache 的栈顶副本弹出,在luaL_requiref成功会残留一个副本在栈顶，需要弹出 */
+	luaL_requiref(L, "skynet.arena", luaopen_arena , 0);
+	lua_pop(L,1);
 
 	const char *path = optstring(ctx, "lua_path","./lualib/?.lua;./lualib/?/init.lua");
 	lua_pushstring(L, path);
@@ -174,6 +206,9 @@ lalloc(void * ud, void *ptr, size_t osize, size_t nsize) {
 		l->mem_report *= 2;
 		skynet_error(l->ctx, "Memory warning %.2f M", (float)l->mem / (1024 * 1024));
 	}
+	if (l->arena) {
+		return arena_lalloc(l->arena, ptr, osize, nsize);
+	}
 	return skynet_lalloc(ptr, osize, nsize);
 }
 
@@ -183,6 +218,10 @@ snlua_create(void) {
 	memset(l,0,sizeof(*l));
 	l->mem_report = MEMORY_WARNING_REPORT;
 	l->mem_limit = 0;
+	const char * arena = skynet_command(NULL, "GETENV", "lua_arena");
+	if (arena && strcmp(arena, "true") == 0) {
+		l->arena = arena_new();
+	}
 	l->L = lua_newstate(lalloc, l);		/* 创建一个虚拟机，然后里面分配内存都是用lalloc来分配，并传递l作为参数 */
 	return l;
 }
@@ -190,6 +229,10 @@ snlua_create(void) {
 void
 snlua_release(struct snlua *l) {
 	lua_close(l->L);
+	if (l->arena) {
+		// release all the chunks at once
+		arena_delete(l->arena);
+	}
 	skynet_free(l);
 }
 
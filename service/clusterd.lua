@@ -105,16 +105,82 @@ function command.listen(source, addr, port)
 	skynet.ret(skynet.pack(nil))
 end
 
+-- The small requests to the same node are queued, and written as one batch package
+-- after the messages already in the queue of clusterd are dispatched.
+-- Set cluster_batch = true in config only if all the nodes can read the batch package (package type 4).
+local batch_enable = skynet.getenv "cluster_batch" == "true"
+local batch_limit = 0xf000
+local batch_queue = {}	-- channel -> { size = bytes, request1, request2, ... }
+
+local function flush_batch(c)
+	local queue = batch_queue[c]
+	if queue == nil then
+		return
+	end
+	batch_queue[c] = nil
+	-- the requests are waiting for the responses, and they will be wakeup by socketchannel if the write fails
+	local ok, err = pcall(c.request, c, cluster.packbatch(queue))
+	if not ok then
+		skynet.error(string.format("Write %d requests failed : %s", #queue, tostring(err)))
+	end
+end
+
+local function queue_request(c, request)
+	local queue = batch_queue[c]
+	if queue and queue.size + #request > batch_limit then
+		flush_batch(c)
+		queue = nil
+	end
+	if queue == nil then
+		queue = { size = 0 }
+		batch_queue[c] = queue
+		skynet.timeout(0, function()
+			if batch_queue[c] == queue then
+				flush_batch(c)
+			end
+		end)
+	end
+	queue.size = queue.size + #request
+	queue[#queue+1] = request
+end
+
+-- the parts of multi part request are C buffers (part1, size1, ...), free them if the channel can't be opened
+local function get_channel(node, padding)
+	if not padding then
+		return node_channel[node]
+	end
+	local c = rawget(node_channel, node)
+	if c == nil then
+		local ok
+		ok, c = pcall(open_channel, node_channel, node)
+		if not ok then
+			for i = 1, #padding, 2 do
+				skynet.trash(padding[i], padding[i+1])
+			end
+			error(c)
+		end
+	end
+	return c
+end
+
 local function send_request(source, node, addr, msg, sz)
 	local session = node_session[node] or 1
 	-- msg is a local pointer, cluster.packrequest will free it
 	local request, new_session, padding = cluster.packrequest(addr, session, msg, sz)
 	node_session[node] = new_session
 
-	-- node_channel[node] may yield or throw error
-	local c = node_channel[node]
+	-- get_channel may yield or throw error
+	local c = get_channel(node, padding)
 
-	return c:request(request, session, padding)
+	if padding or not batch_enable then
+		-- multi part request is not batched, keep the order of requests
+		flush_batch(c)
+		return c:request(request, session, padding)
+	end
+	-- connect once (the same as c:request) before queuing, so c:response would not yield before waiting
+	c:connect(true)
+	queue_request(c, request)
+	return c:response(session)
 end
 
 function command.req(...)
@@ -138,10 +204,16 @@ function command.push(source, node, addr, msg, sz)
 		node_session[node] = new_session
 	end
 
-	-- node_channel[node] may yield or throw error
-	local c = node_channel[node]
+	-- get_channel may yield or throw error
+	local c = get_channel(node, padding)
 
-	c:request(request, nil, padding)
+	if padding or not batch_enable then
+		flush_batch(c)
+		c:request(request, nil, padding)
+	else
+		c:connect(true)
+		queue_request(c, request)
+	end
 
 	-- notice: push may fail where the channel is disconnected or broken.
 end
@@ -173,67 +245,67 @@ end
 
 local large_request = {}
 
-function command.socket(source, subcmd, fd, msg)
-	if subcmd == "data" then
-		local sz
-		local addr, session, msg, padding, is_push = cluster.unpackrequest(msg)
-		if padding then
-			local requests = large_request[fd]
-			if requests == nil then
-				requests = {}
-				large_request[fd] = requests
-			end
-			local req = requests[session] or { addr = addr , is_push = is_push }
-			requests[session] = req
-			table.insert(req, msg)
-			return
+-- sz is true when the multi part request is not complete (see cluster.unpackrequest)
+local function dispatch_request(fd, addr, session, msg, sz, is_push)
+	if sz == true then
+		return
+	end
+	if not msg then
+		local response = cluster.packresponse(session, false, "Invalid large req")
+		socket.write(fd, response)
+		return
+	end
+	local ok, response
+	if addr == 0 then
+		local name = skynet.unpack(msg, sz)
+		if sz then
+			skynet.trash(msg, sz)
+		end
+		local addr = register_name[name]
+		if addr then
+			ok = true
+			msg, sz = skynet.pack(addr)
 		else
-			local requests = large_request[fd]
-			if requests then
-				local req = requests[session]
-				if req then
-					requests[session] = nil
-					table.insert(req, msg)
-					msg,sz = cluster.concat(req)
-					addr = req.addr
-					is_push = req.is_push
-				end
-			end
-			if not msg then
-				local response = cluster.packresponse(session, false, "Invalid large req")
-				socket.write(fd, response)
-				return
-			end
+			ok = false
+			msg = "name not found"
 		end
-		local ok, response
-		if addr == 0 then
-			local name = skynet.unpack(msg, sz)
-			local addr = register_name[name]
-			if addr then
-				ok = true
-				msg, sz = skynet.pack(addr)
-			else
-				ok = false
-				msg = "name not found"
+	elseif is_push then
+		skynet.rawsend(addr, "lua", msg, sz)
+		return	-- no response
+	else
+		ok , msg, sz = pcall(skynet.rawcall, addr, "lua", msg, sz)
+	end
+	if ok then
+		response = cluster.packresponse(session, true, msg, sz)
+		if type(response) == "table" then
+			-- multi part response, C buffers : part1, size1, ... (socket frees them even if the write fails)
+			for i = 1, #response, 2 do
+				socket.lwrite(fd, response[i], response[i+1])
 			end
-		elseif is_push then
-			skynet.rawsend(addr, "lua", msg, sz)
-			return	-- no response
 		else
-			ok , msg, sz = pcall(skynet.rawcall, addr, "lua", msg, sz)
+			socket.write(fd, response)
+		end
+	else
+		response = cluster.packresponse(session, false, msg)
+		socket.write(fd, response)
+	end
+end
+
+function command.socket(source, subcmd, fd, msg)
+	if subcmd == "data" then
+		local requests = large_request[fd]
+		if requests == nil then
+			requests = {}
+			large_request[fd] = requests
 		end
-		if ok then
-			response = cluster.packresponse(session, true, msg, sz)
-			if type(response) == "table" then
-				for _, v in ipairs(response) do
-					socket.lwrite(fd, v)
-				end
-			else
-				socket.write(fd, response)
+		local addr, session, msg, sz, is_push = cluster.unpackrequest(msg, requests)
+		if type(addr) == "table" then
+			-- a batch of requests, dispatch them concurrently (and in order)
+			for _, req in ipairs(addr) do
+				skynet.fork(dispatch_request, fd, cluster.unpackrequest(req, requests))
 			end
 		else
-			response = cluster.packresponse(session, false, msg)
-			socket.write(fd, response)
+			dispatch_request(fd, addr, session, msg, sz, is_push)
 		end
 	elseif subcmd == "open" then
 		skynet.error(string.format("socket accept from %s", msg))
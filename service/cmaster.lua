@@ -11,7 +11,7 @@ local socket = require "skynet.socket"
 	protocol slave->master :
 		package size 1 byte
 		type 1 byte :
-			'H' : HANDSHAKE, report slave id, and address.
+			'H' : HANDSHAKE, report slave id, address, and ext (true when harbor_compress is enabled).
 			'R' : REGISTER name address
 			'Q' : QUERY name
 
@@ -19,8 +19,8 @@ local socket = require "skynet.socket"
 	protocol master->slave:
 		package size 1 byte
 		type 1 byte :
-			'W' : WAIT n
-			'C' : CONNECT slave_id slave_address
+			'W' : WAIT n ext_map (32 bytes bitmap of the slave ids reported ext)
+			'C' : CONNECT slave_id slave_address ext
 			'N' : NAME globalname address
 			'D' : DISCONNECT slave_id
 ]]
@@ -43,30 +43,37 @@ local function pack_package(...)
 	return string.char(size) .. message
 end
 
-local function report_slave(fd, slave_id, slave_addr)
-	local message = pack_package("C", slave_id, slave_addr)
+local function report_slave(fd, slave_id, slave_addr, slave_ext)
+	local message = pack_package("C", slave_id, slave_addr, slave_ext)
 	local n = 0
+	local ext_map = { string.byte(string.rep("\0", 32), 1, -1) }
 	for k,v in pairs(slave_node) do
 		if v.fd ~= 0 then
 			socket.write(v.fd, message)
 			n = n + 1
+			if v.ext then
+				local i = (k >> 3) + 1
+				ext_map[i] = ext_map[i] | (1 << (k & 7))
+			end
 		end
 	end
-	socket.write(fd, pack_package("W", n))
+	socket.write(fd, pack_package("W", n, string.char(table.unpack(ext_map))))
 end
 
 local function handshake(fd)
-	local t, slave_id, slave_addr = read_package(fd)
+	local t, slave_id, slave_addr, slave_ext = read_package(fd)
 	assert(t=='H', "Invalid handshake type " .. t)
 	assert(slave_id ~= 0 , "Invalid slave id 0")
-	if slave_node[slave_id] then
+	-- the slave down (fd is 0) can register again
+	if slave_node[slave_id] and slave_node[slave_id].fd ~= 0 then
 		error(string.format("Slave %d already register on %s", slave_id, slave_node[slave_id].addr))
 	end
-	report_slave(fd, slave_id, slave_addr)
+	report_slave(fd, slave_id, slave_addr, slave_ext)
 	slave_node[slave_id] = {
 		fd = fd,
 		id = slave_id,
 		addr = slave_addr,
+		ext = slave_ext,
 	}
 	return slave_id , slave_addr
 end
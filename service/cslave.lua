@@ -10,6 +10,9 @@ local globalname = {}
 local queryname = {}
 local harbor = {}
 local harbor_service
+-- the harbors (from master) enabled the flags byte of handshake
+local slave_ext = {}
+local handshake_ext
 local monitor = {}
 local monitor_master_set = {}
 
@@ -40,14 +43,16 @@ end
 
 local function connect_slave(slave_id, address)
 	local ok, err = pcall(function()
-		if slaves[slave_id] == nil then
+		-- false : the harbor is down, and it connects to master again
+		if not slaves[slave_id] then
 			local fd = assert(socket.open(address), "Can't connect to "..address)
 			socketdriver.nodelay(fd)
 			skynet.error(string.format("Connect to harbor %d (fd=%d), %s", slave_id, fd, address))
 			slaves[slave_id] = fd
 			monitor_clear(slave_id)
 			socket.abandon(fd)
-			skynet.send(harbor_service, "harbor", string.format("S %d %d",fd,slave_id))
+			local ext = (handshake_ext and slave_ext[slave_id]) and 1 or 0
+			skynet.send(harbor_service, "harbor", string.format("S %d %d %d",fd,slave_id,ext))
 		end
 	end)
 	if not ok then
@@ -79,9 +84,10 @@ end
 
 local function monitor_master(master_fd)
 	while true do
-		local ok, t, id_name, address = pcall(read_package,master_fd)
+		local ok, t, id_name, address, ext = pcall(read_package,master_fd)
 		if ok then
 			if t == 'C' then
+				slave_ext[id_name] = ext
 				if connect_queue then
 					connect_queue[id_name] = address
 				else
@@ -114,14 +120,26 @@ end
 
 local function accept_slave(fd)
 	socket.start(fd)
-	local id = socket.read(fd, 1)
-	if not id then
+	-- handshake : id (1 byte) [+ flags (1 byte), when both sides enabled it]
+	local hs = socket.read(fd, 1)
+	if not hs then
 		skynet.error(string.format("Connection (fd =%d) closed", fd))
 		socket.close(fd)
 		return
 	end
-	id = string.byte(id)
-	if slaves[id] ~= nil then
+	local id = string.byte(hs)
+	local ext = (handshake_ext and slave_ext[id]) and 1 or 0
+	local flags = 0
+	if ext == 1 then
+		hs = socket.read(fd, 1)
+		if not hs then
+			skynet.error(string.format("Connection (fd =%d) closed", fd))
+			socket.close(fd)
+			return
+		end
+		flags = string.byte(hs)
+	end
+	if slaves[id] then
 		skynet.error(string.format("Slave %d exist (fd =%d)", id, fd))
 		socket.close(fd)
 		return
@@ -130,7 +148,7 @@ local function accept_slave(fd)
 	monitor_clear(id)
 	socket.abandon(fd)
 	skynet.error(string.format("Harbor %d connected (fd = %d)", id, fd))
-	skynet.send(harbor_service, "harbor", string.format("A %d %d", fd, id))
+	skynet.send(harbor_service, "harbor", string.format("A %d %d %d %d", fd, id, ext, flags))
 end
 
 skynet.register_protocol {
@@ -159,12 +177,13 @@ local function monitor_harbor(master_fd)
 				socket.write(master_fd, pack_package("Q", arg))
 			end
 		elseif t == 'D' then
-			-- harbor down
-			local id = tonumber(arg)
-			if slaves[id] then
+			-- harbor down : D id fd, ignore it if the harbor has connected again (by another fd)
+			local id, fd = arg:match "(%d+) (%d+)"
+			id = tonumber(id)
+			if slaves[id] == tonumber(fd) then
 				monitor_clear(id)
+				slaves[id] = false
 			end
-			slaves[id] = false
 		else
 			skynet.error("Unknown command ", command)
 		end
@@ -205,6 +224,15 @@ function harbor.CONNECT(fd, id)
 	end
 end
 
+function harbor.COMPRESSSTAT(fd)
+	local stat = {}
+	local text = skynet.call(harbor_service, "harbor", "C")
+	for k, v in text:gmatch "([%w_]+)=(%S+)" do
+		stat[k] = tonumber(v)
+	end
+	skynet.ret(skynet.pack(stat))
+end
+
 function harbor.QUERYNAME(fd, name)
 	if name:byte() == 46 then	-- "." , local name
 		skynet.ret(skynet.pack(skynet.localname(name)))
@@ -239,12 +267,26 @@ skynet.start(function()
 	end)
 	skynet.dispatch("text", monitor_harbor(master_fd))
 
-	harbor_service = assert(skynet.launch("harbor", harbor_id, skynet.self()))
+	-- harbor_flush : bytes of the buffer to merge the remote messages, 0 sends each message alone
+	local flush_size = tonumber(skynet.getenv "harbor_flush" or 0x10000)
+	-- harbor_compress : compress the buffers larger than this size on the links to the harbors enabled it too, 0 disables
+	local compress_size = tonumber(skynet.getenv "harbor_compress" or 0)
+	harbor_service = assert(skynet.launch("harbor", harbor_id, skynet.self(), flush_size, compress_size))
+	-- the flags byte of handshake is used only when both harbors report it to master,
+	-- so the harbors of the older version (1 byte handshake) can be upgraded one by one.
+	handshake_ext = compress_size > 0
 
-	local hs_message = pack_package("H", harbor_id, slave_address)
+	local hs_message = pack_package("H", harbor_id, slave_address, handshake_ext)
 	socket.write(master_fd, hs_message)
-	local t, n = read_package(master_fd)
+	local t, n, ext_map = read_package(master_fd)
 	assert(t == "W" and type(n) == "number", "slave shakehand failed")
+	if ext_map then
+		for id = 1, 255 do
+			if (ext_map:byte((id >> 3) + 1) >> (id & 7)) & 1 == 1 then
+				slave_ext[id] = true
+			end
+		end
+	end
 	skynet.error(string.format("Waiting for %d harbors", n))
 	skynet.fork(monitor_master, master_fd)
 	if n > 0 then
@@ -155,6 +155,8 @@ function COMMAND.help()
 		debug = "debug address : debug a lua service",
 		signal = "signal address sig",
 		cmem = "Show C memory info",
+		jmem = "Show jemalloc arena stats",
+		purge = "Return the dirty pages of jemalloc to the system",
 		shrtbl = "Show shared short string table info",
 		ping = "ping address",
 		call = "call address ...",
@@ -330,6 +332,23 @@ function COMMAND.cmem()
 	return tmp
 end
 
+function COMMAND.jmem()
+	local info = memory.jemalloc()
+	local arenas = info.arenas
+	info.arenas = nil
+	if arenas then
+		for i, arena in pairs(arenas) do
+			info["arena" .. i] = arena
+		end
+	end
+	return info
+end
+
+function COMMAND.purge()
+	memory.purge()
+	return COMMAND.jmem()
+end
+
 function COMMAND.shrtbl()
 	local n, total, longest, space = memory.ssinfo()
 	return { n = n, total = total, longest = longest, space = space }
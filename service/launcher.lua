@@ -44,9 +44,13 @@ end
 function command.MEM()
 	local list = {}
 	for k,v in pairs(services) do
-		local ok, kb, bytes = pcall(skynet.call,k,"debug","MEM")
+		local ok, kb, bytes, reserved, _, request = pcall(skynet.call,k,"debug","MEM")
 		if not ok then
 			list[skynet.address(k)] = string.format("ERROR (%s)",v)
+		elseif reserved and reserved > 0 then
+			-- fragmentation : the bytes in arena chunks not requested by lua
+			list[skynet.address(k)] = string.format("%.2f Kb (%s) arena %.2f Kb, fragmentation %.1f%%",
+				kb, v, reserved / 1024, (reserved - request) * 100 / reserved)
 		else
 			list[skynet.address(k)] = string.format("%.2f Kb (%s)",kb,v)
 		end
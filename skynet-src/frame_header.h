@@ -0,0 +1,151 @@
+#ifndef skynet_frame_header_h
+#define skynet_frame_header_h
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+	The header of a package is the size of the data (header not included) :
+		S : uint16 big-endian		L : uint32 big-endian
+		s : uint16 little-endian	l : uint32 little-endian
+		V : varint, 7 bits per byte, the lowest group first, the highest bit means more bytes follow
+	The format string is the type and an optional max size, such as "S", "V", "L:1048576" .
+	The packages larger than or equal to max are invalid.
+ */
+
+#define FRAME_HEADER_MAX 5
+#define FRAME_DEFAULT_MAX 0x1000000
+
+struct frame_format {
+	char type;	// 0 : no framing
+	int max;
+};
+
+// return 0 when succeed
+static inline int
+frame_format_parse(struct frame_format *f, const char *str) {
+	switch (str[0]) {
+	case 'S':
+	case 's':
+	case 'L':
+	case 'l':
+	case 'V':
+		break;
+	default:
+		return 1;
+	}
+	f->type = str[0];
+	f->max = FRAME_DEFAULT_MAX;
+	if (str[1] == ':') {
+		char * end;
+		long max = strtol(str + 2, &end, 10);
+		if (*end != '\0' || max <= 0 || max > 0x7fffffff)
+			return 1;
+		f->max = (int)max;
+	} else if (str[1] != '\0') {
+		return 1;
+	}
+	if ((f->type == 'S' || f->type == 's') && f->max > 0x10000) {
+		f->max = 0x10000;
+	}
+	return 0;
+}
+
+// return the bytes of header and set *size, 0 if the header is not complete, -1 if it's invalid
+static inline int
+frame_read_header(const struct frame_format *f, const uint8_t *buffer, int sz, int *size) {
+	uint32_t n;
+	int len;
+	switch (f->type) {
+	case 'S':
+		if (sz < 2)
+			return 0;
+		n = buffer[0] << 8 | buffer[1];
+		len = 2;
+		break;
+	case 's':
+		if (sz < 2)
+			return 0;
+		n = buffer[1] << 8 | buffer[0];
+		len = 2;
+		break;
+	case 'L':
+		if (sz < 4)
+			return 0;
+		n = (uint32_t)buffer[0] << 24 | buffer[1] << 16 | buffer[2] << 8 | buffer[3];
+		len = 4;
+		break;
+	case 'l':
+		if (sz < 4)
+			return 0;
+		n = (uint32_t)buffer[3] << 24 | buffer[2] << 16 | buffer[1] << 8 | buffer[0];
+		len = 4;
+		break;
+	case 'V': {
+		uint64_t v = 0;
+		for (len = 0; len < sz && len < FRAME_HEADER_MAX; len++) {
+			v |= (uint64_t)(buffer[len] & 0x7f) << (7 * len);
+			if ((buffer[len] & 0x80) == 0)
+				break;
+		}
+		if (len == FRAME_HEADER_MAX)
+			return -1;
+		if (len == sz)
+			return 0;
+		if (v >= (uint64_t)f->max)
+			return -1;
+		n = (uint32_t)v;
+		++len;
+		break;
+	}
+	default:
+		return -1;
+	}
+	if (n >= (uint32_t)f->max)
+		return -1;
+	*size = (int)n;
+	return len;
+}
+
+// return the bytes of header, -1 if the size is too large
+static inline int
+frame_write_header(const struct frame_format *f, uint8_t *buffer, int size) {
+	if (size < 0 || size >= f->max)
+		return -1;
+	uint32_t n = (uint32_t)size;
+	switch (f->type) {
+	case 'S':
+		buffer[0] = (n >> 8) & 0xff;
+		buffer[1] = n & 0xff;
+		return 2;
+	case 's':
+		buffer[0] = n & 0xff;
+		buffer[1] = (n >> 8) & 0xff;
+		return 2;
+	case 'L':
+		buffer[0] = (n >> 24) & 0xff;
+		buffer[1] = (n >> 16) & 0xff;
+		buffer[2] = (n >> 8) & 0xff;
+		buffer[3] = n & 0xff;
+		return 4;
+	case 'l':
+		buffer[0] = n & 0xff;
+		buffer[1] = (n >> 8) & 0xff;
+		buffer[2] = (n >> 16) & 0xff;
+		buffer[3] = (n >> 24) & 0xff;
+		return 4;
+	case 'V': {
+		int len = 0;
+		while (n >= 0x80) {
+			buffer[len++] = (n & 0x7f) | 0x80;
+			n >>= 7;
+		}
+		buffer[len++] = n;
+		return len;
+	}
+	default:
+		return -1;
+	}
+}
+
+#endif
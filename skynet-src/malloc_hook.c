@@ -14,9 +14,27 @@
 
 #define MEMORY_ALLOCTAG 0x20140605
 #define MEMORY_FREETAG 0x0badf00d
+#define MEMORY_SHAREDTAG 0x5ead0b1e
+
+// Each thread counts into its own shard (two cache lines), so the hot path needs no atomic operation.
+// The shards are summed when malloc_used_memory/malloc_memory_block/dump_slab_lua are queried.
+// A memory block may be freed by another thread, so a shard can be negative.
+#define MAX_SHARD 64
+#define CACHE_LINE 64
+// the size classes of message slab, see skynet_message_malloc
+#define SLAB_CLASS 4
+
+struct mem_shard {
+	ssize_t used;
+	ssize_t block;
+	ssize_t slab_hit[SLAB_CLASS];
+	ssize_t slab_miss[SLAB_CLASS];
+	ssize_t slab_free[SLAB_CLASS];
+	char padding[2 * CACHE_LINE - (2 + 3 * SLAB_CLASS) * sizeof(ssize_t)];
+};
 
-static size_t _used_memory = 0;
-static size_t _memory_block = 0;
+// the last shard is shared by the threads out of MAX_SHARD, update it by atomic operation
+static struct mem_shard mem_shards[MAX_SHARD + 1];
 
 struct mem_data {
 	uint32_t handle;
@@ -30,45 +48,285 @@ struct mem_cookie {
 #endif
 };
 
+/*
+	A shared buffer (skynet_shared_malloc) is pushed to many message queues without copy.
+	Its mem_cookie handle is SHARED_HANDLE, and a mem_shared is placed before the cookie,
+	every skynet_free releases one reference and the last one frees the block.
+ */
+#define SHARED_HANDLE 0xfffffff0
+
+struct mem_shared {
+	int ref;
+	uint32_t handle;	// the owner for mem_stats
+	uint32_t tag;
+};
+
 #define SLOT_SIZE 0x10000
+// handles collide in the same slot probe at most MAX_PROBE slots (open addressing)
+#define MAX_PROBE 32
 #define PREFIX_SIZE sizeof(struct mem_cookie)
 
 static struct mem_data mem_stats[SLOT_SIZE];
 
+static struct mem_data *
+find_stat(uint32_t handle) {
+	int i;
+	for (i=0;i<MAX_PROBE;i++) {
+		struct mem_data *data = &mem_stats[(handle + i) & (SLOT_SIZE - 1)];
+		if (data->handle == handle)
+			return data;
+		if (data->handle == 0)
+			break;
+	}
+	return NULL;
+}
+
 
 #ifndef NOUSE_JEMALLOC
 
 #include "jemalloc.h"
+#include <sys/mman.h>
+#include <stdbool.h>
+
+#ifdef JEMALLOC_CONF
+// the options read only at jemalloc init (such as narenas, lg_tcache_max) can't be set by jemalloc in config,
+// because jemalloc is initialized before the config is loaded. Set them at build time,
+// for example : make linux SKYNET_DEFINES='-DJEMALLOC_CONF="\"narenas:4,lg_tcache_max:12\""'
+// or by the environment variable JE_MALLOC_CONF (the prefix is je_) when skynet starts.
+const char * je_malloc_conf = JEMALLOC_CONF;
+#endif
 
 // for skynet_lalloc use
 #define raw_realloc je_realloc
 #define raw_free je_free
 
+static int shard_count = 0;
+static __thread struct mem_shard * thread_shard = NULL;
+
+static struct mem_shard *
+get_shard(void) {
+	struct mem_shard *s = thread_shard;
+	if (s == NULL) {
+		int idx = ATOM_FINC(&shard_count);
+		if (idx >= MAX_SHARD) {
+			idx = MAX_SHARD;
+		}
+		s = thread_shard = &mem_shards[idx];
+	}
+	return s;
+}
+
+inline static void
+shard_add(struct mem_shard *s, ssize_t *counter, ssize_t n) {
+	if (s == &mem_shards[MAX_SHARD]) {
+		ATOM_ADD(counter, n);
+	} else {
+		*counter += n;
+	}
+}
+
+inline static void
+update_shard(ssize_t n, ssize_t block) {
+	struct mem_shard *s = get_shard();
+	shard_add(s, &s->used, n);
+	shard_add(s, &s->block, block);
+}
+
+/*
+	Small message slab : most of the messages between services are small,
+	skynet_message_malloc allocates them from lock-free size classes (32/64/128/256 bytes)
+	without mem_cookie. Each class owns a region of SLAB_REGION bytes in one reserved mmap,
+	so skynet_free (and skynet_realloc) recognise a slab block by its address.
+	The free list head is (tag << 32 | index + 1), the tag avoids ABA problem.
+	The hit/miss/free counters are in the thread shards, and the block in use is counted
+	(the class size) in malloc_used_memory/malloc_memory_block, but not in the memory of
+	service (mem_stats), because a slab block has no owner.
+ */
+#define SLAB_MINSIZE 32
+#define SLAB_MAXSIZE (SLAB_MINSIZE << (SLAB_CLASS - 1))
+#define SLAB_REGION (16 * 1024 * 1024)
+
+struct slab_class {
+	uint64_t head;
+	uint32_t top;	// the slots from top are never used
+	uint32_t cap;
+	size_t size;
+	char * base;
+	char padding[CACHE_LINE - sizeof(uint64_t) - 2 * sizeof(uint32_t) - sizeof(size_t) - sizeof(char *)];
+};
+
+struct slab {
+	int init;
+	char * base;
+	struct slab_class c[SLAB_CLASS];
+};
+
+static struct slab SLAB;
+
+static int
+slab_init(void) {
+	if (!ATOM_CAS(&SLAB.init, 0, 1)) {
+		// other thread is creating the slab, or it failed
+		return SLAB.base == NULL;
+	}
+	char * base = mmap(NULL, (size_t)SLAB_REGION * SLAB_CLASS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) {
+		return 1;
+	}
+	int i;
+	for (i=0;i<SLAB_CLASS;i++) {
+		struct slab_class *c = &SLAB.c[i];
+		c->size = SLAB_MINSIZE << i;
+		c->base = base + (size_t)SLAB_REGION * i;
+		c->cap = SLAB_REGION / c->size;
+	}
+	__sync_synchronize();
+	SLAB.base = base;
+	return 0;
+}
+
+static inline int
+slab_contains(void *ptr) {
+	char * p = (char *)ptr;
+	return SLAB.base && p >= SLAB.base && p < SLAB.base + (size_t)SLAB_REGION * SLAB_CLASS;
+}
+
+static inline struct slab_class *
+slab_sizeclass(size_t sz) {
+	int i = 0;
+	size_t csz = SLAB_MINSIZE;
+	while (csz < sz) {
+		csz <<= 1;
+		++i;
+	}
+	return &SLAB.c[i];
+}
+
+static void *
+slab_pop(struct slab_class *c) {
+	for (;;) {
+		uint64_t head = c->head;
+		uint32_t idx = (uint32_t)head;
+		if (idx == 0)
+			break;
+		char * slot = c->base + (size_t)(idx - 1) * c->size;
+		// the slot may be popped by other thread, the CAS will fail then
+		uint32_t next = *(volatile uint32_t *)slot;
+		uint64_t nhead = (((head >> 32) + 1) << 32) | next;
+		if (ATOM_CAS(&c->head, head, nhead)) {
+			return slot;
+		}
+	}
+	if (c->top < c->cap) {
+		uint32_t idx = ATOM_FINC(&c->top);
+		if (idx < c->cap) {
+			return c->base + (size_t)idx * c->size;
+		}
+	}
+	return NULL;
+}
+
+static void
+slab_push(void *ptr) {
+	char * slot = (char *)ptr;
+	struct slab_class *c = &SLAB.c[(slot - SLAB.base) / SLAB_REGION];
+	uint32_t idx = (uint32_t)((slot - c->base) / c->size) + 1;
+	for (;;) {
+		uint64_t head = c->head;
+		*(volatile uint32_t *)slot = (uint32_t)head;
+		uint64_t nhead = (((head >> 32) + 1) << 32) | idx;
+		if (ATOM_CAS(&c->head, head, nhead)) {
+			break;
+		}
+	}
+	struct mem_shard *s = get_shard();
+	shard_add(s, &s->slab_free[c - SLAB.c], 1);
+	shard_add(s, &s->used, -(ssize_t)c->size);
+	shard_add(s, &s->block, -1);
+}
+
+void *
+skynet_message_malloc(size_t size) {
+	if (size <= SLAB_MAXSIZE && (SLAB.base || slab_init() == 0)) {
+		struct slab_class *c = slab_sizeclass(size);
+		void * ptr = slab_pop(c);
+		struct mem_shard *s = get_shard();
+		if (ptr) {
+			shard_add(s, &s->slab_hit[c - SLAB.c], 1);
+			shard_add(s, &s->used, (ssize_t)c->size);
+			shard_add(s, &s->block, 1);
+			return ptr;
+		}
+		shard_add(s, &s->slab_miss[c - SLAB.c], 1);
+	}
+	return skynet_malloc(size);
+}
+
+int
+dump_slab_lua(lua_State *L) {
+	int i;
+	lua_newtable(L);
+	if (SLAB.base == NULL)
+		return 1;
+	for (i=0;i<SLAB_CLASS;i++) {
+		struct slab_class *c = &SLAB.c[i];
+		ssize_t hit = 0, miss = 0, release = 0;
+		int j;
+		for (j=0;j<=MAX_SHARD;j++) {
+			hit += mem_shards[j].slab_hit[i];
+			miss += mem_shards[j].slab_miss[i];
+			release += mem_shards[j].slab_free[i];
+		}
+		lua_createtable(L, 0, 6);
+		lua_pushinteger(L, c->size);
+		lua_setfield(L, -2, "size");
+		lua_pushinteger(L, hit);
+		lua_setfield(L, -2, "hit");
+		lua_pushinteger(L, miss);
+		lua_setfield(L, -2, "miss");
+		lua_pushinteger(L, hit - release);
+		lua_setfield(L, -2, "inuse");
+		lua_pushinteger(L, c->top < c->cap ? c->top : c->cap);
+		lua_setfield(L, -2, "touched");
+		lua_pushinteger(L, c->cap);
+		lua_setfield(L, -2, "cap");
+		lua_rawseti(L, -2, i+1);
+	}
+	return 1;
+}
+
 static ssize_t*
 get_allocated_field(uint32_t handle) {
-	int h = (int)(handle & (SLOT_SIZE - 1));
-	struct mem_data *data = &mem_stats[h];
-	uint32_t old_handle = data->handle;
-	ssize_t old_alloc = data->allocated;
-	if(old_handle == 0 || old_alloc <= 0) {
-		// data->allocated may less than zero, because it may not count at start.
-		if(!ATOM_CAS(&data->handle, old_handle, handle)) {
-			return 0;
+	struct mem_data *data = find_stat(handle);
+	if (data) {
+		return &data->allocated;
+	}
+	// claim a new slot : an empty one, or one of a service which released all its memory
+	int i;
+	for (i=0;i<MAX_PROBE;i++) {
+		data = &mem_stats[(handle + i) & (SLOT_SIZE - 1)];
+		uint32_t old_handle = data->handle;
+		ssize_t old_alloc = data->allocated;
+		if (old_handle == handle) {
+			return &data->allocated;
 		}
-		if (old_alloc < 0) {
-			ATOM_CAS(&data->allocated, old_alloc, 0);
+		if(old_handle == 0 || old_alloc <= 0) {
+			// data->allocated may less than zero, because it may not count at start.
+			if(!ATOM_CAS(&data->handle, old_handle, handle)) {
+				continue;
+			}
+			if (old_alloc < 0) {
+				ATOM_CAS(&data->allocated, old_alloc, 0);
+			}
+			return &data->allocated;
 		}
 	}
-	if(data->handle != handle) {
-		return 0;
-	}
-	return &data->allocated;
+	return 0;
 }
 
 inline static void 
 update_xmalloc_stat_alloc(uint32_t handle, size_t __n) {
-	ATOM_ADD(&_used_memory, __n);
-	ATOM_INC(&_memory_block); 
+	update_shard((ssize_t)__n, 1);
 	ssize_t* allocated = get_allocated_field(handle);
 	if(allocated) {
 		ATOM_ADD(allocated, __n);
@@ -77,8 +335,7 @@ update_xmalloc_stat_alloc(uint32_t handle, size_t __n) {
 
 inline static void
 update_xmalloc_stat_free(uint32_t handle, size_t __n) {
-	ATOM_SUB(&_used_memory, __n);
-	ATOM_DEC(&_memory_block);
+	update_shard(-(ssize_t)__n, -1);
 	ssize_t* allocated = get_allocated_field(handle);
 	if(allocated) {
 		ATOM_SUB(allocated, __n);
@@ -99,12 +356,31 @@ fill_prefix(char* ptr) {
 	return ptr;
 }
 
+static inline struct mem_shared *
+get_shared(char *ptr, size_t size) {
+	struct mem_cookie *p = (struct mem_cookie *)(ptr + size - sizeof(struct mem_cookie));
+	uint32_t handle;
+	memcpy(&handle, &p->handle, sizeof(handle));
+	if (handle != SHARED_HANDLE)
+		return NULL;
+	struct mem_shared *s = (struct mem_shared *)((char *)p - sizeof(struct mem_shared));
+	if (s->tag != MEMORY_SHAREDTAG)
+		return NULL;
+	return s;
+}
+
 inline static void*
-clean_prefix(char* ptr) {
-	size_t size = je_malloc_usable_size(ptr);
+clean_prefix(char* ptr, size_t size) {
 	struct mem_cookie *p = (struct mem_cookie *)(ptr + size - sizeof(struct mem_cookie));
 	uint32_t handle;
 	memcpy(&handle, &p->handle, sizeof(handle));
+	if (handle == SHARED_HANDLE) {
+		struct mem_shared *s = get_shared(ptr, size);
+		if (s) {
+			handle = s->handle;
+			s->tag = 0;
+		}
+	}
 #ifdef MEMORY_CHECK
 	uint32_t dogtag;
 	memcpy(&dogtag, &p->dogtag, sizeof(dogtag));
@@ -162,6 +438,144 @@ mallctl_opt(const char* name, int* newval) {
 	return v;
 }
 
+static unsigned
+get_narenas(void) {
+	unsigned n = 0;
+	size_t len = sizeof(n);
+	je_mallctl("arenas.narenas", &n, &len, NULL, 0);
+	return n;
+}
+
+static int
+set_decay(const char *name, ssize_t ms) {
+	char key[64];
+	// the default of new arenas
+	snprintf(key, sizeof(key), "arenas.%s", name);
+	int err = je_mallctl(key, NULL, NULL, &ms, sizeof(ms));
+	unsigned i;
+	unsigned n = get_narenas();
+	for (i=0;i<n;i++) {
+		// it fails if the arena is not initialized, ignore it
+		snprintf(key, sizeof(key), "arena.%u.%s", i, name);
+		je_mallctl(key, NULL, NULL, &ms, sizeof(ms));
+	}
+	return err;
+}
+
+static int
+config_option(const char *k, const char *v) {
+	if (strcmp(k, "dirty_decay_ms") == 0 || strcmp(k, "muzzy_decay_ms") == 0) {
+		return set_decay(k, (ssize_t)strtol(v, NULL, 10));
+	}
+	if (strcmp(k, "background_thread") == 0) {
+		bool enable = strcmp(v, "true") == 0;
+		return je_mallctl("background_thread", NULL, NULL, &enable, sizeof(enable));
+	}
+	if (strcmp(k, "narenas") == 0 || strcmp(k, "lg_tcache_max") == 0) {
+		// read only at jemalloc init, see JEMALLOC_CONF
+		skynet_error(NULL, "jemalloc option %s is rejected, set it by JE_MALLOC_CONF (environment) or JEMALLOC_CONF (build) instead", k);
+		return 0;
+	}
+	return -1;
+}
+
+// conf is the same format as MALLOC_CONF : "dirty_decay_ms:10000,muzzy_decay_ms:0,background_thread:true"
+void
+malloc_configure(const char *conf) {
+	size_t sz = strlen(conf);
+	char tmp[sz+1];
+	memcpy(tmp, conf, sz+1);
+	char *p = tmp;
+	char *item;
+	while ((item = strsep(&p, ",")) != NULL) {
+		char *v = strchr(item, ':');
+		if (v == NULL) {
+			skynet_error(NULL, "Invalid jemalloc option %s", item);
+			continue;
+		}
+		*v++ = '\0';
+		int err = config_option(item, v);
+		if (err) {
+			skynet_error(NULL, "Set jemalloc option %s:%s failed : error -> %d", item, v, err);
+		}
+	}
+}
+
+// return dirty and muzzy pages of all the arenas to the system
+void
+malloc_purge(void) {
+	char key[64];
+#ifdef MALLCTL_ARENAS_ALL
+	snprintf(key, sizeof(key), "arena.%u.purge", (unsigned)MALLCTL_ARENAS_ALL);
+#else
+	snprintf(key, sizeof(key), "arena.%u.purge", get_narenas());
+#endif
+	je_mallctl(key, NULL, NULL, NULL, 0);
+}
+
+static void
+stat_field(lua_State *L, const char *name, const char *key) {
+	size_t v = 0;
+	size_t len = sizeof(v);
+	if (je_mallctl(name, &v, &len, NULL, 0) == 0) {
+		lua_pushinteger(L, (lua_Integer)v);
+		lua_setfield(L, -2, key);
+	}
+}
+
+static void
+arena_field(lua_State *L, unsigned i, const char *name, const char *key, size_t page) {
+	char tmp[64];
+	snprintf(tmp, sizeof(tmp), "stats.arenas.%u.%s", i, name);
+	size_t v = 0;
+	size_t len = sizeof(v);
+	if (je_mallctl(tmp, &v, &len, NULL, 0) == 0) {
+		lua_pushinteger(L, (lua_Integer)(v * page));
+		lua_setfield(L, -2, key);
+	}
+}
+
+int
+dump_jemalloc_lua(lua_State *L) {
+	// refresh the stats
+	uint64_t epoch = 1;
+	size_t len = sizeof(epoch);
+	je_mallctl("epoch", &epoch, &len, &epoch, len);
+
+	lua_newtable(L);
+	stat_field(L, "stats.allocated", "allocated");
+	stat_field(L, "stats.active", "active");
+	stat_field(L, "stats.resident", "resident");
+	stat_field(L, "stats.mapped", "mapped");
+	stat_field(L, "stats.retained", "retained");
+	stat_field(L, "stats.metadata", "metadata");
+
+	size_t page = 0;
+	len = sizeof(page);
+	je_mallctl("arenas.page", &page, &len, NULL, 0);
+	unsigned i;
+	unsigned n = get_narenas();
+	lua_createtable(L, n, 0);
+	for (i=0;i<n;i++) {
+		char tmp[64];
+		bool init = false;
+		len = sizeof(init);
+		snprintf(tmp, sizeof(tmp), "arena.%u.initialized", i);
+		if (je_mallctl(tmp, &init, &len, NULL, 0) || !init)
+			continue;
+		lua_newtable(L);
+		arena_field(L, i, "resident", "resident", 1);
+		arena_field(L, i, "pactive", "active", page);
+		arena_field(L, i, "pdirty", "dirty", page);
+		arena_field(L, i, "pmuzzy", "muzzy", page);
+		arena_field(L, i, "retained", "retained", 1);
+		arena_field(L, i, "mapped", "mapped", 1);
+		lua_rawseti(L, -2, i);
+	}
+	lua_setfield(L, -2, "arenas");
+	return 1;
+}
+
 // hook : malloc, realloc, free, calloc
 
 void *
@@ -174,8 +588,25 @@ skynet_malloc(size_t size) {
 void *
 skynet_realloc(void *ptr, size_t size) {
 	if (ptr == NULL) return skynet_malloc(size);
+	if (slab_contains(ptr)) {
+		struct slab_class *c = &SLAB.c[((char *)ptr - SLAB.base) / SLAB_REGION];
+		void * newptr = skynet_malloc(size);
+		memcpy(newptr, ptr, size < c->size ? size : c->size);
+		slab_push(ptr);
+		return newptr;
+	}
 
-	void* rawptr = clean_prefix(ptr);
+	size_t usable = je_malloc_usable_size(ptr);
+	struct mem_shared *s = get_shared(ptr, usable);
+	if (s) {
+		// never resize a shared buffer in place, the other owners are reading it
+		size_t osize = usable - PREFIX_SIZE - sizeof(*s);
+		void * newptr = skynet_malloc(size);
+		memcpy(newptr, ptr, size < osize ? size : osize);
+		skynet_free(ptr);
+		return newptr;
+	}
+	void* rawptr = clean_prefix(ptr, usable);
 	void *newptr = je_realloc(rawptr, size+PREFIX_SIZE);
 	if(!newptr) malloc_oom(size);
 	return fill_prefix(newptr);
@@ -184,10 +615,40 @@ skynet_realloc(void *ptr, size_t size) {
 void
 skynet_free(void *ptr) {
 	if (ptr == NULL) return;
-	void* rawptr = clean_prefix(ptr);
+	if (slab_contains(ptr)) {
+		slab_push(ptr);
+		return;
+	}
+	size_t usable = je_malloc_usable_size(ptr);
+	struct mem_shared *s = get_shared(ptr, usable);
+	if (s && ATOM_DEC(&s->ref) > 0) {
+		return;
+	}
+	void* rawptr = clean_prefix(ptr, usable);
 	je_free(rawptr);
 }
 
+void *
+skynet_shared_malloc(size_t size, int ref) {
+	void* ptr = je_malloc(size + sizeof(struct mem_shared) + PREFIX_SIZE);
+	if(!ptr) malloc_oom(size);
+	uint32_t handle = skynet_current_handle();
+	size_t usable = je_malloc_usable_size(ptr);
+	struct mem_cookie *p = (struct mem_cookie *)((char *)ptr + usable - sizeof(struct mem_cookie));
+	struct mem_shared *s = (struct mem_shared *)((char *)p - sizeof(struct mem_shared));
+	s->ref = ref;
+	s->handle = handle;
+	s->tag = MEMORY_SHAREDTAG;
+	uint32_t tag = SHARED_HANDLE;
+	memcpy(&p->handle, &tag, sizeof(tag));
+#ifdef MEMORY_CHECK
+	uint32_t dogtag = MEMORY_ALLOCTAG;
+	memcpy(&p->dogtag, &dogtag, sizeof(dogtag));
+#endif
+	update_xmalloc_stat_alloc(handle, usable);
+	return ptr;
+}
+
 void *
 skynet_calloc(size_t nmemb,size_t size) {
 	void* ptr = je_calloc(nmemb + ((PREFIX_SIZE+size-1)/size), size );
@@ -213,6 +674,38 @@ memory_info_dump(void) {
 	skynet_error(NULL, "No jemalloc");
 }
 
+void *
+skynet_message_malloc(size_t size) {
+	return skynet_malloc(size);
+}
+
+int
+dump_slab_lua(lua_State *L) {
+	lua_newtable(L);
+	return 1;
+}
+
+void *
+skynet_shared_malloc(size_t size, int ref) {
+	// can't find the reference count in skynet_free without mem_cookie
+	return NULL;
+}
+
+void
+malloc_configure(const char *conf) {
+	skynet_error(NULL, "No jemalloc : ignore jemalloc options %s", conf);
+}
+
+void
+malloc_purge(void) {
+}
+
+int
+dump_jemalloc_lua(lua_State *L) {
+	lua_newtable(L);
+	return 1;
+}
+
 size_t 
 mallctl_int64(const char* name, size_t* newval) {
 	skynet_error(NULL, "No jemalloc : mallctl_int64 %s.", name);
@@ -229,12 +722,22 @@ mallctl_opt(const char* name, int* newval) {
 
 size_t
 malloc_used_memory(void) {
-	return _used_memory;
+	ssize_t total = 0;
+	int i;
+	for (i=0;i<=MAX_SHARD;i++) {
+		total += mem_shards[i].used;
+	}
+	return (size_t)total;
 }
 
 size_t
 malloc_memory_block(void) {
-	return _memory_block;
+	ssize_t total = 0;
+	int i;
+	for (i=0;i<=MAX_SHARD;i++) {
+		total += mem_shards[i].block;
+	}
+	return (size_t)total;
 }
 
 void
@@ -287,12 +790,9 @@ dump_mem_lua(lua_State *L) {
 size_t
 malloc_current_memory(void) {
 	uint32_t handle = skynet_current_handle();
-	int i;
-	for(i=0; i<SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
-		if(data->handle == (uint32_t)handle && data->allocated != 0) {
-			return (size_t) data->allocated;
-		}
+	struct mem_data* data = find_stat(handle);
+	if (data && data->allocated > 0) {
+		return (size_t) data->allocated;
 	}
 	return 0;
 }
@@ -12,6 +12,10 @@ extern int    mallctl_opt(const char* name, int* newval);
 extern void   dump_c_mem(void);
 extern int    dump_mem_lua(lua_State *L);
 extern size_t malloc_current_memory(void);
+extern int    dump_slab_lua(lua_State *L);
+extern void   malloc_configure(const char *conf);
+extern void   malloc_purge(void);
+extern int    dump_jemalloc_lua(lua_State *L);
 
 #endif /* SKYNET_MALLOC_HOOK_H */
 
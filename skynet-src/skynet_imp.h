@@ -10,6 +10,8 @@ struct skynet_config {
 	const char * bootstrap;		/* snlua bootstrap */
 	const char * logger;
 	const char * logservice;	/* "logservice", "logger" */
+	const char * jemalloc;		/* jemalloc 运行时选项，如 "dirty_decay_ms:10000,background_thread:true" */
+	int jemalloc_purge;			/* 每隔多少秒把 jemalloc 的脏页归还系统，0 为不主动归还 */
 };
 
 #define THREAD_WORKER 0
@@ -157,6 +157,8 @@ main(int argc, char *argv[]) {
 	config.logger = optstring("logger", NULL);
 	config.logservice = optstring("logservice", "logger");
 	config.profile = optboolean("profile", 1);
+	config.jemalloc = optstring("jemalloc", NULL);
+	config.jemalloc_purge = optint("jemalloc_purge", 0);
 
 	lua_close(L);
 
@@ -16,5 +16,7 @@ void skynet_free(void *ptr);
 char * skynet_strdup(const char *str);
 void * skynet_lalloc(void *ptr, size_t osize, size_t nsize);	// use for lua
 void * skynet_memalign(size_t alignment, size_t size);
+void * skynet_message_malloc(size_t sz);	// use for small message, free it by skynet_free
+void * skynet_shared_malloc(size_t sz, int ref);	// immutable buffer with ref references, each skynet_free releases one. NULL if not supported
 
 #endif
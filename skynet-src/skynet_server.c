@@ -688,7 +688,7 @@ _filter_args(struct skynet_context * context, int type, int *session, void ** da
 	}
 
 	if (needcopy && *data) {
-		char * msg = skynet_malloc(*sz+1);
+		char * msg = skynet_message_malloc(*sz+1);
 		memcpy(msg, *data, *sz);
 		msg[*sz] = '\0';
 		*data = msg;
@@ -770,6 +770,55 @@ skynet_sendname(struct skynet_context * context, uint32_t source, const char * a
 	return skynet_send(context, source, des, type, session, data, sz);
 }
 
+/*
+	Send one message to n destinations (session 0). The receivers share one immutable buffer
+	(see skynet_shared_malloc), it's freed when the last receiver drops it.
+	Return the number of destinations the message is pushed to.
+ */
+int
+skynet_broadcast(struct skynet_context * context, uint32_t source, const uint32_t * destination, int n, int type, void * data, size_t sz) {
+	int dontcopy = type & PTYPE_TAG_DONTCOPY;
+	type &= 0xff;
+	if ((sz & MESSAGE_TYPE_MASK) != sz) {
+		skynet_error(context, "The broadcast message is too large");
+		if (dontcopy) {
+			skynet_free(data);
+		}
+		return 0;
+	}
+	char * shared = NULL;
+	if (data && n > 0) {
+		shared = skynet_shared_malloc(sz+1, n);
+	}
+	int i;
+	int count = 0;
+	if (shared == NULL) {
+		// the buffer can't be shared, copy it for each destination
+		for (i=0;i<n;i++) {
+			if (destination[i] && skynet_send(context, source, destination[i], type, 0, data, sz) >= 0) {
+				++count;
+			}
+		}
+		if (dontcopy) {
+			skynet_free(data);
+		}
+		return count;
+	}
+	memcpy(shared, data, sz);
+	shared[sz] = '\0';
+	if (dontcopy) {
+		skynet_free(data);
+	}
+	for (i=0;i<n;i++) {
+		if (destination[i] == 0) {
+			skynet_free(shared);	// release the reference
+		} else if (skynet_send(context, source, destination[i], type | PTYPE_TAG_DONTCOPY, 0, shared, sz) >= 0) {
+			++count;
+		}
+	}
+	return count;
+}
+
 uint32_t 
 skynet_context_handle(struct skynet_context *ctx) {
 	return ctx->handle;
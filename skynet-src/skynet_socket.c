@@ -29,6 +29,11 @@ skynet_socket_free() {
 	SOCKET_SERVER = NULL;
 }
 
+const char *
+skynet_socket_backend() {
+	return socket_server_backend();
+}
+
 // mainloop thread
 //将socket收到的数据转发给对应的ctx队列
 static void
@@ -46,7 +51,7 @@ forward_message(int type, bool padding, struct socket_message * result) {
 			result->data = "";
 		}
 	}
-	sm = (struct skynet_socket_message *)skynet_malloc(sz);
+	sm = (struct skynet_socket_message *)skynet_message_malloc(sz);
 	sm->type = type;
 	sm->id = result->id;
 	sm->ud = result->ud;
@@ -71,6 +76,25 @@ forward_message(int type, bool padding, struct socket_message * result) {
 	}
 }
 
+// deliver the packages split in socket thread to the agent as client messages (the same as service gate)
+static void
+forward_frames(struct socket_message * result) {
+	struct socket_frame_list * list = (struct socket_frame_list *)result->data;
+	uint32_t agent = (uint32_t)result->opaque;
+	int i;
+	for (i=0;i<list->n;i++) {
+		struct skynet_message message;
+		message.source = (uint32_t)list->ud;
+		message.session = 1;
+		message.data = list->frame[i].buffer;
+		message.sz = (size_t)list->frame[i].size | ((size_t)PTYPE_CLIENT << MESSAGE_TYPE_SHIFT);
+		if (skynet_context_push(agent, &message)) {
+			skynet_free(message.data);
+		}
+	}
+	skynet_free(list);
+}
+
 int 
 skynet_socket_poll() {
 	struct socket_server *ss = SOCKET_SERVER;
@@ -102,6 +126,18 @@ skynet_socket_poll() {
 	case SOCKET_WARNING:
 		forward_message(SKYNET_SOCKET_TYPE_WARNING, false, &result);
 		break;
+	case SOCKET_PAUSE:
+		forward_message(SKYNET_SOCKET_TYPE_PAUSE, false, &result);
+		break;
+	case SOCKET_RESUME:
+		forward_message(SKYNET_SOCKET_TYPE_RESUME, false, &result);
+		break;
+	case SOCKET_UDP_BATCH:
+		forward_message(SKYNET_SOCKET_TYPE_UDP_BATCH, false, &result);
+		break;
+	case SOCKET_FRAME:
+		forward_frames(&result);
+		break;
 	default:
 		skynet_error(NULL, "Unknown socket message type %d.",type);
 		return -1;
@@ -122,12 +158,23 @@ skynet_socket_send_lowpriority(struct skynet_context *ctx, int id, void *buffer,
 	return socket_server_send_lowpriority(SOCKET_SERVER, id, buffer, sz);
 }
 
+int
+skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int sz) {
+	return socket_server_sendfile(SOCKET_SERVER, id, fd, offset, sz);
+}
+
 int 
 skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog) {
 	uint32_t source = skynet_context_handle(ctx);
 	return socket_server_listen(SOCKET_SERVER, source, host, port, backlog);
 }
 
+int
+skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog) {
+	uint32_t source = skynet_context_handle(ctx);
+	return socket_server_listen_reuseport(SOCKET_SERVER, source, host, port, backlog);
+}
+
 int 
 skynet_socket_connect(struct skynet_context *ctx, const char *host, int port) {
 	uint32_t source = skynet_context_handle(ctx);
@@ -158,17 +205,45 @@ skynet_socket_start(struct skynet_context *ctx, int id) {
 	socket_server_start(SOCKET_SERVER, source, id);
 }
 
+void
+skynet_socket_start_frame(struct skynet_context *ctx, int id, const struct frame_format *format, uint32_t agent, uint32_t client) {
+	uint32_t source = skynet_context_handle(ctx);
+	// the packages go to agent from client, keep 0 if it's not set
+	socket_server_start_frame(SOCKET_SERVER, source, id, format, agent, client);
+}
+
 void
 skynet_socket_nodelay(struct skynet_context *ctx, int id) {
 	socket_server_nodelay(SOCKET_SERVER, id);
 }
 
+void
+skynet_socket_zerocopy(struct skynet_context *ctx, int id, int enable) {
+	socket_server_zerocopy(SOCKET_SERVER, id, enable);
+}
+
+void
+skynet_socket_watermark(struct skynet_context *ctx, int id, int64_t high, int64_t low, int64_t limit, int close) {
+	socket_server_watermark(SOCKET_SERVER, id, high, low, limit, close);
+}
+
+int
+skynet_socket_paused(struct skynet_context *ctx, int id) {
+	return socket_server_paused(SOCKET_SERVER, id);
+}
+
 int 
 skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port) {
 	uint32_t source = skynet_context_handle(ctx);
 	return socket_server_udp(SOCKET_SERVER, source, addr, port);
 }
 
+int
+skynet_socket_udp_batch(struct skynet_context *ctx, const char * addr, int port) {
+	uint32_t source = skynet_context_handle(ctx);
+	return socket_server_udp_batch(SOCKET_SERVER, source, addr, port);
+}
+
 int 
 skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port) {
 	return socket_server_udp_connect(SOCKET_SERVER, id, addr, port);
@@ -191,3 +266,11 @@ skynet_socket_udp_address(struct skynet_socket_message *msg, int *addrsz) {
 	sm.data = msg->buffer;
 	return (const char *)socket_server_udp_address(SOCKET_SERVER, &sm, addrsz);
 }
+
+const char *
+skynet_socket_udp_next(const char *buffer, int sz, int *offset, int *size, const char **address, int *addrsz) {
+	const struct socket_udp_address * addr = NULL;
+	const char * package = socket_server_udp_next(buffer, sz, offset, size, &addr, addrsz);
+	*address = (const char *)addr;
+	return package;
+}
@@ -1,6 +1,8 @@
 #ifndef skynet_socket_h
 #define skynet_socket_h
 
+#include <stdint.h>
+
 struct skynet_context;
 
 #define SKYNET_SOCKET_TYPE_DATA 1
@@ -10,6 +12,9 @@ struct skynet_context;
 #define SKYNET_SOCKET_TYPE_ERROR 5
 #define SKYNET_SOCKET_TYPE_UDP 6
 #define SKYNET_SOCKET_TYPE_WARNING 7
+#define SKYNET_SOCKET_TYPE_PAUSE 8
+#define SKYNET_SOCKET_TYPE_RESUME 9
+#define SKYNET_SOCKET_TYPE_UDP_BATCH 10
 
 struct skynet_socket_message {
 	int type;
@@ -21,21 +26,36 @@ struct skynet_socket_message {
 void skynet_socket_init();
 void skynet_socket_exit();
 void skynet_socket_free();
+const char * skynet_socket_backend();
 int skynet_socket_poll();
 
 int skynet_socket_send(struct skynet_context *ctx, int id, void *buffer, int sz);
 int skynet_socket_send_lowpriority(struct skynet_context *ctx, int id, void *buffer, int sz);
+int skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int sz);
 int skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog);
+int skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog);
 int skynet_socket_connect(struct skynet_context *ctx, const char *host, int port);
 int skynet_socket_bind(struct skynet_context *ctx, int fd);
 void skynet_socket_close(struct skynet_context *ctx, int id);
 void skynet_socket_shutdown(struct skynet_context *ctx, int id);
 void skynet_socket_start(struct skynet_context *ctx, int id);
+// the socket thread splits the data by the length header (see frame_header.h),
+// and sends each package to agent as PTYPE_CLIENT message from client (0 if client is 0).
+// The other socket messages still go to ctx.
+struct frame_format;
+void skynet_socket_start_frame(struct skynet_context *ctx, int id, const struct frame_format *format, uint32_t agent, uint32_t client);
 void skynet_socket_nodelay(struct skynet_context *ctx, int id);
+void skynet_socket_zerocopy(struct skynet_context *ctx, int id, int enable);
+void skynet_socket_watermark(struct skynet_context *ctx, int id, int64_t high, int64_t low, int64_t limit, int close);
+int skynet_socket_paused(struct skynet_context *ctx, int id);
 
 int skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port);
+// several packages may be delivered in one SKYNET_SOCKET_TYPE_UDP_BATCH message, see skynet_socket_udp_next
+int skynet_socket_udp_batch(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port);
 int skynet_socket_udp_send(struct skynet_context *ctx, int id, const char * address, const void *buffer, int sz);
 const char * skynet_socket_udp_address(struct skynet_socket_message *, int *addrsz);
+// iterate the packages in the buffer of SKYNET_SOCKET_TYPE_UDP_BATCH message (sz is ud), offset begin with 0
+const char * skynet_socket_udp_next(const char *buffer, int sz, int *offset, int *size, const char **address, int *addrsz);
 
 #endif
@@ -9,6 +9,7 @@
 #include "skynet_socket.h"
 #include "skynet_daemon.h"
 #include "skynet_harbor.h"
+#include "malloc_hook.h"
 
 #include <pthread.h>
 #include <unistd.h>
@@ -25,6 +26,7 @@ struct monitor {
 	pthread_mutex_t mutex;
 	int sleep;
 	int quit;
+	int purge;		/* jemalloc purge interval in seconds, 0 for never */
 };
 
 struct worker_parm {
@@ -96,6 +98,7 @@ thread_monitor(void *p) {
 	struct monitor * m = p;
 	int i;
 	int n = m->count;
+	int elapsed = 0;
 	skynet_initthread(THREAD_MONITOR);
 	for (;;) {
 		CHECK_ABORT
@@ -106,6 +109,13 @@ thread_monitor(void *p) {
 			CHECK_ABORT
 			sleep(1);
 		}
+		if (m->purge > 0) {
+			elapsed += 5;
+			if (elapsed >= m->purge) {
+				elapsed = 0;
+				malloc_purge();
+			}
+		}
 	}
 
 	return NULL;
@@ -180,13 +190,14 @@ thread_worker(void *p) {
 }
 
 static void
-start(int thread) {
+start(int thread, int purge) {
 	pthread_t pid[thread+3];
 
 	struct monitor *m = skynet_malloc(sizeof(*m));
 	memset(m, 0, sizeof(*m));
 	m->count = thread;
 	m->sleep = 0;
+	m->purge = purge;
 
 	m->m = skynet_malloc(thread * sizeof(struct skynet_monitor *));
 	int i;
@@ -272,9 +283,13 @@ skynet_start(struct skynet_config * config) {
 		exit(1);
 	}
 
+	if (config->jemalloc) {
+		malloc_configure(config->jemalloc);
+	}
+
 	bootstrap(ctx, config->bootstrap);
 
-	start(config->thread);
+	start(config->thread, config->jemalloc_purge);
 
 	// harbor_exit may call socket send, so it should exit before socket_free
 	skynet_harbor_exit();
@@ -10,6 +10,8 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 
+#define SP_BACKEND "epoll"
+
 static bool 
 sp_invalid(int efd) {
 	return efd == -1;
@@ -49,6 +51,14 @@ sp_write(int efd, int sock, void *ud, bool enable) {
 	epoll_ctl(efd, EPOLL_CTL_MOD, sock, &ev);
 }
 
+static void 
+sp_enable(int efd, int sock, void *ud, bool read_enable, bool write_enable) {
+	struct epoll_event ev;
+	ev.events = (read_enable ? EPOLLIN : 0) | (write_enable ? EPOLLOUT : 0);
+	ev.data.ptr = ud;
+	epoll_ctl(efd, EPOLL_CTL_MOD, sock, &ev);
+}
+
 static int 
 sp_wait(int efd, struct event *e, int max) {
 	struct epoll_event ev[max];
@@ -10,6 +10,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#define SP_BACKEND "kqueue"
+
 static bool 
 sp_invalid(int kfd) {
 	return kfd == -1;
@@ -64,6 +66,16 @@ sp_write(int kfd, int sock, void *ud, bool enable) {
 	}
 }
 
+static void
+sp_enable(int kfd, int sock, void *ud, bool read_enable, bool write_enable) {
+	struct kevent ke;
+	EV_SET(&ke, sock, EVFILT_READ, read_enable ? EV_ENABLE : EV_DISABLE, 0, 0, ud);
+	if (kevent(kfd, &ke, 1, NULL, 0, NULL) == -1 || ke.flags & EV_ERROR) {
+		// todo: check error
+	}
+	sp_write(kfd, sock, ud, write_enable);
+}
+
 static int 
 sp_wait(int kfd, struct event *e, int max) {
 	struct kevent ev[max];
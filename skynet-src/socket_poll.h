@@ -2,6 +2,7 @@
 #define socket_poll_h
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef int poll_fd;
 
@@ -10,6 +11,12 @@ struct event {
 	bool read;
 	bool write;
 	bool error;
+#ifdef USE_IO_URING
+	// the completed operation (see socket_uring.h), SP_OP_POLL for a readiness event
+	uint8_t op;
+	int res;
+	const char * data;
+#endif
 };
 
 static bool sp_invalid(poll_fd fd);
@@ -18,12 +25,18 @@ static void sp_release(poll_fd fd);
 static int sp_add(poll_fd fd, int sock, void *ud);
 static void sp_del(poll_fd fd, int sock);
 static void sp_write(poll_fd, int sock, void *ud, bool enable);
+// turn on/off both read and write events (errors are always reported)
+static void sp_enable(poll_fd, int sock, void *ud, bool read_enable, bool write_enable);
 static int sp_wait(poll_fd, struct event *e, int max);
 static void sp_nonblocking(int sock);
 
 #ifdef __linux__
+#ifdef USE_IO_URING
+#include "socket_uring.h"
+#else
 #include "socket_epoll.h"
 #endif
+#endif
 
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
 #include "socket_kqueue.h"
@@ -1,6 +1,12 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for recvmmsg/sendmmsg
+#define _GNU_SOURCE
+#endif
+
 #include "skynet.h"
 
 #include "socket_server.h"
+#include "frame_header.h"
 #include "socket_poll.h"
 #include "atomic.h"
 #include "spinlock.h"
@@ -17,11 +23,20 @@
 #include <assert.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define HAS_ZEROCOPY
+#endif
+#endif
+
 #define MAX_INFO 128
 // MAX_SOCKET will be 2^MAX_SOCKET_P
 #define MAX_SOCKET_P 16
 #define MAX_EVENT 64
 #define MIN_READ_BUFFER 64
+#define FRAME_BUFFER_MIN 256
 #define SOCKET_TYPE_INVALID 0
 #define SOCKET_TYPE_RESERVE 1
 #define SOCKET_TYPE_PLISTEN 2
@@ -31,6 +46,7 @@
 #define SOCKET_TYPE_HALFCLOSE 6
 #define SOCKET_TYPE_PACCEPT 7
 #define SOCKET_TYPE_BIND 8
+#define SOCKET_TYPE_ZCLOSING 9	// closed, but the fd is kept until the MSG_ZEROCOPY sends are notified
 
 #define MAX_SOCKET (1<<MAX_SOCKET_P)
 
@@ -49,6 +65,13 @@
 
 #define MAX_UDP_PACKAGE 65535
 
+// read/write at most UDP_BATCH udp packages by one recvmmsg/sendmmsg
+#ifdef __linux__
+#define UDP_BATCH 16
+#else
+#define UDP_BATCH 1
+#endif
+
 // EAGAIN and EWOULDBLOCK may be not the same value.
 #if (EAGAIN != EWOULDBLOCK)
 #define AGAIN_WOULDBLOCK EAGAIN : case EWOULDBLOCK
@@ -57,6 +80,20 @@
 #endif
 
 #define WARNING_SIZE (1024*1024)
+// tcp package larger than ZEROCOPY_SIZE use MSG_ZEROCOPY when the socket enable zerocopy
+#define ZEROCOPY_SIZE (16*1024)
+
+#ifdef USE_IO_URING
+// send_list_tcp submits at most URING_SEND_BATCH buffers of a socket at once (linked sends, see sp_send)
+#define URING_SEND_BATCH 16
+#endif
+
+#define LIMIT_DROP 0
+#define LIMIT_CLOSE 1
+
+#define WB_MEMORY 0
+#define WB_ZEROCOPY 1
+#define WB_FILE 2
 
 struct write_buffer {
 	struct write_buffer * next;
@@ -64,9 +101,17 @@ struct write_buffer {
 	char *ptr;				//当前发送的位置
 	int sz;					//还剩下发送的数据
 	bool userobject;		//为1表示是用户的数据，需要调用专门的函数解析为原始数据，为0表示为原始数据
+	uint8_t mode;			// WB_MEMORY, WB_ZEROCOPY or WB_FILE (buffer is struct send_file)
+	bool zc_sent;			// sent (maybe partly) with MSG_ZEROCOPY, kernel may reference it until zc_seq is notified
+	uint32_t zc_seq;		// sequence of the last MSG_ZEROCOPY send of this buffer
 	uint8_t udp_address[UDP_ADDRESS_SIZE];
 };
 
+struct send_file {
+	int fd;
+	off_t offset;
+};
+
 #define SIZEOF_TCPBUFFER (offsetof(struct write_buffer, udp_address[0]))
 #define SIZEOF_UDPBUFFER (sizeof(struct write_buffer))
 
@@ -87,6 +132,30 @@ struct socket {
 	uint8_t type;		/* SOCKET_TYPE_INVALID */
 	uint16_t udpconnecting;
 	int64_t warn_size;		/* 警告长度，超过这个长度会发出警告,SOCKET_WARNING */
+	int64_t high_watermark;	// report SOCKET_PAUSE when wb_size >= high_watermark, 0 means disable
+	int64_t low_watermark;	// report SOCKET_RESUME when wb_size <= low_watermark after paused
+	int64_t limit;			// wb_size can't exceed limit, 0 means unlimited
+	uint8_t limit_policy;	// LIMIT_DROP or LIMIT_CLOSE
+	bool paused;
+	bool zerocopy;
+	bool udp_batch;			// report the udp packages read by one recvmmsg in one SOCKET_UDP_BATCH
+	uint32_t zc_next;		// sequence of the next MSG_ZEROCOPY send
+	uint32_t zc_done;		// sequence of the next MSG_ZEROCOPY notification, zc_done != zc_next means in flight
+	struct wb_list zc_pending;	// buffers sent with MSG_ZEROCOPY, free them after kernel notify
+#ifdef USE_IO_URING
+	int uring_sending;		// sends in flight (SP_OP_SEND), the buffers from uring_first in the list
+	struct write_buffer * uring_first;
+	struct wb_list uring_held;	// the buffers in flight of a closed socket
+#endif
+	struct frame_format frame_format;	// split the data into packages in socket thread (SOCKET_FRAME), type 0 : disable
+	uintptr_t frame_target;
+	uintptr_t frame_ud;
+	int frame_headlen;		// bytes of the partial header in frame_head
+	uint8_t frame_head[FRAME_HEADER_MAX];
+	char * frame_buffer;	// the partial package
+	int frame_size;
+	int frame_len;
+	int frame_cap;			// the buffer grows as the data arrives, up to frame_size
 	union {
 		int size;		/* MIN_READ_BUFFER 64 */
 		uint8_t udp_address[UDP_ADDRESS_SIZE];
@@ -97,6 +166,12 @@ struct socket {
 	size_t dw_size;				/* dw_size小于0说明这个是一个用户维护的对象，需要调用对应的函数解析为原始数据发送 */
 };
 
+union sockaddr_all {
+	struct sockaddr s;
+	struct sockaddr_in v4;
+	struct sockaddr_in6 v6;
+};
+
 struct socket_server {
 	int recvctrl_fd;	/* 2个管道fd */
 	int sendctrl_fd;
@@ -109,7 +184,16 @@ struct socket_server {
 	struct event ev[MAX_EVENT];
 	struct socket slot[MAX_SOCKET];
 	char buffer[MAX_INFO];
-	uint8_t udpbuffer[MAX_UDP_PACKAGE];
+	uint8_t udpbuffer[UDP_BATCH][MAX_UDP_PACKAGE];
+#if UDP_BATCH > 1
+	// the packages read by recvmmsg but not reported yet
+	int udp_id;
+	int udp_n;
+	int udp_index;
+	int udp_len[UDP_BATCH];
+	socklen_t udp_slen[UDP_BATCH];
+	union sockaddr_all udp_sa[UDP_BATCH];
+#endif
 	fd_set rfds;
 };
 
@@ -158,6 +242,9 @@ struct request_bind {
 struct request_start {
 	int id;					/* socket的索引id */
 	uintptr_t opaque;		/* ctx的handle */
+	struct frame_format format;	/* 在 socket 线程分包的包头格式, type 为 0 则不分包 */
+	uintptr_t target;		/* 分包后的数据包发给 target */
+	uintptr_t ud;
 };
 
 struct request_setopt {
@@ -166,10 +253,26 @@ struct request_setopt {
 	int value;
 };
 
+struct request_watermark {
+	int id;
+	int policy;
+	int64_t high;
+	int64_t low;
+	int64_t limit;
+};
+
+struct request_sendfile {
+	int id;
+	int fd;
+	int sz;
+	int64_t offset;
+};
+
 struct request_udp {
 	int id;
 	int fd;
 	int family;
+	int batch;
 	uintptr_t opaque;
 };
 
@@ -188,6 +291,9 @@ struct request_udp {
 	T Set opt
 	U Create UDP socket
 	C set udp address
+	F Send file
+	Z Set zerocopy
+	W Set watermark
  */
 
 struct request_package {
@@ -204,16 +310,12 @@ struct request_package {
 		struct request_setopt setopt;
 		struct request_udp udp;
 		struct request_setudp set_udp;
+		struct request_sendfile sendfile;
+		struct request_watermark watermark;
 	} u;
 	uint8_t dummy[256];
 };
 
-union sockaddr_all {
-	struct sockaddr s;
-	struct sockaddr_in v4;
-	struct sockaddr_in6 v6;
-};
-
 struct send_object {
 	void * buffer;
 	int sz;
@@ -221,6 +323,7 @@ struct send_object {
 };
 
 #define MALLOC skynet_malloc
+#define REALLOC skynet_realloc
 #define FREE skynet_free
 
 struct socket_lock {
@@ -278,7 +381,11 @@ send_object_init(struct socket_server *ss, struct send_object *so, void *object,
 
 static inline void
 write_buffer_free(struct socket_server *ss, struct write_buffer *wb) {
-	if (wb->userobject) {
+	if (wb->mode == WB_FILE) {
+		struct send_file *sf = wb->buffer;
+		close(sf->fd);
+		FREE(sf);
+	} else if (wb->userobject) {
 		ss->soi.free(wb->buffer);
 	} else {
 		FREE(wb->buffer);
@@ -353,12 +460,21 @@ socket_server_create() {
 	ss->recvctrl_fd = fd[0];
 	ss->sendctrl_fd = fd[1];
 	ss->checkctrl = 1;
+#if UDP_BATCH > 1
+	ss->udp_id = -1;
+	ss->udp_n = 0;
+	ss->udp_index = 0;
+#endif
 
 	for (i=0;i<MAX_SOCKET;i++) {
 		struct socket *s = &ss->slot[i];
 		s->type = SOCKET_TYPE_INVALID;
 		clear_wb_list(&s->high);
 		clear_wb_list(&s->low);
+		clear_wb_list(&s->zc_pending);
+#ifdef USE_IO_URING
+		clear_wb_list(&s->uring_held);
+#endif
 	}
 	ss->alloc_id = 0;
 	ss->event_n = 0;
@@ -370,6 +486,33 @@ socket_server_create() {
 	return ss;
 }
 
+static void
+append_wb_list(struct wb_list *list, struct write_buffer *wb) {
+	wb->next = NULL;
+	if (list->head == NULL) {
+		list->head = list->tail = wb;
+	} else {
+		list->tail->next = wb;
+		list->tail = wb;
+	}
+}
+
+// the buffer sent with MSG_ZEROCOPY can't be freed before the kernel notifies its last sequence
+static inline bool
+zerocopy_inflight(struct socket *s, struct write_buffer *wb) {
+	return wb->mode == WB_ZEROCOPY && wb->zc_sent && (int32_t)(wb->zc_seq - s->zc_done) >= 0;
+}
+
+// the kernel may still read the buffers of this socket (MSG_ZEROCOPY or io_uring sends)
+static inline bool
+send_inflight(struct socket *s) {
+#ifdef USE_IO_URING
+	if (s->uring_sending)
+		return true;
+#endif
+	return s->zc_done != s->zc_next;
+}
+
 static void
 free_wb_list(struct socket_server *ss, struct wb_list *list) {
 	struct write_buffer *wb = list->head;
@@ -389,6 +532,80 @@ free_buffer(struct socket_server *ss, const void * buffer, int sz) {
 	so.free_func((void *)buffer);
 }
 
+// move the partly sent buffer (only the head of list) to zc_pending if the kernel may still reference it
+static void
+zerocopy_hold(struct socket *s, struct wb_list *list) {
+	struct write_buffer *wb = list->head;
+	if (wb && zerocopy_inflight(s, wb)) {
+		list->head = wb->next;
+		if (list->head == NULL) {
+			list->tail = NULL;
+		}
+		append_wb_list(&s->zc_pending, wb);
+	}
+}
+
+#ifdef USE_IO_URING
+
+// the kernel may still read the buffers of the sends in flight, move them from the list to uring_held
+static void
+uring_hold(struct socket *s, struct wb_list *list) {
+	if (s->uring_sending == 0)
+		return;
+	struct write_buffer *last = NULL;
+	struct write_buffer *first = list->head;
+	while (first && first != s->uring_first) {
+		last = first;
+		first = first->next;
+	}
+	if (first == NULL)
+		return;
+	struct write_buffer *tail = first;
+	int i;
+	for (i=1;i<s->uring_sending;i++) {
+		tail = tail->next;
+	}
+	if (last) {
+		last->next = tail->next;
+	} else {
+		list->head = tail->next;
+	}
+	if (list->tail == tail) {
+		list->tail = last;
+	}
+	tail->next = NULL;
+	s->uring_held.head = first;
+	s->uring_held.tail = tail;
+}
+
+#endif
+
+static void
+free_frame_buffer(struct socket *s) {
+	if (s->frame_buffer) {
+		FREE(s->frame_buffer);
+		s->frame_buffer = NULL;
+	}
+}
+
+// The kernel may still send the pages of zc_pending after close(fd), and no notification would come.
+// So keep the fd (only for errors) until all the MSG_ZEROCOPY sends are notified, see SOCKET_TYPE_ZCLOSING.
+// The io_uring sends in flight (uring_held) are waited the same way, shutdown makes them fail soon.
+static void
+zerocopy_linger(struct socket_server *ss, struct socket *s, struct socket_lock *l) {
+	sp_enable(ss->event_fd, s->fd, s, false, false);
+	shutdown(s->fd, SHUT_WR);
+	socket_lock(l);
+	s->type = SOCKET_TYPE_ZCLOSING;
+	s->id = -1;	// reject the requests of the old id, and the slot is not reused until closed
+	if (s->dw_buffer) {
+		free_buffer(ss, s->dw_buffer, s->dw_size);
+		s->dw_buffer = NULL;
+	}
+	socket_unlock(l);
+	free_frame_buffer(s);
+}
+
 static void
 force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	result->id = s->id;
@@ -399,8 +616,22 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 		return;
 	}
 	assert(s->type != SOCKET_TYPE_RESERVE);
+	zerocopy_hold(s, &s->high);
+	zerocopy_hold(s, &s->low);
+#ifdef USE_IO_URING
+	uring_hold(s, &s->high);
+	uring_hold(s, &s->low);
+#endif
 	free_wb_list(ss,&s->high);
 	free_wb_list(ss,&s->low);
+	if (send_inflight(s) && s->type != SOCKET_TYPE_ZCLOSING) {
+		zerocopy_linger(ss, s, l);
+		return;
+	}
+	free_wb_list(ss,&s->zc_pending);
+#ifdef USE_IO_URING
+	free_wb_list(ss,&s->uring_held);
+#endif
 	if (s->type != SOCKET_TYPE_PACCEPT && s->type != SOCKET_TYPE_PLISTEN) {
 		sp_del(ss->event_fd, s->fd);
 	}
@@ -416,6 +647,7 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 		s->dw_buffer = NULL;
 	}
 	socket_unlock(l);
+	free_frame_buffer(s);
 }
 
 void 
@@ -427,6 +659,11 @@ socket_server_release(struct socket_server *ss) {
 		struct socket_lock l;
 		socket_lock_init(s, &l);
 		if (s->type != SOCKET_TYPE_RESERVE) {
+			// exiting, don't wait for the zerocopy notifications
+			s->zc_done = s->zc_next;
+#ifdef USE_IO_URING
+			s->uring_sending = 0;
+#endif
 			force_close(ss, s, &l, &dummy);
 		}
 	}
@@ -462,8 +699,26 @@ new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque,
 	s->opaque = opaque;
 	s->wb_size = 0;
 	s->warn_size = 0;
+	s->high_watermark = 0;
+	s->low_watermark = 0;
+	s->limit = 0;
+	s->limit_policy = LIMIT_DROP;
+	s->paused = false;
+	s->zerocopy = false;
+	s->udp_batch = false;
+	s->zc_next = 0;
+	s->zc_done = 0;
+	s->frame_format.type = 0;
+	s->frame_headlen = 0;
+	s->frame_buffer = NULL;
 	check_wb_list(&s->high);
 	check_wb_list(&s->low);
+	check_wb_list(&s->zc_pending);
+#ifdef USE_IO_URING
+	s->uring_sending = 0;
+	s->uring_first = NULL;
+	check_wb_list(&s->uring_held);
+#endif
 	spinlock_init(&s->dw_lock);
 	s->dw_buffer = NULL;
 	s->dw_size = 0;
@@ -496,6 +751,9 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 		goto _failed;
 	}
 	int sock= -1;
+#ifdef USE_IO_URING
+	bool uring_connect = false;
+#endif
 	for (ai_ptr = ai_list; ai_ptr != NULL; ai_ptr = ai_ptr->ai_next ) {
 		sock = socket( ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol );
 		if ( sock < 0 ) {
@@ -503,6 +761,14 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 		}
 		socket_keepalive(sock);
 		sp_nonblocking(sock);
+#ifdef USE_IO_URING
+		if (ai_list->ai_next == NULL) {
+			// only one address (no other to try if it fails at once), connect it by io_uring after new_fd
+			uring_connect = true;
+			status = -1;
+			break;
+		}
+#endif
 		status = connect( sock, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
 		if ( status != 0 && errno != EINPROGRESS) {
 			close(sock);
@@ -526,6 +792,9 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 
 	if(status == 0) {
 		ns->type = SOCKET_TYPE_CONNECTED;
+#ifdef USE_IO_URING
+		sp_mode(ss->event_fd, ns->fd, SP_MODE_RECV);
+#endif
 		struct sockaddr * addr = ai_ptr->ai_addr;
 		void * sin_addr = (ai_ptr->ai_family == AF_INET) ? (void*)&((struct sockaddr_in *)addr)->sin_addr : (void*)&((struct sockaddr_in6 *)addr)->sin6_addr;
 		if (inet_ntop(ai_ptr->ai_family, sin_addr, ss->buffer, sizeof(ss->buffer))) {
@@ -535,6 +804,11 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 		return SOCKET_OPEN;
 	} else {
 		ns->type = SOCKET_TYPE_CONNECTING;
+#ifdef USE_IO_URING
+		if (uring_connect) {
+			sp_connect(ss->event_fd, ns->fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+		}
+#endif
 		sp_write(ss->event_fd, ns->fd, ns, true);
 	}
 
@@ -546,12 +820,143 @@ _failed:
 	return SOCKET_ERR;
 }
 
+static ssize_t
+send_file(int sock, struct send_file *sf, int sz) {
+#ifdef __linux__
+	return sendfile(sock, sf->fd, &sf->offset, sz);
+#else
+	char tmp[4096];
+	ssize_t n = pread(sf->fd, tmp, sz < (int)sizeof(tmp) ? sz : (int)sizeof(tmp), sf->offset);
+	if (n <= 0)
+		return n;
+	n = write(sock, tmp, n);
+	if (n > 0)
+		sf->offset += n;
+	return n;
+#endif
+}
+
+static ssize_t
+write_buffer_send(struct socket *s, struct write_buffer *wb) {
+	switch (wb->mode) {
+	case WB_FILE:
+		return send_file(s->fd, wb->buffer, wb->sz);
+#ifdef HAS_ZEROCOPY
+	case WB_ZEROCOPY: {
+		ssize_t sz = send(s->fd, wb->ptr, wb->sz, MSG_ZEROCOPY);
+		if (sz >= 0) {
+			// every successful MSG_ZEROCOPY send consumes one sequence number
+			wb->zc_seq = s->zc_next++;
+			wb->zc_sent = true;
+		} else if (errno == ENOBUFS) {
+			// out of optmem, send this part by copy (keep the mode, the earlier parts may be in flight)
+			return write(s->fd, wb->ptr, wb->sz);
+		}
+		return sz;
+	}
+#endif
+	default:
+		return write(s->fd, wb->ptr, wb->sz);
+	}
+}
+
+#ifdef USE_IO_URING
+
+// submit the memory buffers at the head of list by io_uring, return false if the head can't (file or zerocopy)
+static bool
+uring_send_list(struct socket_server *ss, struct socket *s, struct wb_list *list) {
+	struct iovec v[URING_SEND_BATCH];
+	int n = 0;
+	struct write_buffer *wb;
+	for (wb = list->head; wb && wb->mode == WB_MEMORY && n < URING_SEND_BATCH; wb = wb->next) {
+		v[n].iov_base = wb->ptr;
+		v[n].iov_len = wb->sz;
+		++n;
+	}
+	if (n == 0 || sp_send(ss->event_fd, s->fd, v, n))
+		return false;
+	s->uring_sending = n;
+	s->uring_first = list->head;
+	return true;
+}
+
+// SP_OP_SEND of the buffer uring_first, they are reported in the order of sp_send
+static int
+uring_sent(struct socket_server *ss, struct socket *s, struct socket_lock *l, int res, struct socket_message *result) {
+	struct write_buffer *wb = s->uring_first;
+	s->uring_first = wb->next;
+	--s->uring_sending;
+	if (s->type == SOCKET_TYPE_ZCLOSING) {
+		// moved to uring_held by force_close
+		assert(s->uring_held.head == wb);
+		s->uring_held.head = wb->next;
+		if (s->uring_held.head == NULL) {
+			s->uring_held.tail = NULL;
+		}
+		write_buffer_free(ss, wb);
+		return -1;
+	}
+	if (res < 0) {
+		switch(-res) {
+		case ECANCELED:
+			// an earlier send of the chain failed, send it again later
+		case EINTR:
+		case AGAIN_WOULDBLOCK:
+			return -1;
+		}
+		force_close(ss,s,l,result);
+		return SOCKET_CLOSE;
+	}
+	struct wb_list *list = (s->high.head == wb) ? &s->high : &s->low;
+	assert(list->head == wb);
+	socket_lock(l);
+	s->wb_size -= res;
+	if (res < wb->sz) {
+		// a short send stops the chain (MSG_WAITALL), the rest of the chain is canceled
+		wb->ptr += res;
+		wb->sz -= res;
+		if (list == &s->low) {
+			// the rest of the package must be sent first, move it before high list (see raise_uncomplete)
+			s->low.head = wb->next;
+			if (s->low.head == NULL) {
+				s->low.tail = NULL;
+			}
+			wb->next = s->high.head;
+			s->high.head = wb;
+			if (s->high.tail == NULL) {
+				s->high.tail = wb;
+			}
+		}
+	} else {
+		list->head = wb->next;
+		if (list->head == NULL) {
+			list->tail = NULL;
+		}
+		write_buffer_free(ss, wb);
+	}
+	socket_unlock(l);
+	return -1;
+}
+
+#endif
+
 static int
 send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
+#ifdef USE_IO_URING
+	if (s->uring_sending)
+		return -1;	// wait for SP_OP_SEND of the buffers in flight
+	if (uring_send_list(ss, s, list))
+		return -1;
+#endif
 	while (list->head) {
 		struct write_buffer * tmp = list->head;
 		for (;;) {
-			ssize_t sz = write(s->fd, tmp->ptr, tmp->sz);
+			ssize_t sz = write_buffer_send(s, tmp);
+			if (sz == 0 && tmp->mode == WB_FILE) {
+				// the file is shorter than expect, drop the rest
+				s->wb_size -= tmp->sz;
+				break;
+			}
 			if (sz < 0) {
 				switch(errno) {
 				case EINTR:
@@ -564,14 +969,21 @@ send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 			}
 			s->wb_size -= sz;
 			if (sz != tmp->sz) {
-				tmp->ptr += sz;
+				if (tmp->mode != WB_FILE) {
+					tmp->ptr += sz;
+				}
 				tmp->sz -= sz;
 				return -1;
 			}
 			break;
 		}
 		list->head = tmp->next;
-		write_buffer_free(ss,tmp);
+		if (zerocopy_inflight(s, tmp)) {
+			// kernel still holds the pages, free it in zerocopy_complete
+			append_wb_list(&s->zc_pending, tmp);
+		} else {
+			write_buffer_free(ss,tmp);
+		}
 	}
 	list->tail = NULL;
 
@@ -602,6 +1014,54 @@ udp_socket_address(struct socket *s, const uint8_t udp_address[UDP_ADDRESS_SIZE]
 	return 0;
 }
 
+#if UDP_BATCH > 1
+
+static int
+send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
+	while (list->head) {
+		struct mmsghdr msg[UDP_BATCH];
+		struct iovec iov[UDP_BATCH];
+		union sockaddr_all sa[UDP_BATCH];
+		struct write_buffer * tmp = list->head;
+		int i;
+		for (i=0; i<UDP_BATCH && tmp; i++, tmp = tmp->next) {
+			iov[i].iov_base = tmp->ptr;
+			iov[i].iov_len = tmp->sz;
+			memset(&msg[i], 0, sizeof(msg[i]));
+			msg[i].msg_hdr.msg_name = &sa[i].s;
+			msg[i].msg_hdr.msg_namelen = udp_socket_address(s, tmp->udp_address, &sa[i]);
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+		}
+		int n = sendmmsg(s->fd, msg, i, 0);
+		if (n < 0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			fprintf(stderr, "socket-server : udp (%d) sendto error %s.\n",s->id, strerror(errno));
+			return -1;
+		}
+		int j;
+		for (j=0;j<n;j++) {
+			tmp = list->head;
+			s->wb_size -= tmp->sz;
+			list->head = tmp->next;
+			write_buffer_free(ss,tmp);
+		}
+		if (n < i) {
+			// the rest would block
+			return -1;
+		}
+	}
+	list->tail = NULL;
+
+	return -1;
+}
+
+#else
+
 static int
 send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
 	while (list->head) {
@@ -637,6 +1097,8 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 	return -1;
 }
 
+#endif
+
 static int
 send_list(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
 	if (s->protocol == PROTOCOL_TCP) {
@@ -678,6 +1140,19 @@ send_buffer_empty(struct socket *s) {
 	return (s->high.head == NULL && s->low.head == NULL);
 }
 
+static inline int
+resume_sending(struct socket *s, struct socket_message *result) {
+	if (s->paused && s->wb_size <= s->low_watermark) {
+		s->paused = false;
+		result->opaque = s->opaque;
+		result->id = s->id;
+		result->ud = s->wb_size%1024 == 0 ? s->wb_size/1024 : s->wb_size/1024 + 1;
+		result->data = NULL;
+		return SOCKET_RESUME;
+	}
+	return -1;
+}
+
 /*
 	Each socket has two write buffer list, high priority and low priority.
 
@@ -685,6 +1160,8 @@ send_buffer_empty(struct socket *s) {
 	2. If high list is empty, try to send low list.
 	3. If low list head is uncomplete (send a part before), move the head of low list to empty high list (call raise_uncomplete) .
 	4. If two lists are both empty, turn off the event. (call check_close)
+
+	When the socket is paused (see check_wb_size), report SOCKET_RESUME once wb_size drops to low watermark.
  */
 static int
 send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
@@ -702,13 +1179,17 @@ send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l,
 			// step 3
 			if (list_uncomplete(&s->low)) {
 				raise_uncomplete(s);
-				return -1;
+				return resume_sending(s, result);
 			}
 			if (s->low.head)
-				return -1;
+				return resume_sending(s, result);
 		} 
 		// step 4
 		assert(send_buffer_empty(s) && s->wb_size == 0);
+		if (s->paused) {
+			// keep the write event, so we can turn off it and report the other messages next time
+			return resume_sending(s, result);
+		}
 		sp_write(ss->event_fd, s->fd, s, false);			
 
 		if (s->type == SOCKET_TYPE_HALFCLOSE) {	/* TCP的设备最好在发送完全后才关闭socket，这样避免对端漏收数据 */
@@ -723,9 +1204,10 @@ send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l,
 				result->data = NULL;
 				return SOCKET_WARNING;
 		}
+		return -1;
 	}
 
-	return -1;
+	return resume_sending(s, result);
 }
 
 static int
@@ -737,6 +1219,7 @@ send_buffer(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 		struct write_buffer * buf = MALLOC(SIZEOF_TCPBUFFER);
 		struct send_object so;
 		buf->userobject = send_object_init(ss, &so, (void *)s->dw_buffer, s->dw_size);
+		buf->mode = WB_MEMORY;
 		buf->ptr = (char*)so.buffer+s->dw_offset;
 		buf->sz = so.sz - s->dw_offset;
 		buf->buffer = (void *)s->dw_buffer;
@@ -761,6 +1244,7 @@ append_sendbuffer_(struct socket_server *ss, struct wb_list *s, struct request_s
 	struct write_buffer * buf = MALLOC(size);
 	struct send_object so;
 	buf->userobject = send_object_init(ss, &so, request->buffer, request->sz);
+	buf->mode = WB_MEMORY;
 	buf->ptr = (char*)so.buffer;
 	buf->sz = so.sz;
 	buf->buffer = request->buffer;
@@ -784,25 +1268,76 @@ append_sendbuffer_udp(struct socket_server *ss, struct socket *s, int priority,
 	s->wb_size += buf->sz;
 }
 
+static inline void
+check_zerocopy(struct socket *s, struct write_buffer *buf) {
+	if (s->zerocopy && buf->sz >= ZEROCOPY_SIZE) {
+		buf->mode = WB_ZEROCOPY;
+		buf->zc_sent = false;
+	}
+}
+
 static inline void
 append_sendbuffer(struct socket_server *ss, struct socket *s, struct request_send * request) {
 	struct write_buffer *buf = append_sendbuffer_(ss, &s->high, request, SIZEOF_TCPBUFFER);
+	check_zerocopy(s, buf);
 	s->wb_size += buf->sz;
 }
 
 static inline void
 append_sendbuffer_low(struct socket_server *ss,struct socket *s, struct request_send * request) {
 	struct write_buffer *buf = append_sendbuffer_(ss, &s->low, request, SIZEOF_TCPBUFFER);
+	check_zerocopy(s, buf);
 	s->wb_size += buf->sz;
 }
 
 
+static int
+check_wb_size(struct socket *s, struct socket_message *result) {
+	if (s->high_watermark > 0 && !s->paused && s->wb_size >= s->high_watermark) {
+		s->paused = true;
+		result->opaque = s->opaque;
+		result->id = s->id;
+		result->ud = s->wb_size%1024 == 0 ? s->wb_size/1024 : s->wb_size/1024 + 1;
+		result->data = NULL;
+		return SOCKET_PAUSE;
+	}
+	if (s->wb_size >= WARNING_SIZE && s->wb_size >= s->warn_size) {
+		s->warn_size = s->warn_size == 0 ? WARNING_SIZE *2 : s->warn_size*2;
+		result->opaque = s->opaque;
+		result->id = s->id;
+		result->ud = s->wb_size%1024 == 0 ? s->wb_size/1024 : s->wb_size/1024 + 1;
+		result->data = NULL;
+		return SOCKET_WARNING;
+	}
+	return -1;
+}
+
+static inline bool
+exceed_limit(struct socket *s, int sz) {
+	return s->limit > 0 && s->wb_size + sz > s->limit;
+}
+
+// the package is dropped by caller, close the socket if the policy is LIMIT_CLOSE
+static int
+overflow_socket(struct socket_server *ss, struct socket *s, struct socket_message *result) {
+	if (s->limit_policy == LIMIT_CLOSE) {
+		struct socket_lock l;
+		socket_lock_init(s, &l);
+		force_close(ss, s, &l, result);
+		result->data = "send buffer overflow";
+		return SOCKET_ERR;
+	}
+	return -1;
+}
+
 /*
 	When send a package , we can assign the priority : PRIORITY_HIGH or PRIORITY_LOW
 
 	If socket buffer is empty, write to fd directly.
 		If write a part, append the rest part to high list. (Even priority is PRIORITY_LOW)
 	Else append package to high (PRIORITY_HIGH) or low (PRIORITY_LOW) list.
+
+	If the package makes wb_size exceed the limit, drop it (and close the socket when the policy is LIMIT_CLOSE).
  */
 static int
 send_socket(struct socket_server *ss, struct request_send * request, struct socket_message *result, int priority, const uint8_t *udp_address) {
@@ -821,6 +1356,10 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 		so.free_func(request->buffer);
 		return -1;
 	}
+	if (exceed_limit(s, so.sz)) {
+		so.free_func(request->buffer);
+		return overflow_socket(ss, s, result);
+	}
 	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
 		if (s->protocol == PROTOCOL_TCP) {
 			append_sendbuffer(ss, s, request);	// add to high priority list, even priority == PRIORITY_LOW
@@ -854,15 +1393,41 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 			append_sendbuffer_udp(ss,s,priority,request,udp_address);
 		}
 	}
-	if (s->wb_size >= WARNING_SIZE && s->wb_size >= s->warn_size) {
-		s->warn_size = s->warn_size == 0 ? WARNING_SIZE *2 : s->warn_size*2;
-		result->opaque = s->opaque;
-		result->id = s->id;
-		result->ud = s->wb_size%1024 == 0 ? s->wb_size/1024 : s->wb_size/1024 + 1;
-		result->data = NULL;
-		return SOCKET_WARNING;
+	return check_wb_size(s, result);
+}
+
+static int
+sendfile_socket(struct socket_server *ss, struct request_sendfile * request, struct socket_message *result) {
+	int id = request->id;
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id != id 
+		|| s->type == SOCKET_TYPE_HALFCLOSE
+		|| s->type == SOCKET_TYPE_PACCEPT
+		|| s->type == SOCKET_TYPE_PLISTEN
+		|| s->type == SOCKET_TYPE_LISTEN
+		|| s->protocol != PROTOCOL_TCP) {
+		close(request->fd);
+		return -1;
 	}
-	return -1;
+	if (exceed_limit(s, request->sz)) {
+		close(request->fd);
+		return overflow_socket(ss, s, result);
+	}
+	struct send_file * sf = MALLOC(sizeof(*sf));
+	sf->fd = request->fd;
+	sf->offset = request->offset;
+	struct write_buffer * buf = MALLOC(SIZEOF_TCPBUFFER);
+	buf->buffer = sf;
+	buf->ptr = NULL;
+	buf->sz = request->sz;
+	buf->userobject = false;
+	buf->mode = WB_FILE;
+	if (send_buffer_empty(s) && s->type == SOCKET_TYPE_CONNECTED) {
+		sp_write(ss->event_fd, s->fd, s, true);
+	}
+	append_wb_list(&s->high, buf);
+	s->wb_size += buf->sz;
+	return check_wb_size(s, result);
 }
 
 static int
@@ -906,8 +1471,8 @@ close_socket(struct socket_server *ss, struct request_close *request, struct soc
 	socket_lock_init(s, &l);
 	if (!nomore_sending_data(s)) {
 		int type = send_buffer(ss,s,&l,result);
-		// type : -1 or SOCKET_WARNING or SOCKET_CLOSE, SOCKET_WARNING means nomore_sending_data
-		if (type != -1 && type != SOCKET_WARNING)
+		// type : -1 or SOCKET_WARNING or SOCKET_RESUME or SOCKET_CLOSE, SOCKET_WARNING means nomore_sending_data
+		if (type != -1 && type != SOCKET_WARNING && type != SOCKET_RESUME)
 			return type;
 	}
 	if (request->shutdown || nomore_sending_data(s)) {
@@ -938,6 +1503,37 @@ bind_socket(struct socket_server *ss, struct request_bind *request, struct socke
 	return SOCKET_OPEN;
 }
 
+// the partial package is kept when only the target changes. When the framing is disabled, return it (with its header)
+// to be the head of the data of the new owner, NULL if there is none.
+static char *
+start_frame(struct socket *s, struct request_start *request, int *sz) {
+	char * partial = NULL;
+	if (s->type != SOCKET_TYPE_CONNECTED)
+		return NULL;
+	if (request->format.type == 0 && s->frame_format.type != 0) {
+		if (s->frame_buffer) {
+			uint8_t head[FRAME_HEADER_MAX];
+			int len = frame_write_header(&s->frame_format, head, s->frame_size);
+			assert(len > 0);
+			partial = MALLOC(len + s->frame_len);
+			memcpy(partial, head, len);
+			memcpy(partial + len, s->frame_buffer, s->frame_len);
+			*sz = len + s->frame_len;
+			FREE(s->frame_buffer);
+			s->frame_buffer = NULL;
+		} else if (s->frame_headlen > 0) {
+			partial = MALLOC(s->frame_headlen);
+			memcpy(partial, s->frame_head, s->frame_headlen);
+			*sz = s->frame_headlen;
+		}
+		s->frame_headlen = 0;
+	}
+	s->frame_format = request->format;
+	s->frame_target = request->target;
+	s->frame_ud = request->ud;
+	return partial;
+}
+
 static int
 start_socket(struct socket_server *ss, struct request_start *request, struct socket_message *result) {
 	int id = request->id;
@@ -958,13 +1554,26 @@ start_socket(struct socket_server *ss, struct request_start *request, struct soc
 			result->data = strerror(errno);
 			return SOCKET_ERR;
 		}
+#ifdef USE_IO_URING
+		sp_mode(ss->event_fd, s->fd, s->type == SOCKET_TYPE_PACCEPT ? SP_MODE_RECV : SP_MODE_ACCEPT);
+#endif
 		s->type = (s->type == SOCKET_TYPE_PACCEPT) ? SOCKET_TYPE_CONNECTED : SOCKET_TYPE_LISTEN;
 		s->opaque = request->opaque;
+		int sz;
+		start_frame(s, request, &sz);
 		result->data = "start";
 		return SOCKET_OPEN;
 	} else if (s->type == SOCKET_TYPE_CONNECTED) {
 		// todo: maybe we should send a message SOCKET_TRANSFER to s->opaque
 		s->opaque = request->opaque;
+		int sz;
+		char * partial = start_frame(s, request, &sz);
+		if (partial) {
+			// hand the partial package back to the new owner (gate) as data, instead of the "transfer" message
+			result->ud = sz;
+			result->data = partial;
+			return SOCKET_DATA;
+		}
 		result->data = "transfer";
 		return SOCKET_OPEN;
 	}
@@ -983,13 +1592,120 @@ setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 	setsockopt(s->fd, IPPROTO_TCP, request->what, &v, sizeof(v));
 }
 
-static void
-block_readpipe(int pipefd, void *buffer, int sz) {
-	for (;;) {
-		int n = read(pipefd, buffer, sz);
-		if (n<0) {
-			if (errno == EINTR)
-				continue;
+static int
+watermark_socket(struct socket_server *ss, struct request_watermark *request, struct socket_message *result) {
+	int id = request->id;
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id) {
+		return -1;
+	}
+	s->high_watermark = request->high;
+	s->low_watermark = request->low;
+	s->limit = request->limit;
+	s->limit_policy = request->policy;
+	if (s->paused) {
+		if (s->high_watermark == 0) {
+			s->low_watermark = s->wb_size;
+		}
+		return resume_sending(s, result);
+	}
+	return check_wb_size(s, result);
+}
+
+static void
+zerocopy_socket(struct socket_server *ss, struct request_setopt *request) {
+	int id = request->id;
+	struct socket *s = &ss->slot[HASH_ID(id)];
+	if (s->type == SOCKET_TYPE_INVALID || s->id !=id || s->protocol != PROTOCOL_TCP) {
+		return;
+	}
+#ifdef HAS_ZEROCOPY
+	int v = request->value;
+	if (setsockopt(s->fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == 0) {
+		s->zerocopy = v != 0;
+#ifdef USE_IO_URING
+		if (s->zerocopy) {
+			// the notifications raise POLLERR, which is only reported by the poll of SP_MODE_POLL
+			sp_mode(ss->event_fd, s->fd, SP_MODE_POLL);
+		}
+#endif
+	}
+#endif
+}
+
+#ifdef HAS_ZEROCOPY
+
+static void
+free_zerocopy(struct socket_server *ss, struct socket *s, uint32_t hi) {
+	struct wb_list *list = &s->zc_pending;
+	while (list->head && (int32_t)(hi - list->head->zc_seq) >= 0) {
+		struct write_buffer *tmp = list->head;
+		list->head = tmp->next;
+		write_buffer_free(ss, tmp);
+	}
+	if (list->head == NULL) {
+		list->tail = NULL;
+	}
+}
+
+// read the MSG_ZEROCOPY notifications from the error queue (zc_done is the next sequence to notify)
+static void
+zerocopy_complete(struct socket_server *ss, struct socket *s) {
+	for (;;) {
+		char control[128];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(s->fd, &msg, MSG_ERRQUEUE) < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		struct cmsghdr *cm;
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+				|| (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+				continue;
+			struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			// [ee_info, ee_data] is the range of completed sequence
+			if ((int32_t)(serr->ee_data + 1 - s->zc_done) > 0) {
+				s->zc_done = serr->ee_data + 1;
+			}
+			free_zerocopy(ss, s, serr->ee_data);
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				// kernel copied the data anyway (loopback for example), zerocopy is only overhead
+				s->zerocopy = false;
+			}
+		}
+	}
+}
+
+#endif
+
+// return the pending error of socket (SO_ERROR, it's cleared after read), NULL if no error
+static const char *
+socket_error(struct socket *s) {
+	int error;
+	socklen_t len = sizeof(error);
+	int code = getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+	if (code < 0) {
+		return strerror(errno);
+	} else if (error != 0) {
+		return strerror(error);
+	}
+	return NULL;
+}
+
+static void
+block_readpipe(int pipefd, void *buffer, int sz) {
+	for (;;) {
+		int n = read(pipefd, buffer, sz);
+		if (n<0) {
+			if (errno == EINTR)
+				continue;
 			fprintf(stderr, "socket-server : read pipe error %s.\n",strerror(errno));
 			return;
 		}
@@ -1029,6 +1745,7 @@ add_udp_socket(struct socket_server *ss, struct request_udp *udp) {
 		return;
 	}
 	ns->type = SOCKET_TYPE_CONNECTED;
+	ns->udp_batch = udp->batch != 0;
 	memset(ns->p.udp_address, 0, sizeof(ns->p.udp_address));
 }
 
@@ -1139,6 +1856,17 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	case 'U':
 		add_udp_socket(ss, (struct request_udp *)buffer);	/* 设置一个udp socket */
 		return -1;
+	case 'F': {
+		struct request_sendfile * request = (struct request_sendfile *) buffer;
+		int ret = sendfile_socket(ss, request, result);
+		dec_sending_ref(ss, request->id);
+		return ret;
+	}
+	case 'Z':
+		zerocopy_socket(ss, (struct request_setopt *)buffer);
+		return -1;
+	case 'W':
+		return watermark_socket(ss, (struct request_watermark *)buffer, result);
 	default:
 		fprintf(stderr, "socket-server: Unknown ctrl %c.\n",type);
 		return -1;
@@ -1147,6 +1875,102 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	return -1;
 }
 
+static void
+frame_list_push(struct socket_frame_list **list, int *cap, char *buffer, int size) {
+	struct socket_frame_list *l = *list;
+	if (l == NULL || l->n >= *cap) {
+		int ncap = l ? *cap * 2 : 8;
+		struct socket_frame_list *nl = MALLOC(sizeof(*nl) + ncap * sizeof(struct socket_frame));
+		if (l) {
+			memcpy(nl, l, sizeof(*l) + l->n * sizeof(struct socket_frame));
+			FREE(l);
+		} else {
+			nl->n = 0;
+		}
+		*list = l = nl;
+		*cap = ncap;
+	}
+	l->frame[l->n].buffer = buffer;
+	l->frame[l->n].size = size;
+	++l->n;
+}
+
+static void
+frame_list_free(struct socket_frame_list *list) {
+	if (list == NULL)
+		return;
+	int i;
+	for (i=0;i<list->n;i++) {
+		FREE(list->frame[i].buffer);
+	}
+	FREE(list);
+}
+
+// split the data into packages, the partial package is kept in socket. return -1 if no package is completed.
+static int
+forward_frames(struct socket *s, const char *data, int n, struct socket_message *result) {
+	struct socket_frame_list *list = NULL;
+	int cap = 0;
+	while (n > 0) {
+		if (s->frame_buffer == NULL) {
+			// the header may be shorter than the bytes copied (varint)
+			int old = s->frame_headlen;
+			int c = n < FRAME_HEADER_MAX - old ? n : FRAME_HEADER_MAX - old;
+			memcpy(s->frame_head + old, data, c);
+			int size;
+			int len = frame_read_header(&s->frame_format, s->frame_head, old + c, &size);
+			if (len < 0) {
+				frame_list_free(list);
+				return SOCKET_ERR;
+			}
+			if (len == 0) {
+				s->frame_headlen = old + c;
+				break;
+			}
+			s->frame_headlen = 0;
+			data += len - old;
+			n -= len - old;
+			if (size == 0)
+				continue;
+			// don't trust the size in header, allocate only what has arrived (at least FRAME_BUFFER_MIN)
+			int cap = n > FRAME_BUFFER_MIN ? n : FRAME_BUFFER_MIN;
+			if (cap > size)
+				cap = size;
+			s->frame_buffer = MALLOC(cap);
+			s->frame_size = size;
+			s->frame_len = 0;
+			s->frame_cap = cap;
+		}
+		int need = s->frame_size - s->frame_len;
+		int c = n < need ? n : need;
+		if (s->frame_len + c > s->frame_cap) {
+			int cap = s->frame_cap * 2;
+			if (cap < s->frame_len + c)
+				cap = s->frame_len + c;
+			if (cap > s->frame_size)
+				cap = s->frame_size;
+			s->frame_buffer = REALLOC(s->frame_buffer, cap);
+			s->frame_cap = cap;
+		}
+		memcpy(s->frame_buffer + s->frame_len, data, c);
+		s->frame_len += c;
+		data += c;
+		n -= c;
+		if (s->frame_len == s->frame_size) {
+			frame_list_push(&list, &cap, s->frame_buffer, s->frame_size);
+			s->frame_buffer = NULL;
+		}
+	}
+	if (list == NULL)
+		return -1;
+	list->ud = s->frame_ud;
+	result->opaque = s->frame_target;
+	result->id = s->id;
+	result->ud = list->n;
+	result->data = (char *)list;
+	return SOCKET_FRAME;
+}
+
 // return -1 (ignore) when error
 static int
 forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
@@ -1187,6 +2011,55 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lo
 		s->p.size /= 2;
 	}
 
+	if (s->frame_format.type) {
+		int type = forward_frames(s, buffer, n, result);
+		FREE(buffer);
+		if (type == SOCKET_ERR) {
+			force_close(ss, s, l, result);
+			result->data = "invalid package header";
+		}
+		return type;
+	}
+
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = n;
+	result->data = buffer;
+	return SOCKET_DATA;
+}
+
+#ifdef USE_IO_URING
+
+// the data received by io_uring (SP_OP_RECV), e->data is valid until the next sp_wait
+static int
+forward_recv_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct event *e, struct socket_message * result) {
+	int n = e->res;
+	if (n < 0) {
+		force_close(ss, s, l, result);
+		result->data = strerror(-n);
+		return SOCKET_ERR;
+	}
+	if (n == 0) {
+		force_close(ss, s, l, result);
+		return SOCKET_CLOSE;
+	}
+
+	if (s->type == SOCKET_TYPE_HALFCLOSE) {
+		// discard recv data
+		return -1;
+	}
+
+	if (s->frame_format.type) {
+		int type = forward_frames(s, e->data, n, result);
+		if (type == SOCKET_ERR) {
+			force_close(ss, s, l, result);
+			result->data = "invalid package header";
+		}
+		return type;
+	}
+
+	char * buffer = MALLOC(n);
+	memcpy(buffer, e->data, n);
 	result->opaque = s->opaque;
 	result->id = s->id;
 	result->ud = n;
@@ -1194,6 +2067,8 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lo
 	return SOCKET_DATA;
 }
 
+#endif
+
 static int
 gen_udp_address(int protocol, union sockaddr_all *sa, uint8_t * udp_address) {
 	int addrsz = 1;
@@ -1212,37 +2087,24 @@ gen_udp_address(int protocol, union sockaddr_all *sa, uint8_t * udp_address) {
 	return addrsz;
 }
 
-static int
-forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
-	union sockaddr_all sa;
-	socklen_t slen = sizeof(sa);
-	int n = recvfrom(s->fd, ss->udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
-	if (n<0) {
-		switch(errno) {
-		case EINTR:
-		case AGAIN_WOULDBLOCK:
-			break;
-		default:
-			// close when error
-			force_close(ss, s, l, result);
-			result->data = strerror(errno);
-			return SOCKET_ERR;
-		}
-		return -1;
-	}
-	uint8_t * data;
-	if (slen == sizeof(sa.v4)) {
-		if (s->protocol != PROTOCOL_UDP)
-			return -1;
-		data = MALLOC(n + 1 + 2 + 4);
-		gen_udp_address(PROTOCOL_UDP, &sa, data + n);
+// return the size of udp address, or 0 when protocol mismatch
+static inline int
+udp_address_size(struct socket *s, socklen_t slen) {
+	if (slen == sizeof(struct sockaddr_in)) {
+		return s->protocol == PROTOCOL_UDP ? 1 + 2 + 4 : 0;
 	} else {
-		if (s->protocol != PROTOCOL_UDPv6)
-			return -1;
-		data = MALLOC(n + 1 + 2 + 16);
-		gen_udp_address(PROTOCOL_UDPv6, &sa, data + n);
+		return s->protocol == PROTOCOL_UDPv6 ? 1 + 2 + 16 : 0;
 	}
-	memcpy(data, ss->udpbuffer, n);
+}
+
+static int
+forward_udp_package(struct socket *s, const uint8_t *buffer, int n, union sockaddr_all *sa, socklen_t slen, struct socket_message * result) {
+	int addrsz = udp_address_size(s, slen);
+	if (addrsz == 0)
+		return -1;
+	uint8_t * data = MALLOC(n + addrsz);
+	gen_udp_address(s->protocol, sa, data + n);
+	memcpy(data, buffer, n);
 
 	result->opaque = s->opaque;
 	result->id = s->id;
@@ -1252,6 +2114,120 @@ forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lo
 	return SOCKET_UDP;
 }
 
+static int
+forward_udp_error(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	switch(errno) {
+	case EINTR:
+	case AGAIN_WOULDBLOCK:
+		break;
+	default:
+		// close when error
+		force_close(ss, s, l, result);
+		result->data = strerror(errno);
+		return SOCKET_ERR;
+	}
+	return -1;
+}
+
+#if UDP_BATCH > 1
+
+// pack the packages read by recvmmsg into one SOCKET_UDP_BATCH, see socket_server_udp_next
+static int
+forward_udp_batch(struct socket_server *ss, struct socket *s, int n, struct socket_message * result) {
+	int sz = 0;
+	int i;
+	for (i=0;i<n;i++) {
+		int addrsz = udp_address_size(s, ss->udp_slen[i]);
+		if (addrsz) {
+			sz += sizeof(int) + ss->udp_len[i] + addrsz;
+		}
+	}
+	if (sz == 0)
+		return -1;
+	uint8_t * data = MALLOC(sz);
+	uint8_t * ptr = data;
+	for (i=0;i<n;i++) {
+		if (udp_address_size(s, ss->udp_slen[i]) == 0)
+			continue;
+		int len = ss->udp_len[i];
+		memcpy(ptr, &len, sizeof(len));
+		ptr += sizeof(len);
+		memcpy(ptr, ss->udpbuffer[i], len);
+		ptr += len;
+		ptr += gen_udp_address(s->protocol, &ss->udp_sa[i], ptr);
+	}
+	assert(ptr == data + sz);
+
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = sz;
+	result->data = (char *)data;
+
+	return SOCKET_UDP_BATCH;
+}
+
+/*
+	Read at most UDP_BATCH packages by one recvmmsg, and keep them in socket_server.
+	Each package is still reported as one SOCKET_UDP, the next call returns the next pending package
+	of the same socket (udp_id) before reading again.
+	If the socket enables udp_batch, the packages are reported in one SOCKET_UDP_BATCH instead.
+ */
+static int
+forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	int i;
+	if (ss->udp_id != s->id || ss->udp_index >= ss->udp_n) {
+		struct mmsghdr msg[UDP_BATCH];
+		struct iovec iov[UDP_BATCH];
+		for (i=0;i<UDP_BATCH;i++) {
+			iov[i].iov_base = ss->udpbuffer[i];
+			iov[i].iov_len = MAX_UDP_PACKAGE;
+			memset(&msg[i], 0, sizeof(msg[i]));
+			msg[i].msg_hdr.msg_name = &ss->udp_sa[i].s;
+			msg[i].msg_hdr.msg_namelen = sizeof(ss->udp_sa[i]);
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+		}
+		ss->udp_n = 0;
+		int n = recvmmsg(s->fd, msg, UDP_BATCH, 0, NULL);
+		if (n<0) {
+			return forward_udp_error(ss, s, l, result);
+		}
+		for (i=0;i<n;i++) {
+			ss->udp_len[i] = msg[i].msg_len;
+			ss->udp_slen[i] = msg[i].msg_hdr.msg_namelen;
+		}
+		ss->udp_id = s->id;
+		ss->udp_n = n;
+		ss->udp_index = 0;
+		if (s->udp_batch && n > 1) {
+			ss->udp_index = n;
+			return forward_udp_batch(ss, s, n, result);
+		}
+	}
+	while (ss->udp_index < ss->udp_n) {
+		i = ss->udp_index++;
+		int type = forward_udp_package(s, ss->udpbuffer[i], ss->udp_len[i], &ss->udp_sa[i], ss->udp_slen[i], result);
+		if (type != -1)
+			return type;
+	}
+	return -1;
+}
+
+#else
+
+static int
+forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	union sockaddr_all sa;
+	socklen_t slen = sizeof(sa);
+	int n = recvfrom(s->fd, ss->udpbuffer[0],MAX_UDP_PACKAGE,0,&sa.s,&slen);
+	if (n<0) {
+		return forward_udp_error(ss, s, l, result);
+	}
+	return forward_udp_package(s, ss->udpbuffer[0], n, &sa, slen, result);
+}
+
+#endif
+
 static int
 report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	int error;
@@ -1269,6 +2245,9 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l
 		result->opaque = s->opaque;
 		result->id = s->id;
 		result->ud = 0;
+#ifdef USE_IO_URING
+		sp_mode(ss->event_fd, s->fd, SP_MODE_RECV);
+#endif
 		if (nomore_sending_data(s)) {
 			sp_write(ss->event_fd, s->fd, s, false);
 		}
@@ -1288,10 +2267,22 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l
 
 // return 0 when failed, or -1 when file limit
 static int
-report_accept(struct socket_server *ss, struct socket *s, struct socket_message *result) {
+report_accept(struct socket_server *ss, struct socket *s, struct event *e, struct socket_message *result) {
 	union sockaddr_all u;
 	socklen_t len = sizeof(u);
-	int client_fd = accept(s->fd, &u.s, &len);
+	int client_fd;
+#ifdef USE_IO_URING
+	if (e->op == SP_OP_ACCEPT) {
+		// accepted by io_uring, res is the new fd
+		client_fd = e->res;
+		if (client_fd < 0) {
+			errno = -client_fd;
+		} else if (getpeername(client_fd, &u.s, &len) != 0) {
+			u.s.sa_family = AF_UNSPEC;
+		}
+	} else
+#endif
+	client_fd = accept(s->fd, &u.s, &len);
 	if (client_fd < 0) {
 		if (errno == EMFILE || errno == ENFILE) {
 			result->opaque = s->opaque;
@@ -1342,8 +2333,8 @@ clear_closed_event(struct socket_server *ss, struct socket_message * result, int
 			struct socket *s = e->s;
 			if (s) {
 				if (s->type == SOCKET_TYPE_INVALID && s->id == id) {
+					// don't stop here, a completion backend (io_uring) may report more than one event of a socket
 					e->s = NULL;
-					break;
 				}
 			}
 		}
@@ -1389,11 +2380,50 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 		}
 		struct socket_lock l;
 		socket_lock_init(s, &l);
+		const char * err = NULL;
+#ifdef USE_IO_URING
+		if (e->op == SP_OP_SEND) {
+			int type = uring_sent(ss, s, &l, e->res, result);
+			if (type != -1)
+				return type;
+			if (s->uring_sending) {
+				// send the rest after the last one of the chain
+				continue;
+			}
+		}
+#endif
+#ifdef HAS_ZEROCOPY
+		if (e->error && s->zc_next != 0) {
+			// EPOLLERR may be raised by the zerocopy notifications in error queue, it's not an error if SO_ERROR is 0
+			zerocopy_complete(ss, s);
+			err = socket_error(s);
+			if (err == NULL) {
+				e->error = false;
+			}
+		}
+#endif
 		switch (s->type) {
+		case SOCKET_TYPE_ZCLOSING:
+#ifdef HAS_ZEROCOPY
+			zerocopy_complete(ss, s);
+#endif
+			if (!send_inflight(s)) {
+				struct socket_message dummy;
+				force_close(ss, s, &l, &dummy);
+			}
+			break;
 		case SOCKET_TYPE_CONNECTING:
+#ifdef USE_IO_URING
+			if (e->op == SP_OP_CONNECT && e->res < 0) {
+				// SO_ERROR is cleared by io_uring, report the result of IORING_OP_CONNECT
+				force_close(ss, s, &l, result);
+				result->data = strerror(-e->res);
+				return SOCKET_ERR;
+			}
+#endif
 			return report_connect(ss, s, &l, result);
 		case SOCKET_TYPE_LISTEN: {
-			int ok = report_accept(ss, s, result);
+			int ok = report_accept(ss, s, e, result);
 			if (ok > 0) {
 				return SOCKET_ACCEPT;
 			} if (ok < 0 ) {
@@ -1409,13 +2439,18 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 			if (e->read) {
 				int type;
 				if (s->protocol == PROTOCOL_TCP) {
+#ifdef USE_IO_URING
+					if (e->op == SP_OP_RECV)
+						type = forward_recv_tcp(ss, s, &l, e, result);
+					else
+#endif
 					type = forward_message_tcp(ss, s, &l, result);
 				} else {
 					type = forward_message_udp(ss, s, &l, result);
-					if (type == SOCKET_UDP) {
+					if (type == SOCKET_UDP || type == SOCKET_UDP_BATCH) {
 						// try read again
 						--ss->event_index;
-						return SOCKET_UDP;
+						return type;
 					}
 				}
 				if (e->write && type != SOCKET_CLOSE && type != SOCKET_ERR) {
@@ -1435,16 +2470,11 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 			}
 			if (e->error) {
 				// close when error
-				int error;
-				socklen_t len = sizeof(error);  
-				int code = getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &error, &len);  
-				const char * err = NULL;
-				if (code < 0) {
-					err = strerror(errno);
-				} else if (error != 0) {
-					err = strerror(error);
-				} else {
-					err = "Unknown error";
+				if (err == NULL) {
+					err = socket_error(s);
+					if (err == NULL) {
+						err = "Unknown error";
+					}
 				}
 				force_close(ss, s, &l, result);
 				result->data = (char *)err;
@@ -1518,7 +2548,8 @@ socket_server_send(struct socket_server *ss, int id, const void * buffer, int sz
 	struct socket_lock l;
 	socket_lock_init(s, &l);
 
-	if (can_direct_write(s,id) && socket_trylock(&l)) {
+	// large package on zerocopy socket should be sent by socket thread, see check_zerocopy()
+	if (!(s->zerocopy && sz >= ZEROCOPY_SIZE) && can_direct_write(s,id) && socket_trylock(&l)) {
 		// may be we can send directly, double check
 		if (can_direct_write(s,id)) {
 			// send directly
@@ -1586,6 +2617,33 @@ socket_server_send_lowpriority(struct socket_server *ss, int id, const void * bu
 	return 0;
 }
 
+// send [offset, offset+sz) of the file. socket server owns fd and close it after sending
+// return -1 when error, 0 when success
+int
+socket_server_sendfile(struct socket_server *ss, int id, int fd, int64_t offset, int sz) {
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->id != id || s->type == SOCKET_TYPE_INVALID) {
+		close(fd);
+		return -1;
+	}
+
+	inc_sending_ref(s, id);
+
+	struct request_package request;
+	request.u.sendfile.id = id;
+	request.u.sendfile.fd = fd;
+	request.u.sendfile.sz = sz;
+	request.u.sendfile.offset = offset;
+
+	send_request(ss, &request, 'F', sizeof(request.u.sendfile));
+	return 0;
+}
+
+const char *
+socket_server_backend() {
+	return SP_BACKEND;
+}
+
 void
 socket_server_exit(struct socket_server *ss) {
 	struct request_package request;
@@ -1614,7 +2672,7 @@ socket_server_shutdown(struct socket_server *ss, uintptr_t opaque, int id) {
 // return -1 means failed
 // or return AF_INET or AF_INET6
 static int
-do_bind(const char *host, int port, int protocol, int *family) {
+do_bind(const char *host, int port, int protocol, int *family, bool reuseport) {
 	int fd;
 	int status;
 	int reuse = 1;
@@ -1647,6 +2705,15 @@ do_bind(const char *host, int port, int protocol, int *family) {
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(int))==-1) {
 		goto _failed;
 	}
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(int))==-1) {
+			goto _failed;
+		}
+#else
+		goto _failed;
+#endif
+	}
 	status = bind(fd, (struct sockaddr *)ai_list->ai_addr, ai_list->ai_addrlen);
 	if (status != 0)
 		goto _failed;
@@ -1661,9 +2728,9 @@ _failed_fd:
 }
 
 static int
-do_listen(const char * host, int port, int backlog) {
+do_listen(const char * host, int port, int backlog, bool reuseport) {
 	int family = 0;
-	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family);
+	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family, reuseport);
 	if (listen_fd < 0) {
 		return -1;
 	}
@@ -1674,9 +2741,9 @@ do_listen(const char * host, int port, int backlog) {
 	return listen_fd;
 }
 
-int 
-socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
-	int fd = do_listen(addr, port, backlog);
+static int
+open_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog, bool reuseport) {
+	int fd = do_listen(addr, port, backlog, reuseport);
 	if (fd < 0) {
 		return -1;
 	}
@@ -1693,6 +2760,16 @@ socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * ad
 	return id;
 }
 
+int 
+socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+	return open_listen(ss, opaque, addr, port, backlog, false);
+}
+
+int
+socket_server_listen_reuseport(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+	return open_listen(ss, opaque, addr, port, backlog, true);
+}
+
 int
 socket_server_bind(struct socket_server *ss, uintptr_t opaque, int fd) {
 	struct request_package request;
@@ -1711,6 +2788,24 @@ socket_server_start(struct socket_server *ss, uintptr_t opaque, int id) {
 	struct request_package request;
 	request.u.start.id = id;
 	request.u.start.opaque = opaque;
+	request.u.start.format.type = 0;
+	request.u.start.target = 0;
+	request.u.start.ud = 0;
+	send_request(ss, &request, 'S', sizeof(request.u.start));
+}
+
+void
+socket_server_start_frame(struct socket_server *ss, uintptr_t opaque, int id, const struct frame_format *format, uintptr_t target, uintptr_t ud) {
+	struct request_package request;
+	request.u.start.id = id;
+	request.u.start.opaque = opaque;
+	if (format) {
+		request.u.start.format = *format;
+	} else {
+		request.u.start.format.type = 0;
+	}
+	request.u.start.target = target;
+	request.u.start.ud = ud;
 	send_request(ss, &request, 'S', sizeof(request.u.start));
 }
 
@@ -1723,6 +2818,36 @@ socket_server_nodelay(struct socket_server *ss, int id) {
 	send_request(ss, &request, 'T', sizeof(request.u.setopt));
 }
 
+void
+socket_server_watermark(struct socket_server *ss, int id, int64_t high, int64_t low, int64_t limit, int close) {
+	struct request_package request;
+	request.u.watermark.id = id;
+	request.u.watermark.high = high;
+	request.u.watermark.low = low < high ? low : high;
+	request.u.watermark.limit = limit;
+	request.u.watermark.policy = close ? LIMIT_CLOSE : LIMIT_DROP;
+	send_request(ss, &request, 'W', sizeof(request.u.watermark));
+}
+
+// the paused flag is written by socket thread, so it's only a hint for the sender
+int
+socket_server_paused(struct socket_server *ss, int id) {
+	struct socket * s = &ss->slot[HASH_ID(id)];
+	if (s->id != id || s->type == SOCKET_TYPE_INVALID) {
+		return 0;
+	}
+	return s->paused;
+}
+
+void
+socket_server_zerocopy(struct socket_server *ss, int id, int enable) {
+	struct request_package request;
+	request.u.setopt.id = id;
+	request.u.setopt.what = 0;
+	request.u.setopt.value = enable;
+	send_request(ss, &request, 'Z', sizeof(request.u.setopt));
+}
+
 void 
 socket_server_userobject(struct socket_server *ss, struct socket_object_interface *soi) {
 	ss->soi = *soi;
@@ -1730,13 +2855,13 @@ socket_server_userobject(struct socket_server *ss, struct socket_object_interfac
 
 // UDP
 
-int 
-socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr, int port) {
+static int
+udp_socket(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int batch) {
 	int fd;
 	int family;
 	if (port != 0 || addr != NULL) {
 		// bind
-		fd = do_bind(addr, port, IPPROTO_UDP, &family);
+		fd = do_bind(addr, port, IPPROTO_UDP, &family, false);
 		if (fd < 0) {
 			return -1;
 		}
@@ -1759,11 +2884,22 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	request.u.udp.fd = fd;
 	request.u.udp.opaque = opaque;
 	request.u.udp.family = family;
+	request.u.udp.batch = batch;
 
 	send_request(ss, &request, 'U', sizeof(request.u.udp));	
 	return id;
 }
 
+int 
+socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr, int port) {
+	return udp_socket(ss, opaque, addr, port, 0);
+}
+
+int
+socket_server_udp_batch(struct socket_server *ss, uintptr_t opaque, const char * addr, int port) {
+	return udp_socket(ss, opaque, addr, port, 1);
+}
+
 int 
 socket_server_udp_send(struct socket_server *ss, int id, const struct socket_udp_address *addr, const void *buffer, int sz) {
 	struct socket * s = &ss->slot[HASH_ID(id)];
@@ -1888,3 +3024,36 @@ socket_server_udp_address(struct socket_server *ss, struct socket_message *msg,
 	}
 	return (const struct socket_udp_address *)address;
 }
+
+const char *
+socket_server_udp_next(const char * data, int sz, int *offset, int *size, const struct socket_udp_address **addr, int *addrsz) {
+	int off = *offset;
+	if (off + (int)sizeof(int) > sz)
+		return NULL;
+	int len;
+	memcpy(&len, data + off, sizeof(len));
+	off += sizeof(len);
+	if (len < 0 || len >= sz - off)
+		return NULL;
+	const char * package = data + off;
+	off += len;
+	const uint8_t * address = (const uint8_t *)(data + off);
+	int n;
+	switch(address[0]) {
+	case PROTOCOL_UDP:
+		n = 1+2+4;
+		break;
+	case PROTOCOL_UDPv6:
+		n = 1+2+16;
+		break;
+	default:
+		return NULL;
+	}
+	if (off + n > sz)
+		return NULL;
+	*offset = off + n;
+	*size = len;
+	*addr = (const struct socket_udp_address *)address;
+	*addrsz = n;
+	return package;
+}
@@ -11,6 +11,10 @@
 #define SOCKET_EXIT 5
 #define SOCKET_UDP 6
 #define SOCKET_WARNING 7
+#define SOCKET_PAUSE 8
+#define SOCKET_RESUME 9
+#define SOCKET_UDP_BATCH 10
+#define SOCKET_FRAME 11
 
 struct socket_server;
 
@@ -21,32 +25,63 @@ struct socket_message {
 	char * data;
 };
 
+// SOCKET_FRAME carries the packages split in socket thread (see socket_server_start_frame),
+// data is a struct socket_frame_list, ud is the number of packages, opaque is the target.
+struct socket_frame {
+	char * buffer;
+	int size;
+};
+
+struct socket_frame_list {
+	uintptr_t ud;
+	int n;
+	struct socket_frame frame[];
+};
+
 struct socket_server * socket_server_create();
 void socket_server_release(struct socket_server *);
 int socket_server_poll(struct socket_server *, struct socket_message *result, int *more);
 
 void socket_server_exit(struct socket_server *);
+// the name of the poll backend (epoll, kqueue or io_uring)
+const char * socket_server_backend();
 void socket_server_close(struct socket_server *, uintptr_t opaque, int id);
 void socket_server_shutdown(struct socket_server *, uintptr_t opaque, int id);
 void socket_server_start(struct socket_server *, uintptr_t opaque, int id);
+// start the socket, and split the data into packages by the length header (see frame_header.h) in socket thread.
+// The packages are reported by SOCKET_FRAME to target instead of SOCKET_DATA, the other messages still go to opaque.
+struct frame_format;
+void socket_server_start_frame(struct socket_server *, uintptr_t opaque, int id, const struct frame_format *format, uintptr_t target, uintptr_t ud);
 
 // return -1 when error
 int socket_server_send(struct socket_server *, int id, const void * buffer, int sz);
 int socket_server_send_lowpriority(struct socket_server *, int id, const void * buffer, int sz);
+// send a region of file fd, socket server owns the fd (close it after sending). sz is an int, split a larger region (see lsendfile)
+int socket_server_sendfile(struct socket_server *, int id, int fd, int64_t offset, int sz);
 
 // ctrl command below returns id
 int socket_server_listen(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
+// listen with SO_REUSEPORT, more than one listen socket can bind the same address, the kernel balances accepts among them
+int socket_server_listen_reuseport(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
 int socket_server_connect(struct socket_server *, uintptr_t opaque, const char * addr, int port);
 int socket_server_bind(struct socket_server *, uintptr_t opaque, int fd);
 
 // for tcp
 void socket_server_nodelay(struct socket_server *, int id);
+// report SOCKET_PAUSE when the send buffer reaches high, and SOCKET_RESUME when it drains to low. high == 0 disable it.
+// if limit > 0, the package which makes the send buffer exceed limit would be dropped, or close the socket if close != 0
+void socket_server_watermark(struct socket_server *, int id, int64_t high, int64_t low, int64_t limit, int close);
+int socket_server_paused(struct socket_server *, int id);
+// send large package (>= 16K) with MSG_ZEROCOPY, linux 4.14+ only
+void socket_server_zerocopy(struct socket_server *, int id, int enable);
 
 struct socket_udp_address;
 
 // create an udp socket handle, attach opaque with it . udp socket don't need call socket_server_start to recv message
 // if port != 0, bind the socket . if addr == NULL, bind ipv4 0.0.0.0 . If you want to use ipv6, addr can be "::" and port 0.
 int socket_server_udp(struct socket_server *, uintptr_t opaque, const char * addr, int port);
+// the same as socket_server_udp, but the packages read together (by one recvmmsg on linux) are reported in one SOCKET_UDP_BATCH
+int socket_server_udp_batch(struct socket_server *, uintptr_t opaque, const char * addr, int port);
 // set default dest address, return 0 when success
 int socket_server_udp_connect(struct socket_server *, int id, const char * addr, int port);
 // If the socket_udp_address is NULL, use last call socket_server_udp_connect address instead
@@ -54,6 +89,10 @@ int socket_server_udp_connect(struct socket_server *, int id, const char * addr,
 int socket_server_udp_send(struct socket_server *, int id, const struct socket_udp_address *, const void *buffer, int sz);
 // extract the address of the message, struct socket_message * should be SOCKET_UDP
 const struct socket_udp_address * socket_server_udp_address(struct socket_server *, struct socket_message *, int *addrsz);
+// SOCKET_UDP_BATCH carries more than one udp package in data (ud is the size of data), each package is :
+//	int size, package (size bytes), udp address
+// iterate them from offset 0, return NULL at the end
+const char * socket_server_udp_next(const char * data, int sz, int *offset, int *size, const struct socket_udp_address **addr, int *addrsz);
 
 struct socket_object_interface {
 	void * (*buffer)(void *);
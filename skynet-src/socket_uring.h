@@ -0,0 +1,781 @@
+#ifndef poll_socket_uring_h
+#define poll_socket_uring_h
+
+/*
+	io_uring backend for socket_poll.h (build with -DUSE_IO_URING, linux 5.19+)
+
+	The tcp sockets are driven by completions instead of readiness :
+
+	SP_MODE_RECV (connected tcp, see sp_mode) : one IORING_OP_RECV is kept armed while reading is
+	enabled. It picks a buffer from the buffer ring registered with IORING_REGISTER_PBUF_RING, and
+	the event carries the data (op SP_OP_RECV, data and res). The buffer goes back to the ring at
+	the beginning of the next sp_wait, so socket_server consumes it before polling again.
+	If the ring is empty (ENOBUFS), a readiness event is reported and socket_server reads the socket.
+
+	SP_MODE_ACCEPT (listen socket) : one IORING_OP_ACCEPT is kept armed, res of SP_OP_ACCEPT is the new fd.
+
+	sp_connect submits IORING_OP_CONNECT (SP_OP_CONNECT), and the socket is in SP_MODE_RECV after it.
+
+	sp_send queues a chain of linked IORING_OP_SEND (MSG_WAITALL, so only an error breaks the chain),
+	each send reports an SP_OP_SEND event in order. They are submitted by the io_uring_enter of the
+	next sp_wait, so the sends of all the sockets queued by send_list_tcp in a round go in one syscall.
+
+	SP_MODE_POLL (default : udp, pipe, bind fd, kernels without buffer ring) : a oneshot
+	IORING_OP_POLL_ADD re-armed after each event, like a level-triggered epoll. The sockets in the
+	other modes use a poll only for the write readiness (POLLOUT) when no send is in flight.
+
+	The slots to (re-)arm are linked in a list through the slot table, and all of them are armed
+	at the beginning of the next sp_wait, submitted with the same io_uring_enter that waits.
+
+	user_data is (gen << 32 | op << 28 | fd). gen is the seq of the slot (bumped by sp_del), or
+	pseq for the poll (bumped when the poll is replaced), so stale completions are dropped.
+
+	sp_write may be called from worker threads (direct write), so the submission queue and the fd
+	table are guarded by a spinlock. Only the socket thread reaps the completion queue.
+ */
+
+#include <netdb.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+
+#include "spinlock.h"
+
+#define SP_BACKEND "io_uring (experimental)"
+
+#define SP_OP_POLL 0
+#define SP_OP_RECV 1
+#define SP_OP_ACCEPT 2
+#define SP_OP_CONNECT 3
+#define SP_OP_SEND 4
+
+#define SP_MODE_POLL 0
+#define SP_MODE_RECV 1
+#define SP_MODE_ACCEPT 2
+
+#define URING_SQ_ENTRIES 4096
+#define URING_CQ_ENTRIES 65536
+// the recv buffer ring : URING_BUF_COUNT (power of 2) buffers of URING_BUF_SIZE bytes
+#define URING_BUF_COUNT 1024
+#define URING_BUF_SIZE 16384
+#define URING_BUF_GROUP 0
+#define URING_IGNORE (~(uint64_t)0)
+#define URING_FD_MASK 0x0fffffff
+#define URING_NIL (-1)
+
+struct uring_slot {
+	void * ud;
+	uint32_t seq;
+	uint32_t pseq;
+	uint32_t events;	// POLLIN / POLLOUT enabled by socket_server
+	uint32_t poll_mask;	// the events of the poll armed
+	int next;			// link of the update list
+	uint16_t sending;	// sends in flight
+	uint8_t used;
+	uint8_t mode;
+	uint8_t polling;
+	uint8_t reading;	// recv or accept in flight (maybe canceling)
+	uint8_t canceling;
+	uint8_t connecting;
+	uint8_t queued;
+};
+
+struct uring_poll {
+	int fd;
+	struct spinlock lock;
+	void * sq_ptr;
+	size_t sq_sz;
+	void * cq_ptr;
+	size_t cq_sz;
+	struct io_uring_sqe * sqes;
+	size_t sqes_sz;
+	unsigned * sq_head;
+	unsigned * sq_tail;
+	unsigned * sq_mask;
+	unsigned * sq_array;
+	unsigned * cq_head;
+	unsigned * cq_tail;
+	unsigned * cq_mask;
+	struct io_uring_cqe * cqes;
+	unsigned sq_entries;
+	int slot_cap;
+	struct uring_slot * slot;
+	int update;			// head of the update list
+	struct io_uring_buf_ring * br;	// NULL if the kernel can't register a buffer ring
+	size_t br_sz;
+	char * buf;
+	uint16_t br_tail;
+	int lent_n;			// the buffers reported by the last sp_wait
+	uint16_t lent[URING_BUF_COUNT];
+};
+
+// socket_server creates only one event pool
+static struct uring_poll * URING = NULL;
+
+static inline int
+uring_setup(unsigned entries, struct io_uring_params *p) {
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int
+uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline int
+uring_register(int fd, unsigned opcode, void *arg, unsigned nr) {
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+static bool
+sp_invalid(int efd) {
+	return efd == -1;
+}
+
+static void
+uring_free(struct uring_poll *u) {
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_sz);
+	if (u->cq_ptr && u->cq_ptr != u->sq_ptr)
+		munmap(u->cq_ptr, u->cq_sz);
+	if (u->sq_ptr)
+		munmap(u->sq_ptr, u->sq_sz);
+	if (u->fd >= 0)
+		close(u->fd);
+	if (u->br)
+		munmap(u->br, u->br_sz);
+	free(u->buf);
+	free(u->slot);
+	free(u);
+}
+
+static inline void
+uring_buf_add(struct uring_poll *u, uint16_t bid) {
+	struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUF_COUNT - 1)];
+	b->addr = (uint64_t)(uintptr_t)(u->buf + (size_t)bid * URING_BUF_SIZE);
+	b->len = URING_BUF_SIZE;
+	b->bid = bid;
+	++u->br_tail;
+}
+
+static inline void
+uring_buf_publish(struct uring_poll *u) {
+	__atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+// register the recv buffer ring, keep u->br NULL (all the sockets in SP_MODE_POLL) if failed
+static void
+uring_buf_init(struct uring_poll *u) {
+	size_t sz = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+	void * br = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (br == MAP_FAILED)
+		return;
+	char * buf = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+	if (buf == NULL) {
+		munmap(br, sz);
+		return;
+	}
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)br;
+	reg.ring_entries = URING_BUF_COUNT;
+	reg.bgid = URING_BUF_GROUP;
+	if (uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		fprintf(stderr, "socket-server: io_uring buffer ring unavailable (%s), read by poll.\n", strerror(errno));
+		free(buf);
+		munmap(br, sz);
+		return;
+	}
+	u->br = br;
+	u->br_sz = sz;
+	u->buf = buf;
+	int i;
+	for (i=0;i<URING_BUF_COUNT;i++) {
+		uring_buf_add(u, i);
+	}
+	uring_buf_publish(u);
+}
+
+static int
+sp_create() {
+	if (URING)
+		return -1;
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_CQ_ENTRIES;
+	struct uring_poll *u = malloc(sizeof(*u));
+	memset(u, 0, sizeof(*u));
+	u->update = URING_NIL;
+	u->fd = uring_setup(URING_SQ_ENTRIES, &p);
+	if (u->fd < 0) {
+		uring_free(u);
+		return -1;
+	}
+	u->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_sz > u->sq_sz)
+			u->sq_sz = u->cq_sz;
+		u->cq_sz = u->sq_sz;
+	}
+	u->sq_ptr = mmap(NULL, u->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ptr == MAP_FAILED) {
+		u->sq_ptr = NULL;
+		uring_free(u);
+		return -1;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ptr = u->sq_ptr;
+	} else {
+		u->cq_ptr = mmap(NULL, u->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (u->cq_ptr == MAP_FAILED) {
+			u->cq_ptr = NULL;
+			uring_free(u);
+			return -1;
+		}
+	}
+	u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		uring_free(u);
+		return -1;
+	}
+	char * sq = u->sq_ptr;
+	char * cq = u->cq_ptr;
+	u->sq_head = (unsigned *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	u->sq_entries = p.sq_entries;
+	uring_buf_init(u);
+	spinlock_init(&u->lock);
+	URING = u;
+	return u->fd;
+}
+
+static void
+sp_release(int efd) {
+	struct uring_poll *u = URING;
+	if (u == NULL || u->fd != efd) {
+		close(efd);
+		return;
+	}
+	spinlock_destroy(&u->lock);
+	uring_free(u);
+	URING = NULL;
+}
+
+// the kernel moves sq_head when it consumes sqes, so the count is right even if another thread submits.
+static inline unsigned
+uring_unsubmitted(struct uring_poll *u) {
+	return *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+}
+
+// submit all the queued sqes, call with lock
+static void
+uring_flush(struct uring_poll *u) {
+	unsigned n;
+	while ((n = uring_unsubmitted(u)) > 0) {
+		if (uring_enter(u->fd, n, 0, 0) < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			fprintf(stderr, "socket-server: io_uring submit error %s.\n", strerror(errno));
+			return;
+		}
+	}
+}
+
+// make room for n sqes (a chain of links can't be split by a submission), call with lock
+static inline void
+uring_room(struct uring_poll *u, unsigned n) {
+	if (uring_unsubmitted(u) + n > u->sq_entries) {
+		uring_flush(u);
+	}
+}
+
+// call with lock
+static struct io_uring_sqe *
+uring_sqe(struct uring_poll *u) {
+	uring_room(u, 1);
+	unsigned tail = *u->sq_tail;
+	unsigned index = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[index] = index;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+static inline uint64_t
+uring_userdata(int sock, int op, uint32_t gen) {
+	return (uint64_t)gen << 32 | (uint32_t)op << 28 | (uint32_t)sock;
+}
+
+static inline uint64_t
+uring_read_userdata(struct uring_slot *slot, int sock) {
+	return uring_userdata(sock, slot->mode == SP_MODE_ACCEPT ? SP_OP_ACCEPT : SP_OP_RECV, slot->seq);
+}
+
+// call with lock
+static void
+uring_cancel(struct uring_poll *u, uint64_t user_data) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = URING_IGNORE;
+}
+
+// call with lock
+static void
+uring_poll_remove(struct uring_poll *u, int sock) {
+	struct uring_slot *slot = &u->slot[sock];
+	if (slot->polling) {
+		struct io_uring_sqe *sqe = uring_sqe(u);
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = uring_userdata(sock, SP_OP_POLL, slot->pseq);
+		sqe->user_data = URING_IGNORE;
+		slot->polling = 0;
+	}
+	++slot->pseq;
+}
+
+// call with lock
+static void
+uring_arm_read(struct uring_poll *u, int sock) {
+	struct uring_slot *slot = &u->slot[sock];
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	sqe->fd = sock;
+	if (slot->mode == SP_MODE_ACCEPT) {
+		sqe->opcode = IORING_OP_ACCEPT;
+	} else {
+		sqe->opcode = IORING_OP_RECV;
+		sqe->len = URING_BUF_SIZE;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BUF_GROUP;
+	}
+	sqe->user_data = uring_read_userdata(slot, sock);
+	slot->reading = 1;
+	slot->canceling = 0;
+}
+
+// call with lock
+static void
+uring_arm_poll(struct uring_poll *u, int sock, uint32_t mask) {
+	struct uring_slot *slot = &u->slot[sock];
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = sock;
+	sqe->poll32_events = mask;
+	sqe->user_data = uring_userdata(sock, SP_OP_POLL, slot->pseq);
+	slot->polling = 1;
+	slot->poll_mask = mask;
+}
+
+// arm or cancel the operations of the slot to match its mode and events, call with lock
+static void
+uring_update(struct uring_poll *u, int sock) {
+	struct uring_slot *slot = &u->slot[sock];
+	if (!slot->used)
+		return;
+	if (slot->connecting) {
+		// wait for SP_OP_CONNECT
+		return;
+	}
+	if (slot->mode != SP_MODE_POLL && (slot->events & POLLIN)) {
+		if (!slot->reading) {
+			uring_arm_read(u, sock);
+		}
+	} else if (slot->reading && !slot->canceling) {
+		// the data received before the cancel is still reported
+		uring_cancel(u, uring_read_userdata(slot, sock));
+		slot->canceling = 1;
+	}
+	uint32_t mask = slot->events;
+	if (slot->mode != SP_MODE_POLL) {
+		mask &= POLLOUT;
+	}
+	if (slot->sending) {
+		// SP_OP_SEND reports the write
+		mask &= ~POLLOUT;
+	}
+	// the poll of SP_MODE_POLL is always armed to report the errors, even if mask is 0
+	bool polling = slot->mode == SP_MODE_POLL || mask != 0;
+	if (slot->polling && (!polling || slot->poll_mask != mask)) {
+		uring_poll_remove(u, sock);
+	}
+	if (polling && !slot->polling) {
+		uring_arm_poll(u, sock, mask);
+	}
+}
+
+// update the slot in the next sp_wait, call with lock
+static inline void
+uring_queue(struct uring_poll *u, int sock) {
+	struct uring_slot *slot = &u->slot[sock];
+	if (!slot->queued) {
+		slot->queued = 1;
+		slot->next = u->update;
+		u->update = sock;
+	}
+}
+
+// call with lock
+static void
+uring_update_all(struct uring_poll *u) {
+	int sock = u->update;
+	while (sock != URING_NIL) {
+		struct uring_slot *slot = &u->slot[sock];
+		int next = slot->next;
+		slot->queued = 0;
+		uring_update(u, sock);
+		sock = next;
+	}
+	u->update = URING_NIL;
+}
+
+static int
+uring_reserve(struct uring_poll *u, int sock) {
+	if (sock < u->slot_cap)
+		return 0;
+	if (sock > URING_FD_MASK)
+		return 1;
+	int cap = u->slot_cap == 0 ? 1024 : u->slot_cap;
+	while (cap <= sock)
+		cap *= 2;
+	struct uring_slot * slot = realloc(u->slot, cap * sizeof(*slot));
+	if (slot == NULL)
+		return 1;
+	memset(slot + u->slot_cap, 0, (cap - u->slot_cap) * sizeof(*slot));
+	u->slot = slot;
+	u->slot_cap = cap;
+	return 0;
+}
+
+static inline struct uring_slot *
+uring_slot(struct uring_poll *u, int sock) {
+	if (sock < u->slot_cap && u->slot[sock].used)
+		return &u->slot[sock];
+	return NULL;
+}
+
+// the socket thread only, the poll is armed in the next sp_wait
+static int
+sp_add(int efd, int sock, void *ud) {
+	struct uring_poll *u = URING;
+	spinlock_lock(&u->lock);
+	if (uring_reserve(u, sock)) {
+		spinlock_unlock(&u->lock);
+		return 1;
+	}
+	struct uring_slot *slot = &u->slot[sock];
+	if (slot->used) {
+		spinlock_unlock(&u->lock);
+		return 1;
+	}
+	slot->used = 1;
+	slot->ud = ud;
+	slot->events = POLLIN;
+	slot->mode = SP_MODE_POLL;
+	slot->polling = 0;
+	slot->reading = 0;
+	slot->canceling = 0;
+	slot->connecting = 0;
+	slot->sending = 0;
+	uring_queue(u, sock);
+	spinlock_unlock(&u->lock);
+	return 0;
+}
+
+static void
+sp_del(int efd, int sock) {
+	struct uring_poll *u = URING;
+	spinlock_lock(&u->lock);
+	struct uring_slot *slot = uring_slot(u, sock);
+	if (slot) {
+		uring_poll_remove(u, sock);
+		if (slot->reading && !slot->canceling) {
+			uring_cancel(u, uring_read_userdata(slot, sock));
+		}
+		if (slot->connecting) {
+			uring_cancel(u, uring_userdata(sock, SP_OP_CONNECT, slot->seq));
+		}
+		++slot->seq;
+		slot->used = 0;
+		slot->ud = NULL;
+		uring_flush(u);
+	}
+	spinlock_unlock(&u->lock);
+}
+
+static void
+sp_enable(int efd, int sock, void *ud, bool read_enable, bool write_enable) {
+	struct uring_poll *u = URING;
+	uint32_t events = (read_enable ? POLLIN : 0) | (write_enable ? POLLOUT : 0);
+	spinlock_lock(&u->lock);
+	struct uring_slot *slot = uring_slot(u, sock);
+	if (slot) {
+		slot->ud = ud;
+		if (slot->events != events) {
+			slot->events = events;
+			uring_update(u, sock);
+			uring_flush(u);
+		}
+	}
+	spinlock_unlock(&u->lock);
+}
+
+static void
+sp_write(int efd, int sock, void *ud, bool enable) {
+	sp_enable(efd, sock, ud, true, enable);
+}
+
+// the socket thread only, set the mode of a socket added by sp_add, return 1 if not supported (it's still SP_MODE_POLL)
+static int
+sp_mode(int efd, int sock, int mode) {
+	struct uring_poll *u = URING;
+	int r = 1;
+	spinlock_lock(&u->lock);
+	struct uring_slot *slot = uring_slot(u, sock);
+	if (slot && (mode != SP_MODE_RECV || u->br)) {
+		if (slot->mode != mode) {
+			if (slot->reading && !slot->canceling) {
+				// the new read is armed after the completion of this one
+				uring_cancel(u, uring_read_userdata(slot, sock));
+				slot->canceling = 1;
+			}
+			slot->mode = mode;
+			uring_queue(u, sock);
+		}
+		r = 0;
+	}
+	spinlock_unlock(&u->lock);
+	return r;
+}
+
+// the socket thread only, connect by IORING_OP_CONNECT (SP_OP_CONNECT).
+// addr is only used in this call, the sqe is submitted at once.
+static int
+sp_connect(int efd, int sock, const struct sockaddr *addr, socklen_t len) {
+	struct uring_poll *u = URING;
+	spinlock_lock(&u->lock);
+	struct uring_slot *slot = uring_slot(u, sock);
+	if (slot == NULL) {
+		spinlock_unlock(&u->lock);
+		return 1;
+	}
+	uring_poll_remove(u, sock);
+	slot->mode = u->br ? SP_MODE_RECV : SP_MODE_POLL;
+	slot->connecting = 1;
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	sqe->opcode = IORING_OP_CONNECT;
+	sqe->fd = sock;
+	sqe->addr = (uint64_t)(uintptr_t)addr;
+	sqe->off = len;
+	sqe->user_data = uring_userdata(sock, SP_OP_CONNECT, slot->seq);
+	uring_flush(u);
+	spinlock_unlock(&u->lock);
+	return 0;
+}
+
+// the socket thread only, queue the linked sends of n buffers (kept by the caller until SP_OP_SEND of each).
+// they are submitted in the next sp_wait, return 1 if failed.
+// It needs the same kernel (5.19+) as the buffer ring, the older ones may not stop the chain after a short send.
+static int
+sp_send(int efd, int sock, const struct iovec *v, int n) {
+	struct uring_poll *u = URING;
+	spinlock_lock(&u->lock);
+	struct uring_slot *slot = uring_slot(u, sock);
+	if (slot == NULL || slot->connecting || u->br == NULL) {
+		spinlock_unlock(&u->lock);
+		return 1;
+	}
+	uring_room(u, n);
+	int i;
+	for (i=0;i<n;i++) {
+		struct io_uring_sqe *sqe = uring_sqe(u);
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = sock;
+		sqe->addr = (uint64_t)(uintptr_t)v[i].iov_base;
+		sqe->len = v[i].iov_len;
+		sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+		if (i < n-1) {
+			sqe->flags = IOSQE_IO_LINK;
+		}
+		sqe->user_data = uring_userdata(sock, SP_OP_SEND, slot->seq);
+	}
+	slot->sending += n;
+	uring_update(u, sock);
+	spinlock_unlock(&u->lock);
+	return 0;
+}
+
+// give the buffers reported by the last sp_wait back to the ring, call with lock
+static void
+uring_recycle(struct uring_poll *u) {
+	if (u->lent_n > 0) {
+		int i;
+		for (i=0;i<u->lent_n;i++) {
+			uring_buf_add(u, u->lent[i]);
+		}
+		u->lent_n = 0;
+		uring_buf_publish(u);
+	}
+}
+
+// drop the completion of a removed socket (or a canceled operation), call with lock
+static void
+uring_drop(struct uring_poll *u, int op, int res, int bid) {
+	if (bid >= 0) {
+		uring_buf_add(u, bid);
+		uring_buf_publish(u);
+	} else if (op == SP_OP_ACCEPT && res >= 0) {
+		close(res);
+	}
+}
+
+// convert a cqe to an event, return false if it's dropped. call with lock
+static bool
+uring_event(struct uring_poll *u, struct io_uring_cqe *cqe, struct event *e) {
+	uint64_t ud = cqe->user_data;
+	if (ud == URING_IGNORE)
+		return false;
+	int sock = (int)(ud & URING_FD_MASK);
+	int op = (int)(ud >> 28) & 0xf;
+	uint32_t gen = (uint32_t)(ud >> 32);
+	int res = cqe->res;
+	int bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+	struct uring_slot *slot = uring_slot(u, sock);
+	if (slot == NULL || gen != (op == SP_OP_POLL ? slot->pseq : slot->seq)) {
+		uring_drop(u, op, res, bid);
+		return false;
+	}
+	e->s = slot->ud;
+	e->op = op;
+	e->res = res;
+	e->data = NULL;
+	e->read = false;
+	e->write = false;
+	e->error = false;
+	uring_queue(u, sock);
+	switch (op) {
+	case SP_OP_POLL:
+		slot->polling = 0;
+		if (res == -ECANCELED)
+			return false;
+		if (res < 0)
+			res = POLLERR;
+		if (slot->mode == SP_MODE_POLL) {
+			e->read = (res & (POLLIN | POLLHUP)) != 0;
+			e->write = (res & POLLOUT) != 0;
+		} else {
+			// only POLLOUT is polled, the hangup is reported by the recv. try to send (and turn off the poll) if it hangs up
+			e->write = (res & (POLLOUT | POLLHUP | POLLERR)) != 0;
+		}
+		e->error = (res & POLLERR) != 0;
+		return true;
+	case SP_OP_RECV:
+	case SP_OP_ACCEPT:
+		slot->reading = 0;
+		slot->canceling = 0;
+		if (res == -ECANCELED || res == -EAGAIN || res == -EINTR) {
+			uring_drop(u, SP_OP_RECV, res, bid);
+			return false;
+		}
+		e->read = true;
+		if (op == SP_OP_RECV) {
+			if (res == -ENOBUFS) {
+				// the buffer ring is empty, read it by socket_server
+				e->op = SP_OP_POLL;
+			} else if (bid >= 0) {
+				e->data = u->buf + (size_t)bid * URING_BUF_SIZE;
+				u->lent[u->lent_n++] = bid;
+			}
+		}
+		return true;
+	case SP_OP_CONNECT:
+		slot->connecting = 0;
+		e->write = true;
+		return true;
+	case SP_OP_SEND:
+		// report every send (even canceled), socket_server counts them
+		--slot->sending;
+		e->write = true;
+		return true;
+	}
+	return false;
+}
+
+static int
+sp_wait(int efd, struct event *e, int max) {
+	struct uring_poll *u = URING;
+	int n = 0;
+	while (n == 0) {
+		spinlock_lock(&u->lock);
+		uring_recycle(u);
+		uring_update_all(u);
+		unsigned to_submit = uring_unsubmitted(u);
+		spinlock_unlock(&u->lock);
+
+		unsigned head = *u->cq_head;
+		if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			if (uring_enter(u->fd, to_submit, 1, IORING_ENTER_GETEVENTS) < 0) {
+				if (errno == EINTR)
+					return -1;
+				if (errno != EAGAIN && errno != EBUSY) {
+					return -1;
+				}
+			}
+		} else if (to_submit > 0) {
+			uring_enter(u->fd, to_submit, 0, 0);
+		}
+
+		spinlock_lock(&u->lock);
+		head = *u->cq_head;
+		unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		unsigned mask = *u->cq_mask;
+		while (head != tail && n < max) {
+			struct io_uring_cqe *cqe = &u->cqes[head & mask];
+			++head;
+			if (uring_event(u, cqe, &e[n])) {
+				++n;
+			}
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+		spinlock_unlock(&u->lock);
+	}
+
+	return n;
+}
+
+static void
+sp_nonblocking(int fd) {
+	int flag = fcntl(fd, F_GETFL, 0);
+	if ( -1 == flag ) {
+		return;
+	}
+
+	fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+}
+
+#endif
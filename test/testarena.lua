@@ -0,0 +1,63 @@
+-- the lua service with arena (lua_arena = true), and the arena line of launcher MEM command.
+-- lua_arena is set by this test if the config doesn't set it, it's effective for the services launched after.
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "worker" then
+
+local arena = require "skynet.arena"
+
+local cache = {}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_, _, cmd)
+		if cmd == "fill" then
+			for i = 1, 10000 do
+				cache[i] = { i, tostring(i) }
+			end
+			-- free a half, the slots are kept in the freelists of arena
+			for i = 1, 10000, 2 do
+				cache[i] = nil
+			end
+			collectgarbage "collect"
+			skynet.ret(skynet.pack(arena.stat()))
+		else
+			skynet.ret()
+			skynet.exit()
+		end
+	end)
+end)
+
+else
+
+local function memline(list, addr)
+	local line = assert(list[skynet.address(addr)], "no service in MEM")
+	local reserved, frag = line:match "arena ([%d%.]+) Kb, fragmentation ([%d%.]+)%%"
+	return line, tonumber(reserved), tonumber(frag)
+end
+
+skynet.start(function()
+	if skynet.getenv "lua_arena" == nil then
+		skynet.setenv("lua_arena", "true")
+	end
+	assert(skynet.getenv "lua_arena" == "true", "lua_arena is disabled in config")
+	local worker = skynet.newservice(SERVICE_NAME, "worker")
+	local reserved, used, request, large = skynet.call(worker, "lua", "fill")
+	assert(reserved > 0 and used <= reserved and request <= used, "arena stat")
+	assert(large >= 0)
+	local list = skynet.call(".launcher", "lua", "MEM")
+	local line, kb, frag = memline(list, worker)
+	assert(kb and frag, line)
+	assert(math.abs(kb - reserved / 1024) < 0.01, line)
+	-- the freed slots (a half of objects) count as fragmentation
+	assert(frag > 0 and frag < 100, line)
+	print(line)
+	-- the services launched before lua_arena is set have no arena
+	assert(select(2, memline(list, skynet.self())) == nil)
+	skynet.call(worker, "lua", "exit")
+	print("arena ok")
+	skynet.exit()
+end)
+
+end
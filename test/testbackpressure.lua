@@ -0,0 +1,47 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local HOST = "127.0.0.1"
+local PORT = 8013
+local PACKAGE = string.rep("x", 16 * 1024)
+local COUNT = 1024
+
+local function server(id)
+	socket.start(id)
+	socket.watermark(id, 512 * 1024, 64 * 1024)
+	socket.onpause(id, function(id, paused, size)
+		print("socket", id, paused and "pause" or "resume", size .. "K")
+	end)
+	for i = 1, COUNT do
+		-- throttle the sender
+		if not socket.writable(id) then
+			break
+		end
+		socket.write(id, PACKAGE)
+	end
+	socket.close(id)
+end
+
+skynet.start(function()
+	local listen_id = socket.listen(HOST, PORT)
+	socket.start(listen_id, function(id)
+		skynet.fork(server, id)
+	end)
+
+	local id = assert(socket.open(HOST, PORT))
+	-- slow client
+	skynet.sleep(50)
+	local total = 0
+	while true do
+		local str = socket.read(id)
+		if not str then
+			break
+		end
+		total = total + #str
+	end
+	assert(total == #PACKAGE * COUNT, total)
+	print("backpressure ok", total)
+	socket.close(id)
+	socket.close(listen_id)
+	skynet.exit()
+end)
@@ -0,0 +1,50 @@
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "sub" then
+
+local received = 0
+
+skynet.start(function()
+	skynet.dispatch("lua", function (_,_, cmd, ...)
+		if cmd == "hello" then
+			local data = ...
+			assert(data.text == "Hello World" and #data.list == 1000)
+			received = received + 1
+		elseif cmd == "count" then
+			skynet.ret(skynet.pack(received))
+		else
+			assert(cmd == "exit")
+			skynet.exit()
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local list = {}
+	for i=1,1000 do
+		list[i] = i
+	end
+	local subs = {}
+	for i=1,10 do
+		subs[i] = skynet.newservice(SERVICE_NAME, "sub")
+	end
+	for i=1,100 do
+		local n = skynet.broadcast(subs, "lua", "hello", { text = "Hello World", list = list })
+		assert(n == #subs)
+	end
+	for i, sub in ipairs(subs) do
+		local n = skynet.call(sub, "lua", "count")
+		print(skynet.address(sub), "received", n)
+		assert(n == 100)
+		skynet.send(sub, "lua", "exit")
+	end
+	-- an invalid address is skipped
+	assert(skynet.broadcast({ 0 }, "lua", "hello") == 0)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,204 @@
+-- serialization benchmark : skynet.pack (lua-seri), sproto, bson and cluster packing
+-- usage : testcodecbench [seconds per case] [codec] [payload]
+-- each case prints a machine readable line :
+--	CODECBENCH codec=... payload=... op=encode|decode ops=... bytes=... alloc=...
+-- ops is operations per second, bytes is the encoded size, alloc is lua heap bytes allocated per operation
+
+local skynet = require "skynet"
+local sproto = require "sproto"
+local bson = require "bson"
+local cluster = require "skynet.cluster.core"
+
+local seconds, only_codec, only_payload = ...
+seconds = tonumber(seconds) or 0.5
+
+local payloads = {}
+
+-- small rpc arguments
+payloads.small = { cmd = "call", session = 1, id = 1001, name = "skynet" }
+
+-- deep nested table
+do
+	local node
+	for i = 8, 1, -1 do
+		node = { value = i, name = "node" .. i, child = node }
+	end
+	payloads.nested = node
+end
+
+-- large array
+do
+	local list = {}
+	for i = 1, 10000 do
+		list[i] = i * 7
+	end
+	payloads.array = { list = list }
+end
+
+-- long string
+payloads.text = { text = string.rep("skynet", 64 * 1024 // 6) }
+
+local payload_names = { "small", "nested", "array", "text" }
+
+local sp = sproto.parse [[
+.small {
+	cmd 0 : string
+	session 1 : integer
+	id 2 : integer
+	name 3 : string
+}
+
+.nested {
+	value 0 : integer
+	name 1 : string
+	child 2 : nested
+}
+
+.array {
+	list 0 : *integer
+}
+
+.text {
+	text 0 : string
+}
+]]
+
+-- the packages begin with a WORD size header, which is stripped by the socket reader in clusterd
+local function cluster_decode(stream)
+	local large = {}
+	local offset = 1
+	while offset <= #stream do
+		local sz = string.unpack(">I2", stream, offset)
+		local _, _, msg, size = cluster.unpackrequest(stream:sub(offset + 2, offset + 1 + sz), large)
+		offset = offset + 2 + sz
+		if msg then
+			if size then
+				-- multi part request, received in a C buffer
+				local obj = skynet.unpack(msg, size)
+				skynet.trash(msg, size)
+				return obj
+			end
+			return skynet.unpack(msg)
+		end
+	end
+end
+
+local codecs = {
+	{
+		name = "luaseri",
+		encode = function(name, obj)
+			return skynet.packstring(obj)
+		end,
+		decode = function(name, str)
+			return skynet.unpack(str)
+		end,
+		size = function(str) return #str end,
+	},
+	{
+		name = "sproto",
+		encode = function(name, obj)
+			return sp:encode(name, obj)
+		end,
+		decode = function(name, str)
+			return sp:decode(name, str)
+		end,
+		size = function(str) return #str end,
+	},
+	{
+		name = "sproto.pack",
+		encode = function(name, obj)
+			return sp:pencode(name, obj)
+		end,
+		decode = function(name, str)
+			return sp:pdecode(name, str)
+		end,
+		size = function(str) return #str end,
+	},
+	{
+		name = "bson",
+		encode = function(name, obj)
+			return bson.encode(obj)
+		end,
+		decode = function(name, b)
+			return bson.decode(b)
+		end,
+		size = function(b) return #tostring(b) end,
+	},
+	{
+		name = "cluster",
+		-- skynet.pack + cluster request framing
+		encode = function(name, obj)
+			local msg, sz = skynet.pack(obj)
+			local req, _, parts = cluster.packrequest(1, 1, msg, sz)
+			if parts then
+				-- multi part request, each part is a C buffer
+				local stream = { req }
+				for i = 1, #parts, 2 do
+					table.insert(stream, skynet.tostring(parts[i], parts[i+1]))
+					skynet.trash(parts[i], parts[i+1])
+				end
+				return table.concat(stream)
+			end
+			return req
+		end,
+		decode = function(name, stream)
+			return cluster_decode(stream)
+		end,
+		size = function(stream) return #stream end,
+	},
+}
+
+-- run f(arg1, arg2) repeatedly for about seconds (cpu time), return ops per second and lua heap bytes allocated per op
+local function measure(f, arg1, arg2)
+	f(arg1, arg2)	-- warm up
+	local n = 0
+	local batch = 1
+	local alloc = 0
+	local start = os.clock()
+	local elapsed
+	repeat
+		collectgarbage "collect"
+		collectgarbage "stop"
+		local mem = collectgarbage "count"
+		for i = 1, batch do
+			f(arg1, arg2)
+		end
+		alloc = alloc + (collectgarbage "count" - mem) * 1024
+		collectgarbage "restart"
+		n = n + batch
+		if batch < 256 then
+			batch = batch * 2
+		end
+		elapsed = os.clock() - start
+	until elapsed >= seconds
+	return n / elapsed, alloc / n
+end
+
+local function bench(codec, pname)
+	local obj = payloads[pname]
+	local ok, encoded = pcall(codec.encode, pname, obj)
+	if not ok then
+		print(string.format("CODECBENCH codec=%s payload=%s error=%q", codec.name, pname, encoded))
+		return
+	end
+	local bytes = codec.size(encoded)
+	local ops, alloc = measure(codec.encode, pname, obj)
+	print(string.format("CODECBENCH codec=%s payload=%s op=encode ops=%.0f bytes=%d alloc=%.0f",
+		codec.name, pname, ops, bytes, alloc))
+	ops, alloc = measure(codec.decode, pname, encoded)
+	print(string.format("CODECBENCH codec=%s payload=%s op=decode ops=%.0f bytes=%d alloc=%.0f",
+		codec.name, pname, ops, bytes, alloc))
+end
+
+skynet.start(function()
+	for _, codec in ipairs(codecs) do
+		if only_codec == nil or only_codec == codec.name then
+			for _, pname in ipairs(payload_names) do
+				if only_payload == nil or only_payload == pname then
+					bench(codec, pname)
+				end
+			end
+		end
+	end
+	skynet.exit()
+end)
@@ -0,0 +1,143 @@
+-- echo benchmark for the socket server backend (epoll or io_uring, see USE_IO_URING in Makefile)
+-- usage : testechobench [connections] [seconds] [package size] [client services]
+-- the echo server and the clients run in different services, so the clients are spread over the worker threads.
+-- build skynet twice (with and without -DUSE_IO_URING) and run the same arguments to compare the backends.
+-- raise ulimit -n before running with 10k connections (each connection uses 2 fd)
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local socketdriver = require "skynet.socketdriver"
+
+local mode = ...
+
+local HOST = "127.0.0.1"
+local PORT = 8011
+
+if mode == "server" then
+
+local function echo(id)
+	socket.start(id)
+	while true do
+		local str = socket.read(id)
+		if not str then
+			break
+		end
+		socket.write(id, str)
+	end
+	socket.close(id)
+end
+
+skynet.start(function()
+	local listen_id = socket.listen(HOST, PORT, 1024)
+	socket.start(listen_id, function(id)
+		skynet.fork(echo, id)
+	end)
+	skynet.dispatch("lua", function(_, _, cmd)
+		assert(cmd == "close")
+		socket.close(listen_id)
+		skynet.ret()
+	end)
+end)
+
+elseif mode == "client" then
+
+local running = true
+local total = 0
+local connected = 0
+
+local function client(package)
+	local id = socket.open(HOST, PORT)
+	if not id then
+		return
+	end
+	connected = connected + 1
+	while running do
+		socket.write(id, package)
+		if not socket.read(id, #package) then
+			break
+		end
+		total = total + 1
+	end
+	socket.close(id)
+end
+
+local command = {}
+
+function command.start(conns, size)
+	local package = string.rep("x", size)
+	for i = 1, conns do
+		skynet.fork(client, package)
+		if i % 256 == 0 then
+			-- let the socket thread accept the pending connections
+			skynet.yield()
+		end
+	end
+	skynet.ret()
+end
+
+function command.count()
+	skynet.ret(skynet.pack(connected, total))
+end
+
+function command.stop()
+	running = false
+	skynet.ret(skynet.pack(connected, total))
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_, _, cmd, ...)
+		command[cmd](...)
+	end)
+end)
+
+else
+
+local conns, seconds, size, nclient = ...
+conns = tonumber(conns) or 10000
+seconds = tonumber(seconds) or 10
+size = tonumber(size) or 64
+nclient = tonumber(nclient) or 4
+
+local function count(clients, cmd)
+	local connected, total = 0, 0
+	for _, c in ipairs(clients) do
+		local n, t = skynet.call(c, "lua", cmd)
+		connected = connected + n
+		total = total + t
+	end
+	return connected, total
+end
+
+skynet.start(function()
+	local backend = socketdriver.backend()
+	local server = skynet.newservice(SERVICE_NAME, "server")
+	local clients = {}
+	for i = 1, nclient do
+		local n = conns // nclient
+		if i <= conns % nclient then
+			n = n + 1
+		end
+		local c = skynet.newservice(SERVICE_NAME, "client")
+		skynet.call(c, "lua", "start", n, size)
+		clients[i] = c
+	end
+
+	local begin = skynet.now()
+	local last = 0
+	local connected, total
+	for i = 1, seconds do
+		skynet.sleep(100)
+		connected, total = count(clients, "count")
+		print(string.format("echo bench (%s) : %d s, %d connections, %d packages/s", backend, i, connected, total - last))
+		last = total
+	end
+	connected, total = count(clients, "stop")
+	local ti = (skynet.now() - begin) / 100
+	-- machine readable line
+	print(string.format("ECHOBENCH backend=%s conns=%d size=%d clients=%d seconds=%.2f packages=%d qps=%.0f",
+		backend:match "%S+", connected, size, nclient, ti, total, total / ti))
+	skynet.call(server, "lua", "close")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,117 @@
+-- gateserver with handler.batch (netpack.filterbatch), compare with handler.message, and the header formats (conf.header)
+local skynet = require "skynet"
+
+local mode = ...
+
+local HOST = "127.0.0.1"
+local PORT = 8017
+
+if mode == "batch" or mode == "message" then
+
+local gateserver = require "snax.gateserver"
+local netpack = require "skynet.netpack"
+
+local packages = {}
+local batches = 0
+local handler = {}
+
+function handler.connect(fd)
+	gateserver.openclient(fd)
+end
+
+if mode == "batch" then
+	function handler.batch(fd, batch)
+		batches = batches + 1
+		for _, msg, sz in netpack.frames(batch) do
+			table.insert(packages, skynet.tostring(msg, sz))
+		end
+	end
+else
+	function handler.message(fd, msg, sz)
+		table.insert(packages, netpack.tostring(msg, sz))
+	end
+end
+
+function handler.command(cmd)
+	assert(cmd == "packages")
+	return packages, batches
+end
+
+gateserver.start(handler)
+
+else
+
+local socket = require "skynet.socket"
+local netpack = require "skynet.netpack"
+
+local function test(mode, port, header)
+	local function package(str)
+		return netpack.tostring(netpack.packframe(header, str))
+	end
+	local gate = skynet.newservice(SERVICE_NAME, mode)
+	skynet.call(gate, "lua", "open", { address = HOST, port = port, header = header })
+	local fd = socket.open(HOST, port)
+	local expect = {}
+	for i = 1, 100 do
+		expect[i] = string.rep(string.char(i), i * 10)
+	end
+	-- the header of varint is 2 bytes, cut it below
+	expect[4] = string.rep(string.char(4), 400)
+	if header ~= "S" then
+		expect[100] = string.rep("x", 100000)
+	end
+	-- several packages in one write
+	socket.write(fd, package(expect[1]) .. package(expect[2]) .. package(expect[3]))
+	-- one package in several writes, cut in the header and in the body
+	local p = package(expect[4])
+	socket.write(fd, p:sub(1,1))
+	skynet.sleep(1)
+	socket.write(fd, p:sub(2,10))
+	skynet.sleep(1)
+	-- the rest of package 4 with the following packages, and an uncomplete tail
+	local tmp = { p:sub(11) }
+	for i = 5, 100 do
+		table.insert(tmp, package(expect[i]))
+	end
+	local str = table.concat(tmp)
+	socket.write(fd, str:sub(1, -5))
+	skynet.sleep(1)
+	socket.write(fd, str:sub(-4))
+	skynet.sleep(20)
+	local packages, batches = skynet.call(gate, "lua", "packages")
+	assert(#packages == #expect, #packages)
+	for i = 1, #expect do
+		assert(packages[i] == expect[i])
+	end
+	socket.close(fd)
+	skynet.call(gate, "lua", "close")
+	print(string.format("gateserver %s header = %s : %d packages, %d batches", mode, header, #packages, batches))
+end
+
+-- the package larger than max size closes the connection
+local function test_invalid(port)
+	local gate = skynet.newservice(SERVICE_NAME, "message")
+	skynet.call(gate, "lua", "open", { address = HOST, port = port, header = "V:1000" })
+	local fd = socket.open(HOST, port)
+	socket.write(fd, netpack.tostring(netpack.packframe("V", "hello")))
+	skynet.sleep(10)
+	socket.write(fd, netpack.tostring(netpack.packframe("V", string.rep("x", 2000))))
+	assert(not socket.read(fd))
+	socket.close(fd)
+	local packages = skynet.call(gate, "lua", "packages")
+	assert(#packages == 1 and packages[1] == "hello")
+	skynet.call(gate, "lua", "close")
+	print("gateserver invalid header : closed")
+end
+
+skynet.start(function()
+	test("message", PORT, "S")
+	test("batch", PORT + 1, "S")
+	test("message", PORT + 2, "V")
+	test("batch", PORT + 3, "V")
+	test("batch", PORT + 4, "l")
+	test_invalid(PORT + 5)
+	skynet.exit()
+end)
+
+end
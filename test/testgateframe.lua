@@ -0,0 +1,176 @@
+-- service gate with the packages split in socket thread (the 7th parameter of gate), compare with the normal mode
+-- and the other header formats (the 1st parameter of gate, see frame_header.h).
+-- The package cut by forward (a new agent) or broker (the packages go through gate again) must not be lost.
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.launch
+local socket = require "skynet.socket"
+
+local mode, frame = ...
+
+local HOST = "127.0.0.1"
+local PORT = 8013
+
+if mode == "agent" then
+
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	unpack = skynet.tostring,
+}
+
+local packages = {}
+local sources = {}
+
+skynet.start(function()
+	skynet.dispatch("client", function(_, source, msg)
+		table.insert(packages, msg)
+		sources[source] = true
+	end)
+	skynet.dispatch("lua", function()
+		skynet.ret(skynet.pack(packages, sources))
+		skynet.exit()
+	end)
+end)
+
+else
+
+skynet.register_protocol {
+	name = "text",
+	id = skynet.PTYPE_TEXT,
+	unpack = skynet.tostring,
+}
+
+local netpack = require "skynet.netpack"
+
+local function test(port, frame, header)
+	local function package(str)
+		return netpack.tostring(netpack.packframe(header, str))
+	end
+	local gate = skynet.launch("gate", header, skynet.address(skynet.self()), HOST .. ":" .. port, 0, 16, 0, frame)
+	local agent
+	local opened = false
+	skynet.dispatch("text", function(_,_, msg)
+		local fd, cmd = msg:match "(%d+) (%w+)"
+		if cmd == "open" then
+			agent = skynet.newservice(SERVICE_NAME, "agent")
+			skynet.rawsend(gate, "text", string.format("forward %s %s 0", fd, skynet.address(agent)))
+			skynet.rawsend(gate, "text", "start " .. fd)
+			opened = true
+		end
+	end)
+	local fd = socket.open(HOST, port)
+	while not opened do
+		skynet.sleep(1)
+	end
+	local expect = {}
+	for i = 1, 100 do
+		expect[i] = string.rep(string.char(i), i * 10)
+	end
+	-- the header of varint is 2 bytes, cut it below
+	expect[4] = string.rep(string.char(4), 400)
+	if header ~= "S" then
+		-- larger than 64K
+		expect[100] = string.rep("x", 100000)
+	end
+	-- several packages in one write
+	socket.write(fd, package(expect[1]) .. package(expect[2]) .. package(expect[3]))
+	-- one package in several writes, cut in the header and in the body
+	local p = package(expect[4])
+	socket.write(fd, p:sub(1,1))
+	skynet.sleep(1)
+	socket.write(fd, p:sub(2,10))
+	skynet.sleep(1)
+	socket.write(fd, p:sub(11))
+	local tmp = {}
+	for i = 5, 100 do
+		table.insert(tmp, package(expect[i]))
+	end
+	socket.write(fd, table.concat(tmp))
+	skynet.sleep(20)
+	local packages = skynet.call(agent, "lua")
+	assert(#packages == #expect, #packages)
+	for i = 1, #expect do
+		assert(packages[i] == expect[i])
+	end
+	socket.close(fd)
+	skynet.rawsend(gate, "text", "close")
+	skynet.kill(gate)
+	print(string.format("gate frame = %d header = %s : %d packages", frame, header, #packages))
+end
+
+local function test_switch(port, header, cut)
+	local function package(str)
+		return netpack.tostring(netpack.packframe(header, str))
+	end
+	local gate = skynet.launch("gate", header, skynet.address(skynet.self()), HOST .. ":" .. port, 0, 16, 0, 1)
+	local agent = {}
+	local client
+	skynet.dispatch("text", function(_,_, msg)
+		local fd, cmd = msg:match "(%d+) (%w+)"
+		if cmd == "open" then
+			agent[1] = skynet.newservice(SERVICE_NAME, "agent")
+			skynet.rawsend(gate, "text", string.format("forward %s %s 0", fd, skynet.address(agent[1])))
+			skynet.rawsend(gate, "text", "start " .. fd)
+			client = fd
+		end
+	end)
+	local fd = socket.open(HOST, port)
+	while not client do
+		skynet.sleep(1)
+	end
+	local expect = {}
+	for i = 1, 4 do
+		expect[i] = string.rep(string.char(i), 300 + i)
+	end
+	local p2 = package(expect[2])
+	local p3 = package(expect[3])
+	socket.write(fd, package(expect[1]) .. p2:sub(1, cut))
+	skynet.sleep(10)
+	-- forward to a new agent in the middle of the package
+	agent[2] = skynet.newservice(SERVICE_NAME, "agent")
+	skynet.rawsend(gate, "text", string.format("forward %s %s 0", client, skynet.address(agent[2])))
+	skynet.sleep(10)
+	socket.write(fd, p2:sub(cut + 1) .. p3:sub(1, cut))
+	skynet.sleep(10)
+	-- the broker takes the packages from gate, the partial package is handed back to gate
+	agent[3] = skynet.newservice(SERVICE_NAME, "agent")
+	skynet.rawsend(gate, "text", "broker " .. skynet.address(agent[3]))
+	skynet.sleep(10)
+	socket.write(fd, p3:sub(cut + 1) .. package(expect[4]))
+	skynet.sleep(10)
+	local result = {}
+	local sources = {}
+	for i = 1, 3 do
+		result[i], sources[i] = skynet.call(agent[i], "lua")
+	end
+	assert(#result[1] == 1 and result[1][1] == expect[1])
+	assert(#result[2] == 1 and result[2][1] == expect[2])
+	-- the packages split in socket thread come from the client of forward (0)
+	assert(next(sources[1]) == 0 and next(sources[2]) == 0)
+	assert(#result[3] == 2 and result[3][1] == expect[3] and result[3][2] == expect[4])
+	socket.close(fd)
+	skynet.rawsend(gate, "text", "close")
+	skynet.kill(gate)
+	print(string.format("gate frame switch header = %s cut = %d ok", header, cut))
+end
+
+skynet.start(function()
+	local cases = {
+		{ 0, "S" },
+		{ 1, "S" },
+		{ 0, "V" },
+		{ 1, "V" },
+		{ 0, "l" },
+		{ 1, "L:200000" },
+	}
+	for i, c in ipairs(cases) do
+		test(PORT + i - 1, c[1], c[2])
+	end
+	-- cut in the header, and in the body
+	test_switch(PORT + #cases, "V", 1)
+	test_switch(PORT + #cases + 1, "S", 100)
+	test_switch(PORT + #cases + 2, "L", 3)
+	skynet.exit()
+end)
+
+end
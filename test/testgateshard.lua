@@ -0,0 +1,114 @@
+-- service gate with 4 workers (the 8th parameter of gate), the front gate routes the connections by socket id,
+-- and closes the new connections beyond max (the 5th parameter of gate) of all workers
+local skynet = require "skynet"
+require "skynet.manager"	-- import skynet.launch
+local socket = require "skynet.socket"
+
+local mode, gate = ...
+
+local HOST = "127.0.0.1"
+local PORT = 8015
+local CONN = 16
+
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	pack = function(...) return ... end,
+	unpack = skynet.tostring,
+}
+
+skynet.register_protocol {
+	name = "text",
+	id = skynet.PTYPE_TEXT,
+	unpack = skynet.tostring,
+}
+
+if mode == "agent" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, fd)
+		-- echo the packages by gate
+		skynet.dispatch("client", function(_,_, msg)
+			skynet.send(gate, "client", string.pack(">s2", msg) .. string.pack("<I4", fd))
+		end)
+		skynet.ret()
+	end)
+end)
+
+else
+
+local function test(frame)
+	-- max is CONN, the workers are not balanced exactly, but none of them should reject a connection under max
+	local gate = skynet.launch("gate", "S", skynet.address(skynet.self()), HOST .. ":" .. (PORT + frame), 0, CONN, 0, frame, 4)
+	local opened = 0
+	local closed = 0
+	local owners = {}
+	skynet.dispatch("text", function(_, source, msg)
+		local fd, cmd = msg:match "(%d+) (%w+)"
+		if cmd == "open" then
+			owners[source] = true
+			local agent = skynet.newservice(SERVICE_NAME, "agent", skynet.address(gate))
+			skynet.call(agent, "lua", tonumber(fd))
+			skynet.rawsend(gate, "text", string.format("forward %s %s 0", fd, skynet.address(agent)))
+			skynet.rawsend(gate, "text", "start " .. fd)
+			opened = opened + 1
+		elseif cmd == "close" then
+			closed = closed + 1
+		end
+	end)
+	local fds = {}
+	for i = 1, CONN do
+		fds[i] = socket.open(HOST, PORT + frame)
+	end
+	while opened < CONN do
+		skynet.sleep(1)
+	end
+	for i, fd in ipairs(fds) do
+		local msg = "hello " .. i
+		socket.write(fd, string.pack(">s2", msg))
+		local sz = string.unpack(">I2", socket.read(fd, 2))
+		assert(socket.read(fd, sz) == msg)
+	end
+	local n = 0
+	for _ in pairs(owners) do
+		n = n + 1
+	end
+	assert(n == 4, n)
+	-- beyond max, the front gate closes the new connections
+	for i = 1, 4 do
+		local fd = socket.open(HOST, PORT + frame)
+		assert(socket.read(fd) == false)
+		socket.close(fd)
+	end
+	assert(opened == CONN, opened)
+	-- a connection is closed, then there is room for a new one
+	socket.close(fds[1])
+	while closed < 1 do
+		skynet.sleep(1)
+	end
+	skynet.sleep(10)
+	fds[1] = socket.open(HOST, PORT + frame)
+	while opened < CONN + 1 do
+		skynet.sleep(1)
+	end
+	socket.write(fds[1], string.pack(">s2", "again"))
+	local sz = string.unpack(">I2", socket.read(fds[1], 2))
+	assert(socket.read(fds[1], sz) == "again")
+	for i, fd in ipairs(fds) do
+		socket.close(fd)
+	end
+	while closed < CONN + 1 do
+		skynet.sleep(1)
+	end
+	skynet.rawsend(gate, "text", "close")
+	skynet.kill(gate)
+	print(string.format("gate frame = %d : %d connections by %d workers", frame, opened, n))
+end
+
+skynet.start(function()
+	test(0)
+	test(1)
+	skynet.exit()
+end)
+
+end
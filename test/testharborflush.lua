@@ -0,0 +1,79 @@
+--[[
+	The remote messages between two harbors keep the order across the flush of harbor send buffer (harbor_flush),
+	and a harbor can disconnect and connect again.
+
+	node 1 (harbor 1 and master) : start = "testharborflush", run it with harbor_flush = 0 and a small one (for example 64)
+	node 2 (harbor 2) : start = "testharborflush 2", run it twice while node 1 is running, the second one connects again.
+]]
+local skynet = require "skynet"
+local harbor = require "skynet.harbor"
+require "skynet.manager"	-- import skynet.abort
+
+local mode = ...
+
+local N = 1000
+-- smaller and larger than harbor_flush, and the buffer grows (MIN_SEND_BUFFER)
+local SIZES = { 1, 10, 60, 100, 1000, 5000, 70000 }
+
+-- send N messages of different sizes to address, some of them are calls, then check the order on the other side
+local function send(address)
+	for i = 1, N do
+		local s = string.rep("x", SIZES[i % #SIZES + 1])
+		if i % 100 == 0 then
+			assert(skynet.call(address, "lua", "call", i, s) == i)
+		else
+			skynet.send(address, "lua", "seq", i, s)
+		end
+	end
+	assert(skynet.call(address, "lua", "check") == N)
+end
+
+local last = 0
+local command = {}
+
+function command.seq(i, s)
+	assert(i == last + 1, "out of order")
+	assert(#s == SIZES[i % #SIZES + 1])
+	last = i
+end
+
+function command.call(i, s)
+	command.seq(i, s)
+	skynet.ret(skynet.pack(i))
+end
+
+function command.check()
+	local n = last
+	last = 0
+	skynet.ret(skynet.pack(n))
+end
+
+-- node 2 calls it after sending, node 1 sends to node 2 then
+function command.hello(address)
+	send(address)
+	skynet.ret()
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_, _, cmd, ...)
+		command[cmd](...)
+	end)
+	if mode == nil then
+		harbor.globalname "FLUSHTEST"
+		print("harbor_flush =", skynet.getenv "harbor_flush" or "default")
+		for round = 1, 2 do
+			harbor.connect(2)
+			print("harbor 2 connected", round)
+			harbor.link(2)
+			print("harbor 2 disconnected", round)
+		end
+		print("harbor flush ok")
+		skynet.exit()
+	else
+		local address = harbor.queryname "FLUSHTEST"
+		send(address)
+		skynet.call(address, "lua", "hello", skynet.self())
+		print("harbor flush round ok")
+		skynet.abort()
+	end
+end)
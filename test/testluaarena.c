@@ -0,0 +1,183 @@
+/*
+	Test of service-src/luaarena.h (the allocator of lua service when lua_arena = true),
+	skynet_lalloc is replaced here to simulate out of memory.
+
+	cc -O2 -Wall -Iservice-src -Iskynet-src -o testluaarena test/testluaarena.c && ./testluaarena
+ */
+
+#include "luaarena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static int oom = 0;
+
+void *
+skynet_lalloc(void *ptr, size_t osize, size_t nsize) {
+	if (nsize == 0) {
+		free(ptr);
+		return NULL;
+	}
+	if (oom)
+		return NULL;
+	return realloc(ptr, nsize);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(void) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static int failed = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); ++failed; } } while(0)
+
+#define OBJECTS 4096
+
+struct object {
+	unsigned char * ptr;
+	size_t sz;
+};
+
+static void
+fill(struct object *o, int i) {
+	size_t j;
+	for (j=0;j<o->sz;j++) {
+		o->ptr[j] = (unsigned char)(i + j);
+	}
+}
+
+static int
+verify(struct object *o, int i, size_t sz) {
+	size_t j;
+	for (j=0;j<sz;j++) {
+		if (o->ptr[j] != (unsigned char)(i + j))
+			return 0;
+	}
+	return 1;
+}
+
+// the same as the counters of arena
+static void
+check_stat(struct arena *a, struct object *obj) {
+	size_t used = 0, request = 0, large = 0;
+	int i;
+	for (i=0;i<OBJECTS;i++) {
+		size_t sz = obj[i].sz;
+		if (obj[i].ptr == NULL)
+			continue;
+		if (sz > ARENA_SMALL) {
+			large += sz;
+		} else {
+			used += ARENA_CLASSSIZE(ARENA_CLASSID(sz));
+			request += sz;
+		}
+	}
+	CHECK(a->used == used && a->request == request && a->large == large,
+		"stat : used %zu/%zu request %zu/%zu large %zu/%zu", a->used, used, a->request, request, a->large, large);
+	CHECK(a->used <= a->reserved, "stat : used %zu > reserved %zu", a->used, a->reserved);
+}
+
+static size_t
+random_size(void) {
+	// mostly small objects, as lua does
+	if (rnd() % 8 == 0)
+		return 1 + rnd() % 2048;
+	return 1 + rnd() % ARENA_SMALL;
+}
+
+static void
+test_random(void) {
+	struct arena * a = arena_new();
+	static struct object obj[OBJECTS];
+	memset(obj, 0, sizeof(obj));
+	int n;
+	for (n=0;n<200000;n++) {
+		int i = rnd() % OBJECTS;
+		struct object *o = &obj[i];
+		if (o->ptr == NULL) {
+			o->sz = random_size();
+			o->ptr = arena_lalloc(a, NULL, rnd() % 9, o->sz);
+			fill(o, i);
+		} else if (rnd() % 2) {
+			CHECK(verify(o, i, o->sz), "random : object %d (%zu) is broken", i, o->sz);
+			arena_lalloc(a, o->ptr, o->sz, 0);
+			o->ptr = NULL;
+		} else {
+			size_t nsz = random_size();
+			unsigned char * ptr = arena_lalloc(a, o->ptr, o->sz, nsz);
+			if (o->sz <= ARENA_SMALL && nsz <= ARENA_SMALL && ARENA_CLASSID(o->sz) == ARENA_CLASSID(nsz)) {
+				CHECK(ptr == o->ptr, "random : realloc in the same class moved");
+			}
+			o->ptr = ptr;
+			CHECK(verify(o, i, o->sz < nsz ? o->sz : nsz), "random : realloc %zu -> %zu is broken", o->sz, nsz);
+			o->sz = nsz;
+			fill(o, i);
+		}
+	}
+	check_stat(a, obj);
+	int i;
+	for (i=0;i<OBJECTS;i++) {
+		arena_lalloc(a, obj[i].ptr, obj[i].sz, 0);
+	}
+	CHECK(a->used == 0 && a->request == 0 && a->large == 0, "random : leak %zu %zu %zu", a->used, a->request, a->large);
+	arena_delete(a);
+}
+
+static void
+test_oom(void) {
+	struct arena * a = arena_new();
+	// no chunk
+	oom = 1;
+	CHECK(arena_lalloc(a, NULL, 0, 16) == NULL, "oom : small allocated");
+	CHECK(arena_lalloc(a, NULL, 0, 1000) == NULL, "oom : large allocated");
+	oom = 0;
+	void * large = arena_lalloc(a, NULL, 0, 1000);
+	void * small = arena_lalloc(a, NULL, 0, 200);
+	memset(large, 'L', 1000);
+	memset(small, 'S', 200);
+	oom = 1;
+	// use up the chunk
+	int n = 0;
+	while (arena_lalloc(a, NULL, 0, ARENA_ALIGN)) {
+		++n;
+	}
+	CHECK(n > 0 && a->end - a->ptr < ARENA_ALIGN, "oom : chunk is not used up");
+	size_t reserved = a->reserved;
+	// growing fails, and the object is kept
+	CHECK(arena_lalloc(a, small, 200, 2000) == NULL, "oom : grow");
+	CHECK(arena_lalloc(a, large, 1000, 2000) == NULL, "oom : grow large");
+	// shrinking never fails : the same block
+	CHECK(arena_lalloc(a, small, 200, ARENA_ALIGN) == small, "oom : shrink small");
+	CHECK(arena_lalloc(a, large, 1000, 100) == large, "oom : shrink large");
+	CHECK(((char *)small)[0] == 'S' && ((char *)large)[99] == 'L', "oom : shrink is broken");
+	CHECK(a->large == 0 && a->reserved == reserved + 1000, "oom : large %zu reserved %zu", a->large, a->reserved);
+	CHECK(a->used == (size_t)(n + 1) * ARENA_ALIGN + ARENA_CLASSSIZE(ARENA_CLASSID(100))
+		&& a->request == (size_t)(n + 1) * ARENA_ALIGN + 100, "oom : used %zu request %zu", a->used, a->request);
+	// they are freed into the freelist of the new class, and reused
+	arena_lalloc(a, large, 100, 0);
+	CHECK(arena_lalloc(a, NULL, 0, 100) == large, "oom : reuse large");
+	arena_lalloc(a, small, ARENA_ALIGN, 0);
+	CHECK(arena_lalloc(a, NULL, 0, ARENA_ALIGN) == small, "oom : reuse small");
+	oom = 0;
+	// the large block joined the arena, it's not freed by arena_delete
+	free(large);
+	arena_delete(a);
+}
+
+int
+main() {
+	test_random();
+	test_oom();
+	if (failed) {
+		printf("luaarena : %d failed\n", failed);
+		return 1;
+	}
+	printf("luaarena ok\n");
+	return 0;
+}
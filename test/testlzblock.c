@@ -0,0 +1,145 @@
+/*
+	Round trip test of service-src/lzblock.h (the compressor of harbor links).
+
+	cc -O2 -Wall -Iservice-src -o testlzblock test/testlzblock.c && ./testlzblock
+ */
+
+#include "lzblock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(void) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static int failed = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf(__VA_ARGS__); printf("\n"); ++failed; } } while(0)
+
+// text-like data : a few words repeated, compressible
+static void
+fill_text(uint8_t *buf, int n) {
+	static const char * words[] = { "skynet ", "harbor ", "message ", "service ", "0123 ", "\n" };
+	int i = 0;
+	while (i < n) {
+		const char * w = words[rnd() % 6];
+		int len = (int)strlen(w);
+		if (len > n - i)
+			len = n - i;
+		memcpy(buf + i, w, len);
+		i += len;
+	}
+}
+
+static void
+fill_random(uint8_t *buf, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		buf[i] = (uint8_t)rnd();
+	}
+}
+
+// a long run of one byte, the matches overlap themselves
+static void
+fill_run(uint8_t *buf, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		buf[i] = 'x';
+	}
+}
+
+// return the compressed size
+static int
+roundtrip(const char *name, const uint8_t *src, int n) {
+	int cap = lzb_bound(n);
+	uint8_t * block = malloc(cap);
+	uint8_t * out = malloc(n + 1);
+	int sz = lzb_compress(src, n, block, cap);
+	CHECK(sz > 0 && sz <= cap, "%s %d : compress %d (bound %d)", name, n, sz, cap);
+	if (sz > 0) {
+		int r = lzb_decompress(block, sz, out, n);
+		CHECK(r == n && memcmp(src, out, n) == 0, "%s %d : decompress %d", name, n, r);
+		// the original length is sent with the block, a wrong one must be rejected
+		r = lzb_decompress(block, sz, out, n + 1);
+		CHECK(r < 0, "%s %d : bad length %d accepted", name, n, n + 1);
+		if (n > 0) {
+			r = lzb_decompress(block, sz, out, n - 1);
+			CHECK(r < 0, "%s %d : bad length %d accepted", name, n, n - 1);
+		}
+		// every truncated block is corrupted (an empty block is the empty data)
+		int i;
+		for (i=(n > 0 ? 0 : sz);i<sz;i += (sz > 4096 ? 61 : 1)) {
+			r = lzb_decompress(block, i, out, n);
+			CHECK(r < 0, "%s %d : truncated block (%d/%d) accepted", name, n, i, sz);
+		}
+	}
+	free(out);
+	free(block);
+	return sz;
+}
+
+static void
+test_corrupted(void) {
+	// literal length extends out of the block
+	uint8_t lit[] = { 0xf0, 255, 255, 'a' };
+	uint8_t out[1024];
+	CHECK(lzb_decompress(lit, sizeof(lit), out, sizeof(out)) < 0, "literal out of block accepted");
+	// offset 0, and offset before the begin of output
+	uint8_t off0[] = { 0x10, 'a', 0, 0, 0x00 };
+	CHECK(lzb_decompress(off0, sizeof(off0), out, 5) < 0, "offset 0 accepted");
+	uint8_t off2[] = { 0x10, 'a', 2, 0, 0x00 };
+	CHECK(lzb_decompress(off2, sizeof(off2), out, 5) < 0, "offset out of output accepted");
+	// match length overflows the output
+	uint8_t mlen[] = { 0x1f, 'a', 1, 0, 255, 255, 0 };
+	CHECK(lzb_decompress(mlen, sizeof(mlen), out, 64) < 0, "match out of output accepted");
+	// random garbage never writes out of the output (run it with -fsanitize=address)
+	int i;
+	for (i=0;i<10000;i++) {
+		uint8_t garbage[64];
+		fill_random(garbage, sizeof(garbage));
+		int size = rnd() % 256;
+		uint8_t * dst = malloc(size + 1);
+		lzb_decompress(garbage, rnd() % sizeof(garbage), dst, size);
+		free(dst);
+	}
+}
+
+int
+main() {
+	static const int sizes[] = { 0, 1, 5, 12, 13, 16, 100, 255, 1000, 4096, 65536, 70000, 1 << 20 };
+	int i;
+	for (i=0;i<(int)(sizeof(sizes)/sizeof(sizes[0]));i++) {
+		int n = sizes[i];
+		uint8_t * buf = malloc(n + 1);
+		fill_text(buf, n);
+		int sz = roundtrip("text", buf, n);
+		if (n >= 4096) {
+			CHECK(sz < n / 2, "text %d : compressed to %d", n, sz);
+		}
+		fill_run(buf, n);
+		roundtrip("run", buf, n);
+		fill_random(buf, n);
+		sz = roundtrip("random", buf, n);
+		// incompressible : never larger than the bound, and not enough when the cap is the size (harbor sends it raw)
+		if (n >= 1000) {
+			uint8_t * block = malloc(n);
+			CHECK(lzb_compress(buf, n, block, n) == 0, "random %d : compressed into %d bytes", n, n);
+			free(block);
+		}
+		free(buf);
+	}
+	test_corrupted();
+	if (failed) {
+		printf("lzblock : %d failed\n", failed);
+		return 1;
+	}
+	printf("lzblock ok\n");
+	return 0;
+}
@@ -0,0 +1,30 @@
+local skynet = require "skynet"
+
+local cache = {}
+local recovered = false
+
+skynet.memsoftlimit(4 * 1024 * 1024, function(over, mem)
+	skynet.error(string.format("soft limit %s, memory %.2f M", over and "exceeded" or "recovered", mem / (1024 * 1024)))
+	if over then
+		-- degrade : drop the cache
+		cache = nil
+	else
+		recovered = true
+	end
+end)
+
+skynet.start(function()
+	local i = 0
+	while cache do
+		i = i + 1
+		cache[#cache+1] = { i, tostring(i) }
+		if i % 1000 == 0 then
+			skynet.yield()	-- the soft limit is checked between messages
+		end
+	end
+	while not recovered do
+		skynet.sleep(1)
+	end
+	skynet.error(string.format("done, memory %.2f M", collectgarbage "count" / 1024))
+	skynet.exit()
+end)
@@ -0,0 +1,48 @@
+-- launch more than one listener with SO_REUSEPORT on the same address, the kernel balances the accepts
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local mode, n = ...
+
+local HOST = "127.0.0.1"
+local PORT = 8012
+
+if mode == "listener" then
+	local accepted = 0
+	skynet.start(function()
+		local id = socket.listen(HOST, PORT, nil, true)
+		socket.start(id, function(fd)
+			accepted = accepted + 1
+			socket.close(fd)
+		end)
+		skynet.dispatch("lua", function()
+			skynet.ret(skynet.pack(accepted))
+			socket.close(id)
+			skynet.exit()
+		end)
+	end)
+else
+	n = tonumber(n) or 4
+	local CONN = 200
+	skynet.start(function()
+		local listener = {}
+		for i = 1, n do
+			listener[i] = skynet.newservice(SERVICE_NAME, "listener")
+		end
+		for i = 1, CONN do
+			local fd = socket.open(HOST, PORT)
+			if fd then
+				socket.close(fd)
+			end
+		end
+		skynet.sleep(10)
+		local total = 0
+		for i = 1, n do
+			local accepted = skynet.call(listener[i], "lua")
+			print(string.format("listener %d accepted %d", i, accepted))
+			total = total + accepted
+		end
+		print("total", total)
+		skynet.exit()
+	end)
+end
@@ -0,0 +1,55 @@
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local HOST = "127.0.0.1"
+local PORT = 8012
+local FILENAME = "./test/testsendfile.lua"
+
+local function readfile(filename)
+	local f = assert(io.open(filename, "rb"))
+	local content = f:read "a"
+	f:close()
+	return content
+end
+
+local function server(id)
+	socket.start(id)
+	socket.zerocopy(id)
+	-- the whole file, then a region of it
+	assert(socket.sendfile(id, FILENAME))
+	assert(socket.sendfile(id, FILENAME, 6, 7))
+	-- large packages would be sent with MSG_ZEROCOPY
+	for i = 1, 8 do
+		socket.write(id, string.rep(string.char(64 + i), 64 * 1024))
+	end
+	-- larger than the socket buffer, they are sent partly while the client is sleeping
+	for i = 1, 4 do
+		socket.write(id, string.rep(string.char(96 + i), 4 * 1024 * 1024))
+	end
+	socket.close(id)
+end
+
+skynet.start(function()
+	local content = readfile(FILENAME)
+	local listen_id = socket.listen(HOST, PORT)
+	socket.start(listen_id, function(id)
+		skynet.fork(server, id)
+	end)
+
+	local id = assert(socket.open(HOST, PORT))
+	assert(socket.read(id, #content) == content)
+	assert(socket.read(id, 7) == content:sub(7, 13))
+	for i = 1, 8 do
+		assert(socket.read(id, 64 * 1024) == string.rep(string.char(64 + i), 64 * 1024))
+	end
+	-- slow reader
+	skynet.sleep(50)
+	for i = 1, 4 do
+		assert(socket.read(id, 4 * 1024 * 1024) == string.rep(string.char(96 + i), 4 * 1024 * 1024))
+	end
+	assert(not socket.read(id))
+	socket.close(id)
+	socket.close(listen_id)
+	print("sendfile/zerocopy ok")
+	skynet.exit()
+end)
@@ -0,0 +1,176 @@
+-- round trip of skynet.pack with seri_extend (the table size hints and the key dictionary, see lua-seri.c),
+-- and the malformed streams must raise "Invalid serialize stream".
+-- seri_extend is set by this test if the config doesn't set it, it's effective for the services launched after.
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "worker" then
+
+local function equal(a, b)
+	if type(a) ~= "table" or type(b) ~= "table" then
+		return a == b
+	end
+	for k, v in pairs(a) do
+		if not equal(v, b[k]) then
+			return false
+		end
+	end
+	for k in pairs(b) do
+		if a[k] == nil then
+			return false
+		end
+	end
+	return true
+end
+
+local function roundtrip(name, ...)
+	local msg = skynet.packstring(...)
+	local n = select("#", ...)
+	local result = table.pack(skynet.unpack(msg))
+	assert(result.n == n, name)
+	for i = 1, n do
+		assert(equal(select(i, ...), result[i]), name)
+	end
+	-- the lightuserdata message is the same
+	local ptr, sz = skynet.pack(...)
+	result = table.pack(skynet.unpack(ptr, sz))
+	skynet.trash(ptr, sz)
+	for i = 1, n do
+		assert(equal(select(i, ...), result[i]), name)
+	end
+	return msg
+end
+
+local TYPE_EXTEND = 7
+local function combine(t, v)
+	return t | v << 3
+end
+local EXTEND_TABLE = combine(TYPE_EXTEND, 0)
+local EXTEND_KEY = combine(TYPE_EXTEND, 1)
+local EXTEND_KEYREF = combine(TYPE_EXTEND, 2)
+
+local function records(n, nkey)
+	local r = {}
+	for i = 1, n do
+		local t = {}
+		for j = 1, nkey do
+			t[string.format("key%02d", j)] = i * 100 + j
+		end
+		r[i] = t
+	end
+	return r
+end
+
+local function test_dictionary()
+	-- more than 16 (DICT_THRESHOLD) repeated keys
+	local r = records(50, 8)
+	local msg = roundtrip("repeated keys", r)
+	assert(msg:find(string.char(EXTEND_KEY), 1, true), "no key in dictionary")
+	local plain = 0
+	for _, t in ipairs(r) do
+		plain = plain + #skynet.packstring(t)
+	end
+	assert(#msg < plain, "dictionary is not shorter")
+	-- the ids 1~29 are in the type byte (EXTEND_KEYREF_SHORT), 30 and above follow EXTEND_KEYREF
+	msg = roundtrip("dictionary ids", records(4, 64))
+	assert(msg:find(string.char(combine(TYPE_EXTEND, 2 + 29)), 1, true), "no id 29")
+	assert(msg:find(string.char(EXTEND_KEYREF), 1, true), "no id beyond 29")
+	-- the dictionary is reset for each value of the message
+	roundtrip("values", records(3, 20), records(3, 20), "tail", records(2, 40))
+	print("seri extend dictionary ok")
+end
+
+local function test_hint()
+	-- array and hash part
+	local t = { 1, 2, 3 }
+	for i = 1, 10 do
+		t["k" .. i] = i
+	end
+	local msg = roundtrip("hint", t)
+	assert(msg:byte(1) == EXTEND_TABLE)
+	-- a hash part larger than 0xffff keys, the hint is clamped
+	t = {}
+	for i = 1, 70000 do
+		t["key" .. i] = i
+	end
+	msg = roundtrip("large hash", t)
+	-- EXTEND_TABLE, array size 0 (TYPE_NUMBER_ZERO), hint (uint16)
+	assert(msg:byte(1) == EXTEND_TABLE and msg:byte(2) == 2)
+	assert(string.unpack("<I2", msg, 3) == 0xffff)
+	-- small tables keep TYPE_TABLE
+	msg = roundtrip("small", { a = 1, b = 2 })
+	assert(msg:byte(1) ~= EXTEND_TABLE)
+	print("seri extend hint ok")
+end
+
+local function test_array()
+	-- the integers of array part are decoded in place (all the sizes), the others as usual
+	local t = { 0, 1, 255, 256, 65535, 65536, -1, -70000, 0x7fffffff, -0x80000000, 1 << 40, 1.5, "s", { 1, 2 }, true }
+	roundtrip("array", t)
+	local large = {}
+	for i = 1, 1000 do
+		large[i] = i * 97
+	end
+	large.name = "large"
+	roundtrip("large array", large)
+	print("seri extend array ok")
+end
+
+local function invalid(name, msg)
+	local ok, err = pcall(skynet.unpack, msg)
+	assert(not ok, name)
+	assert(err:find "Invalid serialize stream", err)
+end
+
+local function test_malformed()
+	local msg = skynet.packstring(records(20, 40))
+	-- every truncated table is invalid
+	for i = 1, #msg - 1, 7 do
+		invalid("truncated " .. i, msg:sub(1, i))
+	end
+	msg = skynet.packstring { 1, 256, 65536, 1 << 40 }
+	for i = 1, #msg - 1 do
+		invalid("truncated array " .. i, msg:sub(1, i))
+	end
+	-- a reference before any key in dictionary (short and long)
+	invalid("short ref", string.char(combine(TYPE_EXTEND, 3)))
+	invalid("long ref", string.char(EXTEND_KEYREF, combine(2, 1), 1))
+	-- a reference beyond the dictionary
+	invalid("ref beyond", string.char(EXTEND_KEY, combine(4, 2)) .. "ab" .. string.char(combine(TYPE_EXTEND, 4)))
+	-- id 0
+	invalid("ref 0", string.char(EXTEND_KEY, combine(4, 2)) .. "ab" .. string.char(EXTEND_KEYREF, 2))
+	-- the key in dictionary must be a string
+	invalid("key type", string.char(EXTEND_KEY, 2))
+	-- EXTEND_TABLE without the hint
+	invalid("no hint", string.char(EXTEND_TABLE, 2, 0))
+	-- unknown cookie of long string
+	invalid("long string", string.char(combine(5, 3), 0, 0))
+	print("seri extend malformed ok")
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		test_dictionary()
+		test_hint()
+		test_array()
+		test_malformed()
+		skynet.ret()
+		skynet.exit()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	if skynet.getenv "seri_extend" == nil then
+		skynet.setenv("seri_extend", "true")
+	end
+	assert(skynet.getenv "seri_extend" == "true", "seri_extend is disabled in config")
+	local worker = skynet.newservice(SERVICE_NAME, "worker")
+	skynet.call(worker, "lua")
+	print("seri extend ok")
+	skynet.exit()
+end)
+
+end
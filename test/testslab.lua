@@ -0,0 +1,104 @@
+-- the small message slab (skynet_message_malloc in malloc_hook.c) : the blocks are reused,
+-- the counters of shards are summed by memory.slab(), and the blocks in use are counted in memory.total()/block().
+local skynet = require "skynet"
+local memory = require "skynet.memory"
+
+local mode = ...
+
+if mode == "sink" then
+
+skynet.start(function()
+	local n = 0
+	skynet.dispatch("lua", function(_, _, cmd)
+		if cmd == "count" then
+			skynet.ret(skynet.pack(n))
+		elseif cmd == "exit" then
+			skynet.exit()
+		else
+			n = n + 1
+		end
+	end)
+end)
+
+else
+
+local N = 1000
+
+-- the class of 32 bytes
+local function class32()
+	for _, c in ipairs(memory.slab()) do
+		if c.size == 32 then
+			return c
+		end
+	end
+end
+
+local function test_stats()
+	local c0 = class32()
+	local total0, block0 = memory.total(), memory.block()
+	local msg = {}
+	for i = 1, N do
+		msg[i] = table.pack(skynet.pack(i))
+	end
+	local c1 = class32()
+	assert(c1.hit - c0.hit >= N, "hit")
+	assert(c1.inuse - c0.inuse >= N, "inuse")
+	-- the slab blocks are counted in the memory of process
+	assert(memory.total() - total0 >= N * 32, "total")
+	assert(memory.block() - block0 >= N, "block")
+	for i = 1, N do
+		skynet.trash(msg[i][1], msg[i][2])
+	end
+	local c2 = class32()
+	assert(c2.inuse - c0.inuse < N, "free")
+	assert(memory.block() - block0 < N, "block free")
+	print("slab stats ok")
+end
+
+local function test_reuse()
+	local c0 = class32()
+	for _ = 1, 10 do
+		local msg = {}
+		for i = 1, N do
+			msg[i] = table.pack(skynet.pack(i))
+		end
+		for i = 1, N do
+			skynet.trash(msg[i][1], msg[i][2])
+		end
+	end
+	-- the freed blocks are popped again, the untouched slots are used only for the first round
+	local c1 = class32()
+	assert(c1.hit - c0.hit >= 10 * N, "hit")
+	assert(c1.touched - c0.touched <= N, "reuse")
+	print("slab reuse ok")
+end
+
+local function test_send()
+	-- the blocks are allocated in this thread and freed in the thread of sink
+	local c0 = class32()
+	local sink = skynet.newservice(SERVICE_NAME, "sink")
+	for i = 1, N do
+		skynet.send(sink, "lua", i)
+	end
+	assert(skynet.call(sink, "lua", "count") == N)
+	local c1 = class32()
+	assert(c1.hit - c0.hit >= N, "hit")
+	assert(c1.inuse - c0.inuse < N, "inuse")
+	skynet.send(sink, "lua", "exit")
+	print("slab send ok")
+end
+
+skynet.start(function()
+	if next(memory.slab()) == nil then
+		print("slab is disabled (NOUSE_JEMALLOC)")
+		skynet.exit()
+		return
+	end
+	test_stats()
+	test_reuse()
+	test_send()
+	print("slab ok")
+	skynet.exit()
+end)
+
+end
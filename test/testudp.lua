@@ -19,7 +19,36 @@ local function client()
 	end
 end
 
+-- the datagrams read together are delivered in one message (SKYNET_SOCKET_TYPE_UDP_BATCH)
+local function batch()
+	local N = 1000
+	local n = 0
+	local host = socket.udp(function(str, from)
+		n = n + 1
+		assert(str == "batch " .. n, str)
+		assert(socket.udp_address(from) == "127.0.0.1")
+	end , "127.0.0.1", 8766, true)
+	local c = socket.udp(function() end)
+	socket.udp_connect(c, "127.0.0.1", 8766)
+	-- send 50 datagrams at a time, not to overflow the receive buffer of the socket
+	for i=1,N,50 do
+		for j=i,i+49 do
+			socket.write(c, "batch " .. j)
+		end
+		for _=1,100 do
+			if n >= i + 49 then
+				break
+			end
+			skynet.sleep(1)
+		end
+	end
+	print("batch recv", n, n == N and "ok" or "lost")
+	socket.close(host)
+	socket.close(c)
+end
+
 skynet.start(function()
 	skynet.fork(server)
 	skynet.fork(client)
+	skynet.fork(batch)
 end)
@@ -0,0 +1,67 @@
+local skynet = require "skynet"
+require "skynet.manager"	-- inject skynet.forward_type
+
+local mode = ...
+
+if mode == "worker" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function (_,_, cmd, ...)
+		assert(cmd == "echo")
+		skynet.ret(skynet.pack(...))
+	end)
+end)
+
+elseif mode == "router" then
+
+-- keep the raw message, route it by the first value
+skynet.register_protocol {
+	name = "system",
+	id = skynet.PTYPE_SYSTEM,
+	unpack = function (msg, sz) return msg, sz end,
+}
+
+local forward_map = {
+	[skynet.PTYPE_LUA] = skynet.PTYPE_SYSTEM,
+	[skynet.PTYPE_RESPONSE] = skynet.PTYPE_RESPONSE,
+}
+
+skynet.forward_type(forward_map, function()
+	local worker = skynet.newservice(SERVICE_NAME, "worker")
+	skynet.dispatch("system", function (session, source, msg, sz)
+		local route, rest, restsz = skynet.unpackhead(msg, sz, 1)
+		skynet.trash(msg, sz)
+		-- forward the rest of message without unpacking it
+		skynet.redirect(worker, source, "lua", session, rest, restsz)
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local keys = {}
+	for i=1,64 do
+		keys["key" .. i] = i
+	end
+	local msg, sz = skynet.pack("cmd", keys, "tail", keys)
+	local cmd, rest, restsz = skynet.unpackhead(msg, sz, 1)
+	assert(cmd == "cmd")
+	local t1, tail, t2 = skynet.unpack(rest, restsz)
+	assert(tail == "tail" and t1.key64 == 64 and t2.key33 == 33)
+	skynet.trash(rest, restsz)
+	local cmd, rest = skynet.unpackhead(msg, sz, 1, true)
+	assert(cmd == "cmd" and type(rest) == "string")
+	local t1, tail, t2 = skynet.unpack(rest)
+	assert(tail == "tail" and t1.key64 == 64 and t2.key33 == 33)
+	local a, b, c, d, e, rest = skynet.unpackhead(msg, sz, 5)
+	assert(a == "cmd" and d.key1 == 1 and e == nil and rest == nil)
+	skynet.trash(msg, sz)
+
+	local router = skynet.newservice(SERVICE_NAME, "router")
+	local r1, r2 = skynet.call(router, "lua", "worker", "echo", "hello", keys)
+	assert(r1 == "hello" and r2.key64 == 64)
+	print("unpackhead ok")
+	skynet.exit()
+end)
+
+end